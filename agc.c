@@ -0,0 +1,225 @@
+#include "agc.h"
+#include <math.h>
+
+// chunk length keeps int32 power accumulator from overflowing (128^2 * 2^16 = 2^30)
+#define CHUNK_VALUES 65536
+#define CLIP_BACKOFF_DB 6
+#define LNA_STEP 8
+#define VGA_STEP 2
+
+void rx_stats_compute(const int8_t *restrict buf, size_t len, struct rx_stats *s) {
+    uint64_t power = 0;
+    uint32_t clipped = 0;
+
+    for (size_t base = 0; base < len; base += CHUNK_VALUES) {
+        size_t n = len - base < CHUNK_VALUES ? len - base : CHUNK_VALUES;
+        const int8_t *x = buf + base;
+        int32_t p = 0;
+        int32_t c = 0;
+
+        for (size_t i = 0; i < n; i++) {
+            int32_t v = x[i];
+            p += v * v;
+            c += (v >= 127) | (v <= -127);
+        }
+
+        power += (uint64_t) p;
+        clipped += (uint32_t) c;
+    }
+
+    s->samples = len / 2;
+    s->clipped = clipped;
+    s->power = s->samples > 0 ? (float) ((double) power / (double) s->samples / (128.0 * 128.0)) : 0.0f;
+}
+
+static int clamp_gain(int v, int step, uint32_t min, uint32_t max) {
+    v -= v % step;
+    if (v < (int) min) {
+        v = (int) min;
+    }
+    if (v > (int) max) {
+        v = (int) max;
+    }
+    return v;
+}
+
+static bool agc_step(const struct agc_config *c, const struct rx_stats *s, float power_db,
+        uint32_t *lna_gain, uint32_t *vga_gain) {
+    float err = c->target_db - power_db;
+    int delta;
+
+    if (s->samples > 0 && (float) s->clipped > c->clip_limit * 2.0f * (float) s->samples) {
+        delta = -CLIP_BACKOFF_DB;
+        if (err < (float) delta) {
+            delta = (int) lrintf(err);
+        }
+    } else if (fabsf(err) > c->hysteresis_db) {
+        delta = (int) lrintf(err);
+    } else {
+        return false;
+    }
+
+    // vga takes the fine part of the correction, lna moves in whole steps
+    int vga = clamp_gain((int) *vga_gain + delta, VGA_STEP, c->vga_min, c->vga_max);
+    delta -= vga - (int) *vga_gain;
+    int lna_delta = delta >= 0 ? (delta / LNA_STEP) * LNA_STEP : -((-delta + LNA_STEP - 1) / LNA_STEP) * LNA_STEP;
+    int lna = clamp_gain((int) *lna_gain + lna_delta, LNA_STEP, c->lna_min, c->lna_max);
+
+    if ((uint32_t) lna == *lna_gain && (uint32_t) vga == *vga_gain) {
+        return false;
+    }
+
+    *lna_gain = (uint32_t) lna;
+    *vga_gain = (uint32_t) vga;
+    return true;
+}
+
+static void *agc_thread(void *arg) {
+    struct agc *a = (struct agc *) arg;
+
+    pthread_mutex_lock(&a->mutex);
+    while (a->running) {
+        while (a->running && !a->pending) {
+            pthread_cond_wait(&a->cond, &a->mutex);
+        }
+
+        if (!a->running) {
+            break;
+        }
+
+        a->pending = false;
+        if (a->skip > 0) {
+            a->skip--;
+            continue;
+        }
+
+        uint32_t lna = a->lna_gain;
+        uint32_t vga = a->vga_gain;
+        if (!agc_step(&a->config, &a->last, a->power_db, &lna, &vga)) {
+            continue;
+        }
+
+        // control transfers are slow, don't hold the lock while they are in progress
+        pthread_mutex_unlock(&a->mutex);
+        int ret = a->set_gain(a->ctx, lna, vga);
+        pthread_mutex_lock(&a->mutex);
+
+        if (ret == 0) {
+            a->lna_gain = lna;
+            a->vga_gain = vga;
+            a->adjustments++;
+            a->skip = a->config.holdoff;
+        }
+    }
+    pthread_mutex_unlock(&a->mutex);
+
+    return NULL;
+}
+
+void agc_init(struct agc *a, agc_set_gain_fn set_gain, void *ctx) {
+    pthread_mutex_init(&a->mutex, NULL);
+    pthread_cond_init(&a->cond, NULL);
+    a->running = false;
+    a->pending = false;
+    a->set_gain = set_gain;
+    a->ctx = ctx;
+    a->config = (struct agc_config) {0};
+    a->lna_gain = 0;
+    a->vga_gain = 0;
+    agc_reset_stats(a);
+}
+
+void agc_deinit(struct agc *a) {
+    agc_stop(a);
+    pthread_mutex_destroy(&a->mutex);
+    pthread_cond_destroy(&a->cond);
+}
+
+bool agc_start(struct agc *a, const struct agc_config *config) {
+    agc_stop(a);
+
+    pthread_mutex_lock(&a->mutex);
+    a->config = *config;
+    uint32_t lna = (uint32_t) clamp_gain((int) a->lna_gain, LNA_STEP, config->lna_min, config->lna_max);
+    uint32_t vga = (uint32_t) clamp_gain((int) a->vga_gain, VGA_STEP, config->vga_min, config->vga_max);
+    pthread_mutex_unlock(&a->mutex);
+
+    if (a->set_gain(a->ctx, lna, vga) != 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&a->mutex);
+    a->lna_gain = lna;
+    a->vga_gain = vga;
+    a->pending = false;
+    a->skip = config->holdoff;
+    a->running = true;
+    if (pthread_create(&a->thread, NULL, agc_thread, a) != 0) {
+        a->running = false;
+    }
+    bool running = a->running;
+    pthread_mutex_unlock(&a->mutex);
+
+    return running;
+}
+
+void agc_stop(struct agc *a) {
+    pthread_mutex_lock(&a->mutex);
+    bool running = a->running;
+    a->running = false;
+    pthread_cond_broadcast(&a->cond);
+    pthread_mutex_unlock(&a->mutex);
+
+    if (running) {
+        pthread_join(a->thread, NULL);
+    }
+}
+
+void agc_update(struct agc *a, const struct rx_stats *s, uint32_t *lna_gain, uint32_t *vga_gain) {
+    pthread_mutex_lock(&a->mutex);
+    a->last = *s;
+    a->transfers++;
+    a->clipped_total += s->clipped;
+    a->power_db = 10.0f * log10f(s->power + 1e-12f);
+    *lna_gain = a->lna_gain;
+    *vga_gain = a->vga_gain;
+    if (a->running) {
+        a->pending = true;
+        pthread_cond_signal(&a->cond);
+    }
+    pthread_mutex_unlock(&a->mutex);
+}
+
+void agc_set_gains(struct agc *a, uint32_t lna_gain, uint32_t vga_gain) {
+    pthread_mutex_lock(&a->mutex);
+    a->lna_gain = lna_gain;
+    a->vga_gain = vga_gain;
+    a->skip = a->config.holdoff;
+    pthread_mutex_unlock(&a->mutex);
+}
+
+void agc_get_status(struct agc *a, struct agc_status *st) {
+    pthread_mutex_lock(&a->mutex);
+    st->last = a->last;
+    st->transfers = a->transfers;
+    st->clipped_total = a->clipped_total;
+    st->adjustments = a->adjustments;
+    st->power_db = a->power_db;
+    st->lna_gain = a->lna_gain;
+    st->vga_gain = a->vga_gain;
+    st->running = a->running;
+    pthread_mutex_unlock(&a->mutex);
+}
+
+void agc_reset_stats(struct agc *a) {
+    pthread_mutex_lock(&a->mutex);
+    a->last.power = 0.0f;
+    a->last.clipped = 0;
+    a->last.samples = 0;
+    a->transfers = 0;
+    a->clipped_total = 0;
+    a->adjustments = 0;
+    a->skip = 0;
+    a->power_db = -120.0f;
+    pthread_mutex_unlock(&a->mutex);
+}
@@ -0,0 +1,154 @@
+#ifndef AGC_H
+#define AGC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * Per-transfer statistics
+ */
+struct rx_stats {
+    float power;        // mean |x|^2, 1.0 = full scale
+    uint32_t clipped;   // number of I/Q values at full scale (127, -127, -128)
+    size_t samples;     // number of complex samples
+};
+
+/**
+ * Gain limits and loop parameters
+ */
+struct agc_config {
+    float target_db;        // target mean power in dBFS
+    float hysteresis_db;    // no adjustment while |power - target| is below this
+    float clip_limit;       // fraction of clipped values that forces a gain reduction
+    uint32_t lna_min;
+    uint32_t lna_max;
+    uint32_t vga_min;
+    uint32_t vga_max;
+    uint32_t holdoff;       // transfers to ignore after a gain change
+};
+
+/**
+ * Snapshot of statistics and loop state
+ */
+struct agc_status {
+    struct rx_stats last;
+    uint64_t transfers;
+    uint64_t clipped_total;
+    uint64_t adjustments;
+    float power_db;
+    uint32_t lna_gain;
+    uint32_t vga_gain;
+    bool running;
+};
+
+/**
+ * Callback used by the AGC thread to apply gains
+ *
+ * @return 0 on success
+ */
+typedef int (*agc_set_gain_fn)(void *ctx, uint32_t lna_gain, uint32_t vga_gain);
+
+/**
+ * Automatic gain control. Statistics are posted from the rx callback, gain
+ * changes are issued from a separate thread so the rx callback never blocks
+ * on control transfers
+ */
+struct agc {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool running;
+    bool pending;
+    struct agc_config config;
+    agc_set_gain_fn set_gain;
+    void *ctx;
+
+    struct rx_stats last;
+    uint64_t transfers;
+    uint64_t clipped_total;
+    uint64_t adjustments;
+    uint32_t skip;
+    float power_db;
+    uint32_t lna_gain;
+    uint32_t vga_gain;
+};
+
+/**
+ * Compute statistics of interleaved int8 IQ samples
+ *
+ * @param buf interleaved IQ samples
+ * @param len buffer length in bytes
+ * @param s pointer to store the statistics
+ */
+void rx_stats_compute(const int8_t *buf, size_t len, struct rx_stats *s);
+
+/**
+ * Initialize AGC state. The control thread is not started
+ *
+ * @param a agc
+ * @param set_gain callback that applies gains
+ * @param ctx callback context
+ */
+void agc_init(struct agc *a, agc_set_gain_fn set_gain, void *ctx);
+
+/**
+ * Stop the control thread and destroy AGC state
+ *
+ * @param a agc
+ */
+void agc_deinit(struct agc *a);
+
+/**
+ * Start the control thread. Current gains are clamped to the limits and applied
+ *
+ * @param a agc
+ * @param config loop configuration
+ *
+ * @return false if the thread could not be started
+ */
+bool agc_start(struct agc *a, const struct agc_config *config);
+
+/**
+ * Stop the control thread
+ *
+ * @param a agc
+ */
+void agc_stop(struct agc *a);
+
+/**
+ * Post statistics of a transfer and wake up the control thread
+ *
+ * @param a agc
+ * @param s transfer statistics
+ * @param lna_gain pointer to store the lna gain in effect
+ * @param vga_gain pointer to store the vga gain in effect
+ */
+void agc_update(struct agc *a, const struct rx_stats *s, uint32_t *lna_gain, uint32_t *vga_gain);
+
+/**
+ * Record gains that were set outside of the AGC loop
+ *
+ * @param a agc
+ * @param lna_gain lna gain
+ * @param vga_gain vga gain
+ */
+void agc_set_gains(struct agc *a, uint32_t lna_gain, uint32_t vga_gain);
+
+/**
+ * Read statistics and loop state
+ *
+ * @param a agc
+ * @param st pointer to store the status
+ */
+void agc_get_status(struct agc *a, struct agc_status *st);
+
+/**
+ * Reset accumulated statistics
+ *
+ * @param a agc
+ */
+void agc_reset_stats(struct agc *a);
+
+#endif // AGC_H
@@ -0,0 +1,402 @@
+#include "correlator.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_FFT_SIZE 1024
+#define CONVERT_CHUNK 1024
+
+static size_t next_pow2(size_t v) {
+    size_t p = 1;
+    while (p < v) {
+        p <<= 1;
+    }
+    return p;
+}
+
+static void free_buffers(struct correlator *c) {
+    fft_deinit(&c->fft);
+    free(c->segment);
+    free(c->work);
+    free(c->product);
+    free(c->energy);
+    free(c->ring);
+    c->segment = NULL;
+    c->work = NULL;
+    c->product = NULL;
+    c->energy = NULL;
+    c->ring = NULL;
+
+    for (size_t i = 0; i < c->n_templates; i++) {
+        free(c->templates[i].spectrum);
+        c->templates[i].spectrum = NULL;
+    }
+
+    for (size_t i = 0; i < c->n_pending; i++) {
+        free(c->pending[i].window);
+    }
+    c->n_pending = 0;
+}
+
+void correlator_init(struct correlator *c) {
+    memset(c, 0, sizeof(*c));
+}
+
+int correlator_add_template(struct correlator *c, const float *samples, size_t len, float threshold) {
+    if (c->n_templates >= CORRELATOR_MAX_TEMPLATES || len == 0) {
+        return -1;
+    }
+
+    double energy = 0.0;
+    for (size_t i = 0; i < 2 * len; i++) {
+        energy += (double) samples[i] * samples[i];
+    }
+    if (energy <= 0.0) {
+        return -1;
+    }
+
+    float *taps = malloc(2 * len * sizeof(float));
+    if (taps == NULL) {
+        return -1;
+    }
+
+    float scale = (float) (1.0 / sqrt(energy));
+    for (size_t i = 0; i < 2 * len; i++) {
+        taps[i] = samples[i] * scale;
+    }
+
+    struct correlator_template *t = &c->templates[c->n_templates];
+    memset(t, 0, sizeof(*t));
+    t->len = len;
+    t->threshold = threshold;
+    t->taps = taps;
+
+    return (int) c->n_templates++;
+}
+
+void correlator_clear(struct correlator *c) {
+    free_buffers(c);
+    for (size_t i = 0; i < c->n_templates; i++) {
+        free(c->templates[i].taps);
+    }
+    c->n_templates = 0;
+}
+
+bool correlator_prepare(struct correlator *c, size_t pre, size_t post, correlator_emit_fn emit, void *ctx) {
+    free_buffers(c);
+
+    if (c->n_templates == 0) {
+        return false;
+    }
+
+    c->max_len = 0;
+    for (size_t i = 0; i < c->n_templates; i++) {
+        if (c->templates[i].len > c->max_len) {
+            c->max_len = c->templates[i].len;
+        }
+    }
+
+    c->n_fft = next_pow2(4 * c->max_len);
+    if (c->n_fft < MIN_FFT_SIZE) {
+        c->n_fft = MIN_FFT_SIZE;
+    }
+    c->step = c->n_fft - c->max_len + 1;
+    c->pre = pre;
+    c->post = post;
+    c->emit = emit;
+    c->ctx = ctx;
+
+    if (!fft_init(&c->fft, c->n_fft)) {
+        return false;
+    }
+
+    size_t bytes = 2 * c->n_fft * sizeof(float);
+    c->segment = malloc(bytes);
+    c->work = malloc(bytes);
+    c->product = malloc(bytes);
+    c->energy = malloc((c->n_fft + 1) * sizeof(double));
+    if (c->segment == NULL || c->work == NULL || c->product == NULL || c->energy == NULL) {
+        free_buffers(c);
+        return false;
+    }
+
+    if (pre + post > 0) {
+        c->ring_size = next_pow2(pre + c->max_len + post + 2 * c->n_fft);
+        c->ring = malloc(2 * c->ring_size * sizeof(float));
+        if (c->ring == NULL) {
+            free_buffers(c);
+            return false;
+        }
+    }
+
+    // conjugated template spectra, scaled so the inverse transform is normalized
+    for (size_t i = 0; i < c->n_templates; i++) {
+        struct correlator_template *t = &c->templates[i];
+        t->spectrum = calloc(2 * c->n_fft, sizeof(float));
+        if (t->spectrum == NULL) {
+            free_buffers(c);
+            return false;
+        }
+
+        memcpy(t->spectrum, t->taps, 2 * t->len * sizeof(float));
+        fft_forward(&c->fft, t->spectrum);
+
+        float scale = 1.0f / (float) c->n_fft;
+        for (size_t k = 0; k < c->n_fft; k++) {
+            t->spectrum[2 * k] *= scale;
+            t->spectrum[2 * k + 1] *= -scale;
+        }
+    }
+
+    correlator_reset(c);
+    return true;
+}
+
+void correlator_reset(struct correlator *c) {
+    c->fill = 0;
+    c->segment_idx = 0;
+    c->origin = 0;
+    c->written = 0;
+    atomic_store(&c->events, 0);
+
+    for (size_t i = 0; i < c->n_pending; i++) {
+        free(c->pending[i].window);
+    }
+    c->n_pending = 0;
+
+    for (size_t i = 0; i < c->n_templates; i++) {
+        c->templates[i].in_peak = false;
+    }
+}
+
+static void extract_window(struct correlator *c, struct correlator_event *e) {
+    uint64_t oldest = c->written > c->ring_size ? c->written - c->ring_size : 0;
+    if (oldest < c->origin) {
+        oldest = c->origin;
+    }
+    uint64_t end = e->window_idx + e->window_len;
+    if (e->window_idx < oldest) {
+        e->window_idx = oldest;
+    }
+    if (end > c->written) {
+        end = c->written;
+    }
+
+    e->window_len = end > e->window_idx ? (size_t) (end - e->window_idx) : 0;
+    e->window = malloc(2 * e->window_len * sizeof(float) + 1);
+    if (e->window == NULL) {
+        e->window_len = 0;
+        return;
+    }
+
+    size_t mask = c->ring_size - 1;
+    for (size_t i = 0; i < e->window_len; i++) {
+        size_t r = (size_t) ((e->window_idx + i) & mask);
+        e->window[2 * i] = c->ring[2 * r];
+        e->window[2 * i + 1] = c->ring[2 * r + 1];
+    }
+}
+
+static bool finish_peak(struct correlator *c, size_t id) {
+    struct correlator_template *t = &c->templates[id];
+    struct correlator_event e = {
+        .template_id = (uint32_t) id,
+        .sample_idx = t->best_idx,
+        .score = t->best_score,
+        .window = NULL,
+        .window_len = 0,
+        .window_idx = t->best_idx,
+    };
+
+    t->in_peak = false;
+    atomic_fetch_add(&c->events, 1);
+
+    if (c->ring != NULL) {
+        e.window_idx = t->best_idx > c->pre ? t->best_idx - c->pre : 0;
+        e.window_len = (size_t) (t->best_idx - e.window_idx) + t->len + c->post;
+
+        // wait for the rest of the window unless there is no room to keep the event
+        if (e.window_idx + e.window_len > c->written && c->n_pending < CORRELATOR_MAX_PENDING) {
+            c->pending[c->n_pending++] = e;
+            return true;
+        }
+        extract_window(c, &e);
+    }
+
+    return c->emit(c->ctx, &e);
+}
+
+static bool flush_pending(struct correlator *c) {
+    size_t i = 0;
+    while (i < c->n_pending) {
+        struct correlator_event e = c->pending[i];
+        if (e.window_idx + e.window_len > c->written) {
+            i++;
+            continue;
+        }
+
+        c->pending[i] = c->pending[--c->n_pending];
+        extract_window(c, &e);
+        if (!c->emit(c->ctx, &e)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// score the positions whose template fits in the first valid samples of the segment
+static bool process_segment(struct correlator *c, size_t valid) {
+    size_t n = c->n_fft;
+
+    memcpy(c->work, c->segment, 2 * n * sizeof(float));
+    fft_forward(&c->fft, c->work);
+
+    c->energy[0] = 0.0;
+    for (size_t j = 0; j < n; j++) {
+        float re = c->segment[2 * j], im = c->segment[2 * j + 1];
+        c->energy[j + 1] = c->energy[j] + (double) (re * re + im * im);
+    }
+
+    for (size_t id = 0; id < c->n_templates; id++) {
+        struct correlator_template *t = &c->templates[id];
+        const float *h = t->spectrum;
+        float *y = c->product;
+
+        for (size_t k = 0; k < n; k++) {
+            float xr = c->work[2 * k], xi = c->work[2 * k + 1];
+            y[2 * k] = xr * h[2 * k] - xi * h[2 * k + 1];
+            y[2 * k + 1] = xr * h[2 * k + 1] + xi * h[2 * k];
+        }
+        fft_inverse(&c->fft, y);
+
+        for (size_t j = 0; j < c->step && j + t->len <= valid; j++) {
+            double ex = c->energy[j + t->len] - c->energy[j];
+            float score = 0.0f;
+            if (ex > 1e-20) {
+                score = (float) ((double) (y[2 * j] * y[2 * j] + y[2 * j + 1] * y[2 * j + 1]) / ex);
+                score = score > 1.0f ? 1.0f : score;
+            }
+
+            uint64_t idx = c->segment_idx + j;
+            if (score >= t->threshold) {
+                if (!t->in_peak) {
+                    t->in_peak = true;
+                    t->best_score = score;
+                    t->best_idx = idx;
+                    t->peak_start = idx;
+                } else if (score > t->best_score) {
+                    t->best_score = score;
+                    t->best_idx = idx;
+                }
+
+                if (idx - t->peak_start >= t->len && !finish_peak(c, id)) {
+                    return false;
+                }
+            } else if (t->in_peak && !finish_peak(c, id)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool correlator_restart(struct correlator *c, uint64_t idx) {
+    bool ok = true;
+    if (c->fill > 0) {
+        memset(c->segment + 2 * c->fill, 0, 2 * (c->n_fft - c->fill) * sizeof(float));
+        ok = process_segment(c, c->fill);
+    }
+
+    for (size_t id = 0; ok && id < c->n_templates; id++) {
+        if (c->templates[id].in_peak) {
+            ok = finish_peak(c, id);
+        }
+    }
+
+    // windows of pending events end at the gap
+    for (size_t i = 0; ok && i < c->n_pending; i++) {
+        struct correlator_event e = c->pending[i];
+        extract_window(c, &e);
+        ok = c->emit(c->ctx, &e);
+    }
+    c->n_pending = 0;
+
+    for (size_t id = 0; id < c->n_templates; id++) {
+        c->templates[id].in_peak = false;
+    }
+    c->fill = 0;
+    c->segment_idx = idx;
+    c->origin = idx;
+    c->written = idx;
+    return ok;
+}
+
+bool correlator_process_cf32(struct correlator *c, const float *buf, size_t n_samples, uint64_t base_idx) {
+    if (base_idx != c->written && !correlator_restart(c, base_idx)) {
+        return false;
+    }
+
+    while (n_samples > 0) {
+        size_t len = c->n_fft - c->fill;
+        if (len > n_samples) {
+            len = n_samples;
+        }
+
+        memcpy(c->segment + 2 * c->fill, buf, 2 * len * sizeof(float));
+
+        if (c->ring != NULL) {
+            size_t mask = c->ring_size - 1;
+            for (size_t i = 0; i < len; i++) {
+                size_t r = (size_t) ((c->written + i) & mask);
+                c->ring[2 * r] = buf[2 * i];
+                c->ring[2 * r + 1] = buf[2 * i + 1];
+            }
+        }
+        c->written += len;
+
+        c->fill += len;
+        buf += 2 * len;
+        n_samples -= len;
+
+        if (c->fill == c->n_fft) {
+            if (!process_segment(c, c->n_fft)) {
+                return false;
+            }
+
+            // overlap: the last max_len - 1 samples start the next segment
+            size_t keep = c->n_fft - c->step;
+            memmove(c->segment, c->segment + 2 * c->step, 2 * keep * sizeof(float));
+            c->fill = keep;
+            c->segment_idx += c->step;
+        }
+
+        if (c->n_pending > 0 && !flush_pending(c)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool correlator_process_int8(struct correlator *c, const int8_t *buf, size_t n_samples, uint64_t base_idx) {
+    float tmp[2 * CONVERT_CHUNK];
+
+    while (n_samples > 0) {
+        size_t len = n_samples < CONVERT_CHUNK ? n_samples : CONVERT_CHUNK;
+        for (size_t i = 0; i < 2 * len; i++) {
+            tmp[i] = (float) buf[i] * (1.0f / 128.0f);
+        }
+
+        if (!correlator_process_cf32(c, tmp, len, base_idx)) {
+            return false;
+        }
+
+        buf += 2 * len;
+        n_samples -= len;
+        base_idx += len;
+    }
+
+    return true;
+}
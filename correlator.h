@@ -0,0 +1,166 @@
+#ifndef CORRELATOR_H
+#define CORRELATOR_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "fft.h"
+
+#define CORRELATOR_MAX_TEMPLATES 8
+#define CORRELATOR_MAX_PENDING 64
+
+/**
+ * Detection event
+ */
+struct correlator_event {
+    uint32_t template_id;
+    uint64_t sample_idx;    // stream index of the first matched sample
+    float score;            // normalized correlation |<h, x>|^2 / (|h|^2 |x|^2), 0..1
+    float *window;          // interleaved float32 IQ around the match, allocated with malloc or NULL
+    size_t window_len;      // window length in complex samples
+    uint64_t window_idx;    // stream index of the first window sample
+};
+
+/**
+ * Callback invoked for every detection. Ownership of event->window is
+ * transferred to the callee
+ *
+ * @return false to stop processing
+ */
+typedef bool (*correlator_emit_fn)(void *ctx, struct correlator_event *event);
+
+struct correlator_template {
+    size_t len;
+    float threshold;
+    float *taps;            // unit-energy template, len complex values
+    float *spectrum;        // conjugated FFT of the unit-energy template, n_fft complex values
+
+    // peak tracking, carried across blocks
+    bool in_peak;
+    float best_score;
+    uint64_t best_idx;
+    uint64_t peak_start;
+};
+
+/**
+ * Overlap-save correlator for several complex templates. Matches that
+ * straddle block boundaries are found since the last max_len - 1 samples
+ * of every segment are carried into the next one
+ */
+struct correlator {
+    struct fft fft;
+    size_t n_fft;
+    size_t max_len;
+    size_t step;
+
+    struct correlator_template templates[CORRELATOR_MAX_TEMPLATES];
+    size_t n_templates;
+
+    float *segment;         // n_fft samples of input being accumulated
+    size_t fill;
+    uint64_t segment_idx;   // stream index of segment[0]
+    uint64_t origin;        // stream index where the contiguous input started
+    float *work;
+    float *product;
+    double *energy;
+
+    // window extraction
+    size_t pre;
+    size_t post;
+    float *ring;
+    size_t ring_size;
+    uint64_t written;
+    struct correlator_event pending[CORRELATOR_MAX_PENDING];
+    size_t n_pending;
+
+    correlator_emit_fn emit;
+    void *ctx;
+    atomic_ullong events;
+};
+
+/**
+ * Initialize an empty correlator
+ *
+ * @param c correlator
+ */
+void correlator_init(struct correlator *c);
+
+/**
+ * Register a template. Must not be called while streaming
+ *
+ * @param c correlator
+ * @param samples interleaved float32 IQ template
+ * @param len template length in complex samples
+ * @param threshold normalized detection threshold, 0..1
+ *
+ * @return template id or -1 if there are too many templates or the template is invalid
+ */
+int correlator_add_template(struct correlator *c, const float *samples, size_t len, float threshold);
+
+/**
+ * Remove all templates and release processing buffers
+ *
+ * @param c correlator
+ */
+void correlator_clear(struct correlator *c);
+
+/**
+ * Allocate processing buffers for registered templates
+ *
+ * @param c correlator
+ * @param pre window samples before the match, 0 with post = 0 disables windows
+ * @param post window samples after the match
+ * @param emit event callback
+ * @param ctx callback context
+ *
+ * @return false if no templates are registered or memory allocation failed
+ */
+bool correlator_prepare(struct correlator *c, size_t pre, size_t post, correlator_emit_fn emit, void *ctx);
+
+/**
+ * Reset stream state, templates are kept
+ *
+ * @param c correlator
+ */
+void correlator_reset(struct correlator *c);
+
+/**
+ * End the contiguous input, e.g. at a retune. Matches that fit in the
+ * samples received so far are reported, pending windows are cut at the end
+ * of the input and processing resumes at idx
+ *
+ * @param c correlator
+ * @param idx stream index of the next sample
+ *
+ * @return false if the callback requested stop
+ */
+bool correlator_restart(struct correlator *c, uint64_t idx);
+
+/**
+ * Process interleaved int8 IQ samples. A gap in the stream index restarts
+ * the correlator
+ *
+ * @param c correlator
+ * @param buf samples
+ * @param n_samples number of complex samples
+ * @param base_idx stream index of the first sample
+ *
+ * @return false if the callback requested stop
+ */
+bool correlator_process_int8(struct correlator *c, const int8_t *buf, size_t n_samples, uint64_t base_idx);
+
+/**
+ * Process interleaved float32 IQ samples. A gap in the stream index restarts
+ * the correlator
+ *
+ * @param c correlator
+ * @param buf samples
+ * @param n_samples number of complex samples
+ * @param base_idx stream index of the first sample
+ *
+ * @return false if the callback requested stop
+ */
+bool correlator_process_cf32(struct correlator *c, const float *buf, size_t n_samples, uint64_t base_idx);
+
+#endif // CORRELATOR_H
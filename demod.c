@@ -0,0 +1,275 @@
+#include "demod.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEMOD_TAPS_PER_FACTOR 8
+#define DEMOD_RESAMPLER_TAPS 16
+#define AM_DC_HZ 20.0
+
+struct shared_block *shared_block_new(const int8_t *buf, size_t len, uint64_t sample_idx, int refs) {
+    struct shared_block *b = malloc(sizeof(struct shared_block) + len);
+    if (b == NULL) {
+        return NULL;
+    }
+
+    atomic_init(&b->refs, refs);
+    b->restart = false;
+    b->sample_idx = sample_idx;
+    b->len = len;
+    memcpy(b->data, buf, len);
+    return b;
+}
+
+void shared_block_release(struct shared_block *b) {
+    if (atomic_fetch_sub(&b->refs, 1) == 1) {
+        free(b);
+    }
+}
+
+static bool reserve(float **buf, size_t *cap, size_t n) {
+    if (n <= *cap) {
+        return true;
+    }
+
+    float *b = realloc(*buf, n * sizeof(float));
+    if (b == NULL) {
+        return false;
+    }
+
+    *buf = b;
+    *cap = n;
+    return true;
+}
+
+static void demodulate(struct demod *d, const float *x, float *y, size_t n) {
+    switch (d->config.mode) {
+    case DEMOD_FM:
+        for (size_t k = 0; k < n; k++) {
+            float re = x[2 * k], im = x[2 * k + 1];
+            float dr = re * d->prev_re + im * d->prev_im;
+            float di = im * d->prev_re - re * d->prev_im;
+            float v = atan2f(di, dr) * d->fm_gain;
+            d->deemph_y += d->deemph_a * (v - d->deemph_y);
+            y[k] = d->deemph_y;
+            d->prev_re = re;
+            d->prev_im = im;
+        }
+        break;
+    case DEMOD_AM:
+        for (size_t k = 0; k < n; k++) {
+            float env = sqrtf(x[2 * k] * x[2 * k] + x[2 * k + 1] * x[2 * k + 1]);
+            d->am_dc += d->am_k * (env - d->am_dc);
+            y[k] = d->am_dc > 1e-6f ? (env - d->am_dc) / d->am_dc : 0.0f;
+        }
+        break;
+    case DEMOD_USB:
+    case DEMOD_LSB:
+        // move the sideband back from 0 Hz to audio frequencies, real part is the audio
+        for (size_t k = 0; k < n; k++) {
+            y[k] = (float) (x[2 * k] * d->bfo_re - x[2 * k + 1] * d->bfo_im);
+            double re = d->bfo_re * d->bfo_step_re - d->bfo_im * d->bfo_step_im;
+            d->bfo_im = d->bfo_re * d->bfo_step_im + d->bfo_im * d->bfo_step_re;
+            d->bfo_re = re;
+        }
+        double mag = sqrt(d->bfo_re * d->bfo_re + d->bfo_im * d->bfo_im);
+        d->bfo_re /= mag;
+        d->bfo_im /= mag;
+        break;
+    }
+}
+
+static bool process_block(struct demod *d, const struct shared_block *b, struct audio_packet *p) {
+    size_t n = b->len / 2;
+    size_t n_if = n / d->decimator.factor + 1;
+
+    if (!reserve(&d->mix, &d->mix_cap, 2 * n) ||
+            !reserve(&d->iff, &d->iff_cap, 2 * n_if) ||
+            !reserve(&d->audio_in, &d->audio_in_cap, n_if)) {
+        return false;
+    }
+
+    // convert to float and shift the channel to 0 Hz
+    nco_mix_int8(&d->nco, b->data, d->mix, n);
+    n_if = decimator_process(&d->decimator, d->mix, n, d->iff);
+    demodulate(d, d->iff, d->audio_in, n_if);
+
+    p->buf = malloc(resampler_max_output(&d->resampler, n_if) * sizeof(float) + 1);
+    if (p->buf == NULL) {
+        return false;
+    }
+
+    p->samples = resampler_process(&d->resampler, d->audio_in, n_if, p->buf);
+    p->sample_idx = b->sample_idx;
+    return true;
+}
+
+static void filters_reset(struct demod *d) {
+    nco_reset(&d->nco);
+    d->bfo_re = 1.0;
+    d->bfo_im = 0.0;
+    d->prev_re = 0.0f;
+    d->prev_im = 0.0f;
+    d->deemph_y = 0.0f;
+    d->am_dc = 0.0f;
+    decimator_reset(&d->decimator);
+    resampler_reset(&d->resampler);
+}
+
+static void *demod_thread(void *arg) {
+    struct demod *d = (struct demod *) arg;
+    struct shared_block *b;
+
+    while (queue_pop(&d->in_queue, &b, 0)) {
+        struct audio_packet p;
+
+        pthread_mutex_lock(&d->lock);
+        if (b->restart) {
+            filters_reset(d);
+        }
+        bool ok = process_block(d, b, &p);
+        pthread_mutex_unlock(&d->lock);
+        shared_block_release(b);
+
+        if (!ok) {
+            atomic_fetch_add(&d->dropped, 1);
+            continue;
+        }
+
+        if (p.samples == 0 || !queue_push_noblock(&d->out_queue, &p)) {
+            if (p.samples > 0) {
+                atomic_fetch_add(&d->dropped, 1);
+            }
+            free(p.buf);
+        }
+    }
+
+    return NULL;
+}
+
+bool demod_init(struct demod *d, const struct demod_config *config, size_t in_len, size_t out_len) {
+    memset(d, 0, sizeof(*d));
+    d->config = *config;
+
+    const struct demod_config *c = &d->config;
+    if (c->sample_rate <= 0.0 || c->audio_rate <= 0.0 || c->bandwidth <= 0.0 ||
+            c->audio_rate > c->sample_rate || c->bandwidth > c->sample_rate ||
+            (c->mode == DEMOD_FM && c->deviation <= 0.0)) {
+        return false;
+    }
+
+    // decimate to the lowest rate that still fits the channel and the audio
+    double if_min = c->bandwidth > c->audio_rate ? c->bandwidth : c->audio_rate;
+    size_t factor = (size_t) floor(c->sample_rate / if_min);
+    if (factor < 1) {
+        factor = 1;
+    }
+    d->if_rate = c->sample_rate / (double) factor;
+
+    // ssb channels are shifted so the selected sideband is centered at 0 Hz
+    double shift = 0.0;
+    if (c->mode == DEMOD_USB) {
+        shift = c->bandwidth / 2.0;
+    } else if (c->mode == DEMOD_LSB) {
+        shift = -c->bandwidth / 2.0;
+    }
+    double cutoff = c->bandwidth / 2.0 / c->sample_rate;
+    if (cutoff > 0.45 / (double) factor) {
+        cutoff = 0.45 / (double) factor;
+    }
+
+    nco_init(&d->nco, -(c->offset + shift) / c->sample_rate);
+    d->bfo_step_re = cos(2.0 * M_PI * shift / d->if_rate);
+    d->bfo_step_im = sin(2.0 * M_PI * shift / d->if_rate);
+    d->fm_gain = c->mode == DEMOD_FM ? (float) (d->if_rate / (2.0 * M_PI * c->deviation)) : 1.0f;
+    d->deemph_a = c->deemphasis > 0.0 ? (float) (1.0 - exp(-1.0 / (c->deemphasis * d->if_rate))) : 1.0f;
+    d->am_k = (float) (1.0 - exp(-2.0 * M_PI * AM_DC_HZ / d->if_rate));
+
+    if (!decimator_init(&d->decimator, factor, (float) cutoff, DEMOD_TAPS_PER_FACTOR)) {
+        decimator_deinit(&d->decimator);
+        return false;
+    }
+
+    if (!resampler_init(&d->resampler, 1, c->audio_rate / d->if_rate, DEMOD_RESAMPLER_TAPS)) {
+        resampler_deinit(&d->resampler);
+        decimator_deinit(&d->decimator);
+        return false;
+    }
+
+    filters_reset(d);
+
+    if (!queue_init(&d->in_queue, sizeof(struct shared_block *), in_len)) {
+        resampler_deinit(&d->resampler);
+        decimator_deinit(&d->decimator);
+        return false;
+    }
+
+    if (!queue_init(&d->out_queue, sizeof(struct audio_packet), out_len)) {
+        queue_deinit(&d->in_queue);
+        resampler_deinit(&d->resampler);
+        decimator_deinit(&d->decimator);
+        return false;
+    }
+
+    pthread_mutex_init(&d->lock, NULL);
+    atomic_init(&d->overruns, 0);
+    atomic_init(&d->dropped, 0);
+
+    d->running = pthread_create(&d->thread, NULL, demod_thread, d) == 0;
+    if (!d->running) {
+        demod_deinit(d);
+        return false;
+    }
+
+    return true;
+}
+
+static void drain(struct demod *d) {
+    struct shared_block *b;
+    while (queue_pop_noblock(&d->in_queue, &b)) {
+        shared_block_release(b);
+    }
+
+    struct audio_packet p;
+    while (queue_pop_noblock(&d->out_queue, &p)) {
+        free(p.buf);
+    }
+}
+
+void demod_deinit(struct demod *d) {
+    if (d->running) {
+        queue_terminate(&d->in_queue);
+        pthread_join(d->thread, NULL);
+        d->running = false;
+    }
+
+    drain(d);
+    queue_deinit(&d->in_queue);
+    queue_deinit(&d->out_queue);
+    pthread_mutex_destroy(&d->lock);
+    decimator_deinit(&d->decimator);
+    resampler_deinit(&d->resampler);
+    free(d->mix);
+    free(d->iff);
+    free(d->audio_in);
+}
+
+void demod_reset(struct demod *d) {
+    pthread_mutex_lock(&d->lock);
+    drain(d);
+    filters_reset(d);
+    atomic_store(&d->overruns, 0);
+    atomic_store(&d->dropped, 0);
+    pthread_mutex_unlock(&d->lock);
+}
+
+void demod_submit(struct demod *d, struct shared_block *b) {
+    if (!queue_push_noblock(&d->in_queue, &b)) {
+        atomic_fetch_add(&d->overruns, 1);
+        shared_block_release(b);
+    }
+}
+
+bool demod_pop(struct demod *d, struct audio_packet *p, bool block, unsigned int timeout_ms) {
+    return block ? queue_pop(&d->out_queue, p, timeout_ms) : queue_pop_noblock(&d->out_queue, p);
+}
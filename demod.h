@@ -0,0 +1,160 @@
+#ifndef DEMOD_H
+#define DEMOD_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "nco.h"
+#include "queue.h"
+#include "resampler.h"
+
+enum demod_mode {
+    DEMOD_FM,
+    DEMOD_AM,
+    DEMOD_USB,
+    DEMOD_LSB,
+};
+
+/**
+ * Demodulator parameters. Frequencies are in Hz
+ */
+struct demod_config {
+    enum demod_mode mode;
+    double sample_rate;     // rx sample rate
+    double offset;          // channel offset from the tuned frequency
+    double audio_rate;
+    double bandwidth;       // channel bandwidth
+    double deviation;       // fm peak deviation, maps to audio amplitude 1.0
+    double deemphasis;      // fm de-emphasis time constant in seconds, 0 disables
+};
+
+/**
+ * Reference counted copy of a transfer, shared by all demodulators
+ */
+struct shared_block {
+    atomic_int refs;
+    bool restart;           // first block after a retune, filter state starts over
+    uint64_t sample_idx;
+    size_t len;
+    int8_t data[];
+};
+
+/**
+ * Block of float32 audio samples
+ */
+struct audio_packet {
+    float *buf;
+    size_t samples;
+    uint64_t sample_idx;    // rx stream index of the input block
+};
+
+/**
+ * Demodulator running on its own thread: nco mix, decimating channel filter,
+ * demodulation and resampling to the audio rate
+ */
+struct demod {
+    struct demod_config config;
+    double if_rate;
+
+    struct nco nco;
+
+    struct decimator decimator;
+    struct resampler resampler;
+
+    float prev_re;
+    float prev_im;
+    float fm_gain;
+    float deemph_a;
+    float deemph_y;
+    float am_k;
+    float am_dc;
+    double bfo_re;
+    double bfo_im;
+    double bfo_step_re;
+    double bfo_step_im;
+
+    float *mix;
+    size_t mix_cap;
+    float *iff;
+    size_t iff_cap;
+    float *audio_in;
+    size_t audio_in_cap;
+
+    struct queue in_queue;
+    struct queue out_queue;
+    pthread_mutex_t lock;   // held while a block is processed
+    pthread_t thread;
+    bool running;
+    atomic_ullong overruns;
+    atomic_ullong dropped;
+};
+
+/**
+ * Allocate a shared block
+ *
+ * @param buf interleaved int8 IQ samples
+ * @param len buffer length in bytes
+ * @param sample_idx stream index of the first sample
+ * @param refs number of consumers
+ *
+ * @return block or NULL if memory allocation failed
+ */
+struct shared_block *shared_block_new(const int8_t *buf, size_t len, uint64_t sample_idx, int refs);
+
+/**
+ * Drop one reference, the block is freed by the last consumer
+ *
+ * @param b block
+ */
+void shared_block_release(struct shared_block *b);
+
+/**
+ * Initialize demodulator and start its thread
+ *
+ * @param d demodulator
+ * @param config parameters
+ * @param in_len input FIFO size in blocks
+ * @param out_len output FIFO size in audio packets
+ *
+ * @return false if parameters are invalid or initialization failed
+ */
+bool demod_init(struct demod *d, const struct demod_config *config, size_t in_len, size_t out_len);
+
+/**
+ * Stop the thread and destroy demodulator
+ *
+ * @param d demodulator
+ */
+void demod_deinit(struct demod *d);
+
+/**
+ * Reset filter state and drop queued data at the start of a stream
+ *
+ * @param d demodulator
+ */
+void demod_reset(struct demod *d);
+
+/**
+ * Queue a block for demodulation (non-blocking). The reference is released
+ * by the demodulator, also when the block is dropped
+ *
+ * @param d demodulator
+ * @param b block
+ */
+void demod_submit(struct demod *d, struct shared_block *b);
+
+/**
+ * Pop an audio packet
+ *
+ * @param d demodulator
+ * @param p pointer to store the packet, p->buf must be freed by the caller
+ * @param block wait for data
+ * @param timeout_ms timeout in milliseconds, 0 will block forever
+ *
+ * @return true if a packet was popped
+ */
+bool demod_pop(struct demod *d, struct audio_packet *p, bool block, unsigned int timeout_ms);
+
+#endif // DEMOD_H
@@ -0,0 +1,90 @@
+#include "fft.h"
+#include <math.h>
+#include <stdlib.h>
+
+bool fft_init(struct fft *f, size_t n) {
+    f->twiddle = NULL;
+    f->bitrev = NULL;
+    f->n = n;
+
+    if (n < 2 || (n & (n - 1)) != 0) {
+        return false;
+    }
+
+    f->twiddle = malloc(n * sizeof(float));
+    f->bitrev = malloc(n * sizeof(size_t));
+    if (f->twiddle == NULL || f->bitrev == NULL) {
+        fft_deinit(f);
+        return false;
+    }
+
+    for (size_t k = 0; k < n / 2; k++) {
+        double a = -2.0 * M_PI * (double) k / (double) n;
+        f->twiddle[2 * k] = (float) cos(a);
+        f->twiddle[2 * k + 1] = (float) sin(a);
+    }
+
+    size_t bits = 0;
+    while (((size_t) 1 << bits) < n) {
+        bits++;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        size_t r = 0;
+        for (size_t b = 0; b < bits; b++) {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        f->bitrev[i] = r;
+    }
+
+    return true;
+}
+
+void fft_deinit(struct fft *f) {
+    free(f->twiddle);
+    free(f->bitrev);
+    f->twiddle = NULL;
+    f->bitrev = NULL;
+}
+
+static void fft_run(const struct fft *f, float *data, float sign) {
+    size_t n = f->n;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t j = f->bitrev[i];
+        if (j > i) {
+            float re = data[2 * i], im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1) {
+        size_t half = len >> 1;
+        size_t step = n / len;
+        for (size_t start = 0; start < n; start += len) {
+            float *a = data + 2 * start;
+            float *b = a + 2 * half;
+            for (size_t k = 0; k < half; k++) {
+                float wr = f->twiddle[2 * k * step];
+                float wi = sign * f->twiddle[2 * k * step + 1];
+                float tr = b[2 * k] * wr - b[2 * k + 1] * wi;
+                float ti = b[2 * k] * wi + b[2 * k + 1] * wr;
+                b[2 * k] = a[2 * k] - tr;
+                b[2 * k + 1] = a[2 * k + 1] - ti;
+                a[2 * k] += tr;
+                a[2 * k + 1] += ti;
+            }
+        }
+    }
+}
+
+void fft_forward(const struct fft *f, float *data) {
+    fft_run(f, data, 1.0f);
+}
+
+void fft_inverse(const struct fft *f, float *data) {
+    fft_run(f, data, -1.0f);
+}
@@ -0,0 +1,49 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Radix-2 complex FFT on interleaved float32 data
+ */
+struct fft {
+    size_t n;
+    float *twiddle;
+    size_t *bitrev;
+};
+
+/**
+ * Initialize FFT of given size
+ *
+ * @param f fft
+ * @param n number of points, must be a power of two
+ *
+ * @return false if n is not a power of two or memory allocation failed
+ */
+bool fft_init(struct fft *f, size_t n);
+
+/**
+ * Destroy FFT and allocated resources
+ *
+ * @param f fft
+ */
+void fft_deinit(struct fft *f);
+
+/**
+ * In-place forward transform
+ *
+ * @param f fft
+ * @param data n interleaved complex values
+ */
+void fft_forward(const struct fft *f, float *data);
+
+/**
+ * In-place inverse transform, not normalized (result is scaled by n)
+ *
+ * @param f fft
+ * @param data n interleaved complex values
+ */
+void fft_inverse(const struct fft *f, float *data);
+
+#endif // FFT_H
@@ -0,0 +1,177 @@
+#include "hop.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void *hop_thread(void *arg) {
+    struct hop *h = (struct hop *) arg;
+
+    pthread_mutex_lock(&h->mutex);
+    while (h->running) {
+        while (h->running && !h->pending) {
+            pthread_cond_wait(&h->cond, &h->mutex);
+        }
+
+        if (!h->running) {
+            break;
+        }
+
+        h->pending = false;
+        size_t idx = (h->idx + 1) % h->n_freqs;
+        uint64_t freq = h->freqs[idx];
+        uint64_t issue_idx = h->stream_idx;
+        h->tuning = true;
+        h->issue_idx = issue_idx;
+
+        // control transfers are slow, don't hold the lock while they are in progress
+        pthread_mutex_unlock(&h->mutex);
+        int ret = h->set_freq(h->ctx, freq);
+        pthread_mutex_lock(&h->mutex);
+
+        h->tuning = false;
+        if (ret == 0) {
+            h->idx = idx;
+            h->freq = freq;
+            h->retune_idx = issue_idx;
+            h->hops++;
+        } else {
+            h->failures++;
+        }
+
+        // whatever arrived while tuning is gone, settling counts from the retune
+        h->settle_end = issue_idx + h->settle;
+        if (h->settle_end < h->stream_idx) {
+            h->settle_end = h->stream_idx;
+        }
+        h->next_hop = h->settle_end + h->dwell;
+    }
+    pthread_mutex_unlock(&h->mutex);
+
+    return NULL;
+}
+
+void hop_init(struct hop *h, hop_set_freq_fn set_freq, void *ctx) {
+    memset(h, 0, sizeof(*h));
+    pthread_mutex_init(&h->mutex, NULL);
+    pthread_cond_init(&h->cond, NULL);
+    h->set_freq = set_freq;
+    h->ctx = ctx;
+}
+
+void hop_deinit(struct hop *h) {
+    hop_stop(h, NULL);
+    free(h->freqs);
+    pthread_mutex_destroy(&h->mutex);
+    pthread_cond_destroy(&h->cond);
+}
+
+bool hop_start(struct hop *h, const uint64_t *freqs, size_t n_freqs, uint64_t dwell, uint64_t settle) {
+    hop_stop(h, NULL);
+
+    uint64_t *copy = malloc(n_freqs * sizeof(uint64_t));
+    if (copy == NULL) {
+        return false;
+    }
+    memcpy(copy, freqs, n_freqs * sizeof(uint64_t));
+
+    if (h->set_freq(h->ctx, freqs[0]) != 0) {
+        free(copy);
+        return false;
+    }
+
+    pthread_mutex_lock(&h->mutex);
+    free(h->freqs);
+    h->freqs = copy;
+    h->n_freqs = n_freqs;
+    h->dwell = dwell;
+    h->settle = settle;
+    h->idx = 0;
+    h->freq = freqs[0];
+    h->retune_idx = h->stream_idx;
+    h->settle_end = h->stream_idx + settle;
+    h->next_hop = h->settle_end + dwell;
+    h->tuning = false;
+    h->pending = false;
+    h->hops = 0;
+    h->failures = 0;
+    // a single frequency needs no thread but packets are still tagged
+    h->running = n_freqs > 1;
+    if (h->running && pthread_create(&h->thread, NULL, hop_thread, h) != 0) {
+        h->running = false;
+        h->n_freqs = 0;
+        pthread_mutex_unlock(&h->mutex);
+        return false;
+    }
+    pthread_mutex_unlock(&h->mutex);
+
+    return true;
+}
+
+void hop_stop(struct hop *h, uint64_t *freq) {
+    pthread_mutex_lock(&h->mutex);
+    bool running = h->running;
+    h->running = false;
+    pthread_cond_broadcast(&h->cond);
+    pthread_mutex_unlock(&h->mutex);
+
+    if (running) {
+        pthread_join(h->thread, NULL);
+    }
+
+    pthread_mutex_lock(&h->mutex);
+    if (freq != NULL && h->n_freqs > 0) {
+        *freq = h->freq;
+    }
+    h->n_freqs = 0;
+    h->pending = false;
+    pthread_mutex_unlock(&h->mutex);
+}
+
+void hop_rewind(struct hop *h) {
+    pthread_mutex_lock(&h->mutex);
+    h->stream_idx = 0;
+    h->retune_idx = 0;
+    h->settle_end = h->settle;
+    h->next_hop = h->settle + h->dwell;
+    pthread_mutex_unlock(&h->mutex);
+}
+
+bool hop_update(struct hop *h, uint64_t base_idx, size_t n_samples, struct hop_range *r) {
+    uint64_t end_idx = base_idx + n_samples;
+
+    pthread_mutex_lock(&h->mutex);
+    if (h->n_freqs == 0) {
+        h->stream_idx = end_idx;
+        pthread_mutex_unlock(&h->mutex);
+        return false;
+    }
+
+    uint64_t keep_start = base_idx;
+    uint64_t keep_end = end_idx;
+    if (h->tuning) {
+        // samples after the retune was issued belong to neither frequency
+        keep_end = h->issue_idx > base_idx ? (h->issue_idx < end_idx ? h->issue_idx : end_idx) : base_idx;
+    } else if (h->settle_end > base_idx) {
+        keep_start = h->settle_end < end_idx ? h->settle_end : end_idx;
+    }
+
+    r->start = (size_t) (keep_start - base_idx);
+    r->end = (size_t) (keep_end - base_idx);
+    r->freq = h->freq;
+    r->retune_idx = h->retune_idx;
+
+    h->stream_idx = end_idx;
+    if (h->running && !h->tuning && end_idx >= h->next_hop) {
+        h->pending = true;
+        pthread_cond_signal(&h->cond);
+    }
+    pthread_mutex_unlock(&h->mutex);
+
+    return true;
+}
+
+void hop_get_counts(struct hop *h, uint64_t *hops, uint64_t *failures) {
+    pthread_mutex_lock(&h->mutex);
+    *hops = h->hops;
+    *failures = h->failures;
+    pthread_mutex_unlock(&h->mutex);
+}
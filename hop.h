@@ -0,0 +1,124 @@
+#ifndef HOP_H
+#define HOP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * Callback used by the hop thread to retune
+ *
+ * @return 0 on success
+ */
+typedef int (*hop_set_freq_fn)(void *ctx, uint64_t freq);
+
+/**
+ * Part of a transfer to keep and the tuning it was captured with
+ */
+struct hop_range {
+    size_t start;           // first sample to keep, relative to the transfer
+    size_t end;             // end of kept samples, start == end drops the transfer
+    uint64_t freq;
+    uint64_t retune_idx;    // stream index at which the retune to freq was issued
+};
+
+/**
+ * Frequency hopping schedule. Transfers are posted from the rx callback,
+ * retunes are issued from a separate thread once the dwell time has been
+ * received. Samples from the retune until the end of the settle interval
+ * are dropped
+ */
+struct hop {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool running;
+    bool pending;
+    hop_set_freq_fn set_freq;
+    void *ctx;
+
+    uint64_t *freqs;
+    size_t n_freqs;
+    uint64_t dwell;
+    uint64_t settle;
+
+    size_t idx;             // schedule position of the frequency in effect
+    uint64_t stream_idx;    // end of the last posted transfer
+    uint64_t next_hop;      // stream index that triggers the next retune
+    bool tuning;            // retune in progress, samples from issue_idx are dropped
+    uint64_t issue_idx;
+    uint64_t freq;
+    uint64_t retune_idx;
+    uint64_t settle_end;
+    uint64_t hops;
+    uint64_t failures;
+};
+
+/**
+ * Initialize hop state. The thread is not started
+ *
+ * @param h hop
+ * @param set_freq callback that retunes
+ * @param ctx callback context
+ */
+void hop_init(struct hop *h, hop_set_freq_fn set_freq, void *ctx);
+
+/**
+ * Stop the thread and destroy hop state
+ *
+ * @param h hop
+ */
+void hop_deinit(struct hop *h);
+
+/**
+ * Tune to the first frequency and start the thread
+ *
+ * @param h hop
+ * @param freqs frequencies in Hz, copied
+ * @param n_freqs number of frequencies
+ * @param dwell samples to receive at each frequency after settling
+ * @param settle samples to drop after each retune
+ *
+ * @return false if tuning failed or the thread could not be started
+ */
+bool hop_start(struct hop *h, const uint64_t *freqs, size_t n_freqs, uint64_t dwell, uint64_t settle);
+
+/**
+ * Stop the thread
+ *
+ * @param h hop
+ * @param freq pointer to store the frequency in effect
+ */
+void hop_stop(struct hop *h, uint64_t *freq);
+
+/**
+ * Restart sample counting at the start of a stream. The current frequency
+ * is kept and treated as retuned at index 0
+ *
+ * @param h hop
+ */
+void hop_rewind(struct hop *h);
+
+/**
+ * Post a transfer and get the part of it to keep
+ *
+ * @param h hop
+ * @param base_idx stream index of the first sample
+ * @param n_samples number of samples in the transfer
+ * @param r pointer to store the range
+ *
+ * @return false if hopping is not running, r is not set
+ */
+bool hop_update(struct hop *h, uint64_t base_idx, size_t n_samples, struct hop_range *r);
+
+/**
+ * Read hop counters
+ *
+ * @param h hop
+ * @param hops pointer to store the number of retunes
+ * @param failures pointer to store the number of failed retunes
+ */
+void hop_get_counts(struct hop *h, uint64_t *hops, uint64_t *failures);
+
+#endif // HOP_H
@@ -0,0 +1,140 @@
+#include "iq_correction.h"
+#include <math.h>
+
+// chunk length keeps int32 moment accumulators from overflowing (128^2 * 2^16 = 2^30)
+#define CHUNK_SAMPLES 65536
+
+static void update_coefficients(struct iq_correction *c) {
+    c->phase = 0.0f;
+    c->gain = 1.0f;
+    if (c->p_ii <= 0.0f) {
+        return;
+    }
+
+    c->phase = c->p_iq / c->p_ii;
+    float q_orth = c->p_qq - c->p_iq * c->phase;
+    if (q_orth > 0.0f) {
+        c->gain = sqrtf(c->p_ii / q_orth);
+    }
+}
+
+void iq_correction_init(struct iq_correction *c, float dc_alpha, float iq_alpha) {
+    pthread_mutex_init(&c->mutex, NULL);
+    c->dc_alpha = dc_alpha;
+    c->iq_alpha = iq_alpha;
+    c->frozen = false;
+    iq_correction_reset(c);
+}
+
+void iq_correction_deinit(struct iq_correction *c) {
+    pthread_mutex_destroy(&c->mutex);
+}
+
+void iq_correction_reset(struct iq_correction *c) {
+    pthread_mutex_lock(&c->mutex);
+    c->primed = false;
+    c->dc_i = 0.0f;
+    c->dc_q = 0.0f;
+    c->p_ii = 0.0f;
+    c->p_qq = 0.0f;
+    c->p_iq = 0.0f;
+    update_coefficients(c);
+    pthread_mutex_unlock(&c->mutex);
+}
+
+void iq_correction_freeze(struct iq_correction *c, bool frozen) {
+    pthread_mutex_lock(&c->mutex);
+    c->frozen = frozen;
+    pthread_mutex_unlock(&c->mutex);
+}
+
+void iq_correction_get(struct iq_correction *c, struct iq_estimates *e) {
+    pthread_mutex_lock(&c->mutex);
+    e->dc_i = c->dc_i / 128.0f;
+    e->dc_q = c->dc_q / 128.0f;
+    e->gain = c->gain;
+    e->phase = 0.0f;
+    if (c->p_ii > 0.0f && c->p_qq > 0.0f) {
+        float rho = c->p_iq / sqrtf(c->p_ii * c->p_qq);
+        e->phase = asinf(fmaxf(-1.0f, fminf(1.0f, rho)));
+    }
+    e->frozen = c->frozen;
+    pthread_mutex_unlock(&c->mutex);
+}
+
+void iq_correction_process(struct iq_correction *c, const int8_t *restrict in, float *restrict out, size_t n_samples) {
+    if (n_samples == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&c->mutex);
+    const float dc_i = c->dc_i, dc_q = c->dc_q;
+    const float gain = c->gain / 128.0f, phase = c->phase;
+    bool frozen = c->frozen;
+    pthread_mutex_unlock(&c->mutex);
+
+    int64_t s_i = 0, s_q = 0, s_ii = 0, s_qq = 0, s_iq = 0;
+
+    for (size_t base = 0; base < n_samples; base += CHUNK_SAMPLES) {
+        size_t len = n_samples - base < CHUNK_SAMPLES ? n_samples - base : CHUNK_SAMPLES;
+        const int8_t *x = in + 2 * base;
+        float *y = out + 2 * base;
+        int32_t c_i = 0, c_q = 0, c_ii = 0, c_qq = 0, c_iq = 0;
+
+        // single pass: moments for the estimator and corrected float output
+        for (size_t n = 0; n < len; n++) {
+            int32_t i = x[2 * n];
+            int32_t q = x[2 * n + 1];
+            c_i += i;
+            c_q += q;
+            c_ii += i * i;
+            c_qq += q * q;
+            c_iq += i * q;
+
+            float fi = (float) i - dc_i;
+            float fq = (float) q - dc_q;
+            y[2 * n] = fi * (1.0f / 128.0f);
+            y[2 * n + 1] = gain * (fq - phase * fi);
+        }
+
+        s_i += c_i;
+        s_q += c_q;
+        s_ii += c_ii;
+        s_qq += c_qq;
+        s_iq += c_iq;
+    }
+
+    if (frozen) {
+        return;
+    }
+
+    float inv_n = 1.0f / (float) n_samples;
+    float m_i = (float) s_i * inv_n;
+    float m_q = (float) s_q * inv_n;
+    float v_ii = (float) s_ii * inv_n - m_i * m_i;
+    float v_qq = (float) s_qq * inv_n - m_q * m_q;
+    float v_iq = (float) s_iq * inv_n - m_i * m_q;
+
+    pthread_mutex_lock(&c->mutex);
+    if (!c->frozen) {
+        if (!c->primed) {
+            c->dc_i = m_i;
+            c->dc_q = m_q;
+            c->p_ii = v_ii;
+            c->p_qq = v_qq;
+            c->p_iq = v_iq;
+            c->primed = true;
+        } else {
+            // block update equivalent to n_samples steps of the per-sample single-pole filter
+            float k_dc = 1.0f - powf(1.0f - c->dc_alpha, (float) n_samples);
+            float k_iq = 1.0f - powf(1.0f - c->iq_alpha, (float) n_samples);
+            c->dc_i += k_dc * (m_i - c->dc_i);
+            c->dc_q += k_dc * (m_q - c->dc_q);
+            c->p_ii += k_iq * (v_ii - c->p_ii);
+            c->p_qq += k_iq * (v_qq - c->p_qq);
+            c->p_iq += k_iq * (v_iq - c->p_iq);
+        }
+        update_coefficients(c);
+    }
+    pthread_mutex_unlock(&c->mutex);
+}
@@ -0,0 +1,93 @@
+#ifndef IQ_CORRECTION_H
+#define IQ_CORRECTION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * Streaming DC offset removal and IQ imbalance correction.
+ *
+ * Samples are corrected as i' = i - dc_i, q' = gain * ((q - dc_q) - phase * i'),
+ * which makes i' and q' uncorrelated and of equal power. Estimates are updated
+ * once per block from integer moments that are accumulated in the same pass
+ * that converts and corrects the samples.
+ */
+struct iq_correction {
+    pthread_mutex_t mutex;
+    float dc_alpha;
+    float iq_alpha;
+    bool frozen;
+    bool primed;
+    float dc_i;
+    float dc_q;
+    float p_ii;
+    float p_qq;
+    float p_iq;
+    float gain;
+    float phase;
+};
+
+/**
+ * Snapshot of the current estimates
+ */
+struct iq_estimates {
+    float dc_i;
+    float dc_q;
+    float gain;
+    float phase;
+    bool frozen;
+};
+
+/**
+ * Initialize correction state
+ *
+ * @param c correction state
+ * @param dc_alpha per-sample coefficient of the single-pole DC tracker
+ * @param iq_alpha per-sample coefficient of the IQ imbalance estimator
+ */
+void iq_correction_init(struct iq_correction *c, float dc_alpha, float iq_alpha);
+
+/**
+ * Destroy correction state
+ *
+ * @param c correction state
+ */
+void iq_correction_deinit(struct iq_correction *c);
+
+/**
+ * Reset the estimates. The first processed block will prime them again
+ *
+ * @param c correction state
+ */
+void iq_correction_reset(struct iq_correction *c);
+
+/**
+ * Stop or resume updating the estimates. Correction is still applied while frozen
+ *
+ * @param c correction state
+ * @param frozen true to freeze
+ */
+void iq_correction_freeze(struct iq_correction *c, bool frozen);
+
+/**
+ * Read current estimates
+ *
+ * @param c correction state
+ * @param e pointer to store the estimates
+ */
+void iq_correction_get(struct iq_correction *c, struct iq_estimates *e);
+
+/**
+ * Convert interleaved int8 samples to interleaved float32 scaled to [-1, 1),
+ * correct them and update the estimates
+ *
+ * @param c correction state
+ * @param in interleaved int8 IQ samples
+ * @param out interleaved float32 IQ samples, 2 * n_samples floats
+ * @param n_samples number of complex samples
+ */
+void iq_correction_process(struct iq_correction *c, const int8_t *in, float *out, size_t n_samples);
+
+#endif // IQ_CORRECTION_H
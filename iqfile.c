@@ -0,0 +1,649 @@
+#include "iqfile.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BLOCK_MAGIC 0x4b424849  // "IHBK"
+#define RICE_ESCAPE 24
+#define RICE_RAW_BITS 9
+#define RICE_MAX_PARAM 8
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t) (v >> (8 * i));
+    }
+}
+
+static void put_u64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (uint8_t) (v >> (8 * i));
+    }
+}
+
+static void put_f64(uint8_t *p, double v) {
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    put_u64(p, u);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        v |= (uint32_t) p[i] << (8 * i);
+    }
+    return v;
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v |= (uint64_t) p[i] << (8 * i);
+    }
+    return v;
+}
+
+static double get_f64(const uint8_t *p) {
+    uint64_t u = get_u64(p);
+    double v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+void iq_put_file_header(uint8_t *buf, const struct iq_file_header *h) {
+    memset(buf, 0, IQFILE_HEADER_SIZE);
+    memcpy(buf, IQFILE_MAGIC, 8);
+    put_u32(buf + 8, h->version);
+    put_u32(buf + 12, h->codec);
+    put_u32(buf + 16, h->block_samples);
+    put_f64(buf + 24, h->sample_rate);
+    put_u64(buf + 32, h->index_offset);
+    put_u64(buf + 40, h->n_blocks);
+}
+
+static bool get_file_header(const uint8_t *buf, struct iq_file_header *h) {
+    if (memcmp(buf, IQFILE_MAGIC, 8) != 0) {
+        return false;
+    }
+
+    h->version = get_u32(buf + 8);
+    h->codec = get_u32(buf + 12);
+    h->block_samples = get_u32(buf + 16);
+    h->sample_rate = get_f64(buf + 24);
+    h->index_offset = get_u64(buf + 32);
+    h->n_blocks = get_u64(buf + 40);
+    return h->version == IQFILE_VERSION;
+}
+
+void iq_put_block_header(uint8_t *buf, const struct iq_block_header *h) {
+    uint32_t scale;
+    memcpy(&scale, &h->scale, sizeof(scale));
+
+    put_u32(buf, BLOCK_MAGIC);
+    put_u32(buf + 4, h->codec);
+    put_u32(buf + 8, h->samples);
+    put_u32(buf + 12, h->payload_len);
+    put_u32(buf + 16, scale);
+    put_u32(buf + 20, h->param);
+    put_u64(buf + 24, h->sample_idx);
+    put_f64(buf + 32, h->timestamp);
+    put_u64(buf + 40, h->freq);
+}
+
+static bool get_block_header(const uint8_t *buf, struct iq_block_header *h) {
+    if (get_u32(buf) != BLOCK_MAGIC) {
+        return false;
+    }
+
+    uint32_t scale = get_u32(buf + 16);
+    memcpy(&h->scale, &scale, sizeof(scale));
+    h->codec = get_u32(buf + 4);
+    h->samples = get_u32(buf + 8);
+    h->payload_len = get_u32(buf + 12);
+    h->param = get_u32(buf + 20);
+    h->sample_idx = get_u64(buf + 24);
+    h->timestamp = get_f64(buf + 32);
+    h->freq = get_u64(buf + 40);
+    return h->codec <= IQ_CODEC_RICE && h->samples <= IQFILE_MAX_BLOCK_SAMPLES &&
+            h->payload_len <= iq_encode_bound(h->samples);
+}
+
+void iq_put_index_entry(uint8_t *buf, const struct iq_index_entry *e) {
+    put_u64(buf, e->offset);
+    put_u64(buf + 8, e->sample_idx);
+    put_f64(buf + 16, e->timestamp);
+    put_u64(buf + 24, e->freq);
+    put_u32(buf + 32, e->samples);
+    put_u32(buf + 36, 0);
+}
+
+static void get_index_entry(const uint8_t *buf, struct iq_index_entry *e) {
+    e->offset = get_u64(buf);
+    e->sample_idx = get_u64(buf + 8);
+    e->timestamp = get_f64(buf + 16);
+    e->freq = get_u64(buf + 24);
+    e->samples = get_u32(buf + 32);
+}
+
+/*
+ * Bit packing, MSB first. The writer stores 32 bits at a time and may run up
+ * to 3 bytes past its capacity before it notices
+ */
+struct bit_writer {
+    uint8_t *out;
+    size_t pos;
+    size_t cap;
+    uint64_t acc;
+    int n;
+};
+
+static inline bool put_bits(struct bit_writer *w, uint32_t v, int bits) {
+    if (w->n >= 32) {
+        if (w->pos >= w->cap) {
+            return false;
+        }
+        w->n -= 32;
+        uint32_t word = (uint32_t) (w->acc >> w->n);
+        w->out[w->pos] = (uint8_t) (word >> 24);
+        w->out[w->pos + 1] = (uint8_t) (word >> 16);
+        w->out[w->pos + 2] = (uint8_t) (word >> 8);
+        w->out[w->pos + 3] = (uint8_t) word;
+        w->pos += 4;
+    }
+
+    w->acc = (w->acc << bits) | v;
+    w->n += bits;
+    return true;
+}
+
+static inline bool flush_bits(struct bit_writer *w) {
+    if (w->n % 8 != 0) {
+        w->acc <<= 8 - w->n % 8;
+        w->n += 8 - w->n % 8;
+    }
+
+    while (w->n > 0) {
+        if (w->pos >= w->cap) {
+            return false;
+        }
+        w->n -= 8;
+        w->out[w->pos++] = (uint8_t) (w->acc >> w->n);
+    }
+    return true;
+}
+
+struct bit_reader {
+    const uint8_t *in;
+    size_t pos;
+    size_t len;
+    uint64_t acc;
+    int n;
+};
+
+static inline void refill(struct bit_reader *r) {
+    while (r->n <= 56 && r->pos < r->len) {
+        r->acc |= (uint64_t) r->in[r->pos++] << (56 - r->n);
+        r->n += 8;
+    }
+}
+
+static inline bool get_bits(struct bit_reader *r, int bits, uint32_t *v) {
+    refill(r);
+    if (r->n < bits) {
+        return false;
+    }
+    *v = (uint32_t) (r->acc >> (64 - bits));
+    r->acc <<= bits;
+    r->n -= bits;
+    return true;
+}
+
+/*
+ * Rice coding of zigzag mapped per-channel differences. Each block starts
+ * from zero so blocks decode independently
+ */
+static inline uint32_t zigzag(int v) {
+    return v >= 0 ? (uint32_t) v << 1 : ((uint32_t) -v << 1) - 1;
+}
+
+static inline int unzigzag(uint32_t v) {
+    return (v & 1) ? -(int) ((v + 1) >> 1) : (int) (v >> 1);
+}
+
+static uint32_t rice_param(const int8_t *in, size_t n_values) {
+    uint64_t sum = 0;
+    int prev[2] = {0, 0};
+    for (size_t i = 0; i < n_values; i++) {
+        sum += zigzag(in[i] - prev[i & 1]);
+        prev[i & 1] = in[i];
+    }
+
+    // 2^k closest to the mean value
+    uint32_t k = 0;
+    while (k < RICE_MAX_PARAM && ((uint64_t) n_values << (k + 1)) <= sum) {
+        k++;
+    }
+    return k;
+}
+
+static bool rice_encode(const int8_t *in, size_t n_values, uint32_t k, uint8_t *out, size_t cap, size_t *len) {
+    struct bit_writer w = {.out = out, .cap = cap};
+    int prev[2] = {0, 0};
+
+    for (size_t i = 0; i < n_values; i++) {
+        uint32_t v = zigzag(in[i] - prev[i & 1]);
+        prev[i & 1] = in[i];
+
+        // q ones, a zero and the k low bits fit one 32 bit write
+        uint32_t q = v >> k;
+        if (q < RICE_ESCAPE) {
+            uint32_t code = (((1u << q) - 1) << (k + 1)) | (v & ((1u << k) - 1));
+            if (!put_bits(&w, code, (int) (q + 1 + k))) {
+                return false;
+            }
+        } else if (!put_bits(&w, (1u << RICE_ESCAPE) - 1, RICE_ESCAPE) ||
+                !put_bits(&w, v, RICE_RAW_BITS)) {
+            return false;
+        }
+    }
+
+    if (!flush_bits(&w)) {
+        return false;
+    }
+
+    *len = w.pos;
+    return true;
+}
+
+static bool rice_decode(const uint8_t *in, size_t len, uint32_t k, int8_t *out, size_t n_values) {
+    struct bit_reader r = {.in = in, .len = len};
+    int prev[2] = {0, 0};
+
+    if (k > RICE_MAX_PARAM) {
+        return false;
+    }
+
+    for (size_t i = 0; i < n_values; i++) {
+        // bits past the end of the data are zero, so the count stops there
+        refill(&r);
+        uint64_t inv = ~r.acc;
+        uint32_t q = inv != 0 ? (uint32_t) __builtin_clzll(inv) : 64;
+        uint32_t v;
+
+        if (q >= RICE_ESCAPE) {
+            if (r.n < RICE_ESCAPE + RICE_RAW_BITS) {
+                return false;
+            }
+            r.acc <<= RICE_ESCAPE;
+            r.n -= RICE_ESCAPE;
+            get_bits(&r, RICE_RAW_BITS, &v);
+        } else {
+            if ((uint32_t) r.n < q + 1 + k) {
+                return false;
+            }
+            r.acc <<= q + 1;
+            r.n -= (int) (q + 1);
+            uint32_t low = 0;
+            if (k > 0) {
+                get_bits(&r, (int) k, &low);
+            }
+            v = (q << k) | low;
+        }
+
+        int x = prev[i & 1] + unzigzag(v);
+        if (x < -128 || x > 127) {
+            return false;
+        }
+        out[i] = (int8_t) x;
+        prev[i & 1] = x;
+    }
+
+    return true;
+}
+
+/*
+ * Fixed point packing with a per-block step. Values are stored two's
+ * complement, 4-bit: 2 per byte, 6-bit: 4 per 3 bytes
+ */
+static int pack_bits(enum iq_codec codec) {
+    return codec == IQ_CODEC_PACK4 ? 4 : 6;
+}
+
+static size_t pack_len(enum iq_codec codec, size_t n_values) {
+    return codec == IQ_CODEC_PACK4 ? (n_values + 1) / 2 : (n_values + 3) / 4 * 3;
+}
+
+static float pack_encode(enum iq_codec codec, const int8_t *in, size_t n_values, uint8_t *out) {
+    int bits = pack_bits(codec);
+    int q_max = (1 << (bits - 1)) - 1;
+
+    int peak = 0;
+    for (size_t i = 0; i < n_values; i++) {
+        int a = abs(in[i]);
+        peak = a > peak ? a : peak;
+    }
+    float scale = peak > 0 ? (float) peak / (float) q_max : 1.0f;
+    float inv = 1.0f / scale;
+
+    uint32_t mask = (1u << bits) - 1;
+    uint32_t acc = 0;
+    int n = 0;
+    size_t pos = 0;
+    for (size_t i = 0; i < n_values; i++) {
+        int q = (int) lrintf((float) in[i] * inv);
+        q = q > q_max ? q_max : (q < -q_max ? -q_max : q);
+        acc |= ((uint32_t) q & mask) << n;
+        n += bits;
+        while (n >= 8) {
+            out[pos++] = (uint8_t) acc;
+            acc >>= 8;
+            n -= 8;
+        }
+    }
+    if (n > 0) {
+        out[pos++] = (uint8_t) acc;
+    }
+    // pad the last 6-bit group
+    while (pos < pack_len(codec, n_values)) {
+        out[pos++] = 0;
+    }
+
+    return scale;
+}
+
+static bool pack_decode(enum iq_codec codec, const uint8_t *in, size_t len, size_t n_values, int8_t *q_out) {
+    int bits = pack_bits(codec);
+    if (len < pack_len(codec, n_values)) {
+        return false;
+    }
+
+    uint32_t mask = (1u << bits) - 1;
+    uint32_t sign = 1u << (bits - 1);
+    uint32_t acc = 0;
+    int n = 0;
+    size_t pos = 0;
+    for (size_t i = 0; i < n_values; i++) {
+        while (n < bits) {
+            acc |= (uint32_t) in[pos++] << n;
+            n += 8;
+        }
+        uint32_t v = acc & mask;
+        acc >>= bits;
+        n -= bits;
+        q_out[i] = (int8_t) ((v ^ sign) - sign);
+    }
+
+    return true;
+}
+
+size_t iq_encode_bound(size_t n_samples) {
+    return 2 * n_samples + 8;
+}
+
+void iq_encode(enum iq_codec codec, const int8_t *in, size_t n_samples, uint8_t *out, struct iq_block_header *h) {
+    size_t n_values = 2 * n_samples;
+    size_t len = 0;
+
+    h->samples = (uint32_t) n_samples;
+    h->scale = 1.0f;
+    h->param = 0;
+
+    switch (codec) {
+    case IQ_CODEC_PACK4:
+    case IQ_CODEC_PACK6:
+        h->codec = codec;
+        h->scale = pack_encode(codec, in, n_values, out);
+        h->payload_len = (uint32_t) pack_len(codec, n_values);
+        return;
+    case IQ_CODEC_RICE:
+        h->param = rice_param(in, n_values);
+        // give up as soon as the output is not smaller than the raw block
+        if (rice_encode(in, n_values, h->param, out, n_values - 1, &len)) {
+            h->codec = IQ_CODEC_RICE;
+            h->payload_len = (uint32_t) len;
+            return;
+        }
+        h->param = 0;
+        break;
+    case IQ_CODEC_RAW:
+        break;
+    }
+
+    h->codec = IQ_CODEC_RAW;
+    h->payload_len = (uint32_t) n_values;
+    memcpy(out, in, n_values);
+}
+
+bool iq_decode_int8(const struct iq_block_header *h, const uint8_t *payload, int8_t *out) {
+    size_t n_values = 2 * (size_t) h->samples;
+
+    switch (h->codec) {
+    case IQ_CODEC_RAW:
+        if (h->payload_len < n_values) {
+            return false;
+        }
+        memcpy(out, payload, n_values);
+        return true;
+    case IQ_CODEC_RICE:
+        return rice_decode(payload, h->payload_len, h->param, out, n_values);
+    case IQ_CODEC_PACK4:
+    case IQ_CODEC_PACK6:
+        if (!pack_decode(h->codec, payload, h->payload_len, n_values, out)) {
+            return false;
+        }
+        for (size_t i = 0; i < n_values; i++) {
+            long v = lrintf((float) out[i] * h->scale);
+            out[i] = (int8_t) (v > 127 ? 127 : (v < -128 ? -128 : v));
+        }
+        return true;
+    }
+
+    return false;
+}
+
+bool iq_decode_cf32(const struct iq_block_header *h, const uint8_t *payload, float *out) {
+    size_t n_values = 2 * (size_t) h->samples;
+
+    // decode into the tail of the output, int8 values are expanded front to back
+    int8_t *tmp = (int8_t *) (out + n_values) - n_values;
+    bool packed = h->codec == IQ_CODEC_PACK4 || h->codec == IQ_CODEC_PACK6;
+    bool ok = packed ? pack_decode(h->codec, payload, h->payload_len, n_values, tmp) :
+            iq_decode_int8(h, payload, tmp);
+    if (!ok) {
+        return false;
+    }
+
+    // packed blocks keep their full quantization step instead of rounding to int8
+    float scale = (packed ? h->scale : 1.0f) * (1.0f / 128.0f);
+    for (size_t i = 0; i < n_values; i++) {
+        out[i] = (float) tmp[i] * scale;
+    }
+    return true;
+}
+
+/*
+ * Reader
+ */
+static bool read_at(int fd, void *buf, size_t len, uint64_t offset) {
+    uint8_t *p = (uint8_t *) buf;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, (off_t) offset);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        len -= (size_t) n;
+        offset += (uint64_t) n;
+    }
+    return true;
+}
+
+static bool append_entry(struct iq_reader *r, size_t *cap, const struct iq_index_entry *e) {
+    if (r->n_blocks == *cap) {
+        size_t n = *cap ? 2 * *cap : 64;
+        struct iq_index_entry *index = realloc(r->index, n * sizeof(struct iq_index_entry));
+        if (index == NULL) {
+            return false;
+        }
+        r->index = index;
+        *cap = n;
+    }
+
+    r->index[r->n_blocks++] = *e;
+    return true;
+}
+
+static int load_index(struct iq_reader *r) {
+    uint64_t n = r->header.n_blocks;
+    if (n > SIZE_MAX / IQFILE_INDEX_ENTRY_SIZE) {
+        return -2;
+    }
+
+    uint8_t *buf = malloc(n * IQFILE_INDEX_ENTRY_SIZE + 1);
+    r->index = malloc(n * sizeof(struct iq_index_entry) + 1);
+    if (buf == NULL || r->index == NULL) {
+        free(buf);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (!read_at(r->fd, buf, n * IQFILE_INDEX_ENTRY_SIZE, r->header.index_offset)) {
+        free(buf);
+        return -2;
+    }
+
+    for (uint64_t i = 0; i < n; i++) {
+        get_index_entry(buf + i * IQFILE_INDEX_ENTRY_SIZE, &r->index[i]);
+    }
+    r->n_blocks = n;
+    free(buf);
+    return 0;
+}
+
+// recover the index of a recording that was not closed, stops at the first incomplete block
+static int scan_index(struct iq_reader *r) {
+    off_t end = lseek(r->fd, 0, SEEK_END);
+    if (end < 0) {
+        return -1;
+    }
+
+    size_t cap = 0;
+    uint64_t offset = IQFILE_HEADER_SIZE;
+    uint8_t buf[IQFILE_BLOCK_HEADER_SIZE];
+    struct iq_block_header h;
+
+    while (offset + IQFILE_BLOCK_HEADER_SIZE <= (uint64_t) end &&
+            read_at(r->fd, buf, sizeof(buf), offset) && get_block_header(buf, &h)) {
+        uint64_t next = offset + IQFILE_BLOCK_HEADER_SIZE + h.payload_len;
+        if (next > (uint64_t) end) {
+            break;
+        }
+
+        struct iq_index_entry e = {
+            .offset = offset,
+            .sample_idx = h.sample_idx,
+            .timestamp = h.timestamp,
+            .freq = h.freq,
+            .samples = h.samples,
+        };
+        if (!append_entry(r, &cap, &e)) {
+            errno = ENOMEM;
+            return -1;
+        }
+        offset = next;
+    }
+
+    return 0;
+}
+
+int iq_reader_open(struct iq_reader *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0) {
+        return -1;
+    }
+
+    uint8_t buf[IQFILE_HEADER_SIZE];
+    int ret = -2;
+    if (!read_at(r->fd, buf, sizeof(buf), 0) || !get_file_header(buf, &r->header)) {
+        goto ERROR;
+    }
+
+    ret = r->header.index_offset != 0 ? load_index(r) : scan_index(r);
+    if (ret != 0) {
+        goto ERROR;
+    }
+    return 0;
+
+ERROR:
+    iq_reader_close(r);
+    return ret;
+}
+
+void iq_reader_close(struct iq_reader *r) {
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    free(r->index);
+    free(r->payload);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+const uint8_t *iq_reader_block(struct iq_reader *r, size_t block, struct iq_block_header *h) {
+    if (block >= r->n_blocks) {
+        return NULL;
+    }
+
+    uint8_t buf[IQFILE_BLOCK_HEADER_SIZE];
+    uint64_t offset = r->index[block].offset;
+    if (!read_at(r->fd, buf, sizeof(buf), offset) || !get_block_header(buf, h)) {
+        return NULL;
+    }
+
+    if (h->payload_len > r->payload_cap) {
+        uint8_t *p = realloc(r->payload, h->payload_len);
+        if (p == NULL) {
+            return NULL;
+        }
+        r->payload = p;
+        r->payload_cap = h->payload_len;
+    }
+
+    if (!read_at(r->fd, r->payload, h->payload_len, offset + IQFILE_BLOCK_HEADER_SIZE)) {
+        return NULL;
+    }
+
+    return r->payload;
+}
+
+size_t iq_reader_find_time(const struct iq_reader *r, double timestamp) {
+    size_t lo = 0, hi = r->n_blocks;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (r->index[mid].timestamp <= timestamp) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+size_t iq_reader_find_sample(const struct iq_reader *r, uint64_t sample_idx) {
+    size_t lo = 0, hi = r->n_blocks;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (r->index[mid].sample_idx <= sample_idx) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
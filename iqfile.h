@@ -0,0 +1,171 @@
+#ifndef IQFILE_H
+#define IQFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Block based IQ recording format, all fields little endian:
+ *
+ *   file header   IQFILE_HEADER_SIZE bytes
+ *   blocks        block header followed by the encoded payload
+ *   index         one entry per block, written when the file is closed
+ *
+ * Every block header carries its own position in the stream, so the index of
+ * a file that was not closed properly can be rebuilt by scanning the blocks
+ */
+#define IQFILE_MAGIC "HRFIQ\0\0\1"
+#define IQFILE_VERSION 1
+#define IQFILE_HEADER_SIZE 64
+#define IQFILE_BLOCK_HEADER_SIZE 48
+#define IQFILE_INDEX_ENTRY_SIZE 40
+#define IQFILE_MAX_BLOCK_SAMPLES (1 << 24)
+
+enum iq_codec {
+    IQ_CODEC_RAW = 0,       // int8 as captured
+    IQ_CODEC_PACK4 = 1,     // 4-bit with per-block scale, lossy
+    IQ_CODEC_PACK6 = 2,     // 6-bit with per-block scale, lossy
+    IQ_CODEC_RICE = 3,      // per-channel delta, rice coded, lossless
+};
+
+struct iq_file_header {
+    uint32_t version;
+    uint32_t codec;         // codec requested for the recording
+    uint32_t block_samples;
+    double sample_rate;
+    uint64_t index_offset;  // 0 if the index was not written
+    uint64_t n_blocks;
+};
+
+struct iq_block_header {
+    uint32_t codec;         // codec of this block, incompressible blocks are stored raw
+    uint32_t samples;
+    uint32_t payload_len;
+    float scale;            // pack4/pack6 quantization step in int8 units
+    uint32_t param;         // rice parameter
+    uint64_t sample_idx;    // rx stream index of the first sample
+    double timestamp;       // wall clock time of the first sample in seconds
+    uint64_t freq;          // tuned frequency in Hz
+};
+
+struct iq_index_entry {
+    uint64_t offset;        // file offset of the block header
+    uint64_t sample_idx;
+    double timestamp;
+    uint64_t freq;
+    uint32_t samples;
+};
+
+/**
+ * Upper bound of the encoded payload size of a block
+ *
+ * @param n_samples number of complex samples
+ *
+ * @return size in bytes
+ */
+size_t iq_encode_bound(size_t n_samples);
+
+/**
+ * Encode a block. Blocks that do not compress are stored raw
+ *
+ * @param codec requested codec
+ * @param in interleaved int8 IQ
+ * @param n_samples number of complex samples
+ * @param out payload buffer of iq_encode_bound() bytes
+ * @param h block header, codec, samples, payload_len, scale and param are set
+ */
+void iq_encode(enum iq_codec codec, const int8_t *in, size_t n_samples, uint8_t *out, struct iq_block_header *h);
+
+/**
+ * Decode a block to interleaved int8 IQ
+ *
+ * @param h block header
+ * @param payload encoded payload
+ * @param out h->samples complex samples
+ *
+ * @return false if the payload is corrupt
+ */
+bool iq_decode_int8(const struct iq_block_header *h, const uint8_t *payload, int8_t *out);
+
+/**
+ * Decode a block to interleaved float32 IQ scaled to [-1, 1)
+ *
+ * @param h block header
+ * @param payload encoded payload
+ * @param out h->samples complex samples
+ *
+ * @return false if the payload is corrupt
+ */
+bool iq_decode_cf32(const struct iq_block_header *h, const uint8_t *payload, float *out);
+
+/**
+ * Serialize headers and index entries
+ */
+void iq_put_file_header(uint8_t *buf, const struct iq_file_header *h);
+void iq_put_block_header(uint8_t *buf, const struct iq_block_header *h);
+void iq_put_index_entry(uint8_t *buf, const struct iq_index_entry *e);
+
+/**
+ * Random access reader
+ */
+struct iq_reader {
+    int fd;
+    struct iq_file_header header;
+    struct iq_index_entry *index;
+    size_t n_blocks;
+    uint8_t *payload;
+    size_t payload_cap;
+};
+
+/**
+ * Open a recording and load its index, scanning the blocks if the index is
+ * missing
+ *
+ * @param r reader
+ * @param path file path
+ *
+ * @return 0 on success, -1 on an i/o error (errno is set), -2 if the file is
+ * not a recording
+ */
+int iq_reader_open(struct iq_reader *r, const char *path);
+
+/**
+ * Close the file and free the index
+ *
+ * @param r reader, may be zeroed or already closed
+ */
+void iq_reader_close(struct iq_reader *r);
+
+/**
+ * Read a block header and its payload
+ *
+ * @param r reader
+ * @param block block number
+ * @param h pointer to store the header
+ *
+ * @return payload valid until the next call or NULL on error
+ */
+const uint8_t *iq_reader_block(struct iq_reader *r, size_t block, struct iq_block_header *h);
+
+/**
+ * Find the last block starting at or before a time
+ *
+ * @param r reader
+ * @param timestamp wall clock time in seconds
+ *
+ * @return block number, 0 if the time is before the first block
+ */
+size_t iq_reader_find_time(const struct iq_reader *r, double timestamp);
+
+/**
+ * Find the last block starting at or before a stream index
+ *
+ * @param r reader
+ * @param sample_idx rx stream index
+ *
+ * @return block number, 0 if the index is before the first block
+ */
+size_t iq_reader_find_sample(const struct iq_reader *r, uint64_t sample_idx);
+
+#endif // IQFILE_H
@@ -0,0 +1,173 @@
+#include "modulator.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MOD_TABLE_SIZE (1 << MOD_TABLE_BITS)
+#define MOD_GAUSS_SPAN 3.5
+#define MOD_DEFAULT_BT 0.5
+
+static bool step_alloc(struct modulator *m, double lo, double hi) {
+    m->step_lo = lo;
+    m->step_hi = hi;
+    m->step_len = (size_t) ceil((hi - lo) * MOD_STEP_RES) + 1;
+    m->step = malloc(m->step_len * sizeof(float));
+    return m->step != NULL;
+}
+
+bool modulator_init(struct modulator *m, const struct mod_config *config) {
+    memset(m, 0, sizeof(*m));
+    m->config = *config;
+
+    struct mod_config *c = &m->config;
+    if (c->type == MOD_GFSK && c->bt <= 0.0) {
+        c->bt = MOD_DEFAULT_BT;
+    }
+
+    if (c->sample_rate <= 0.0 || c->symbol_rate <= 0.0 || c->sample_rate < 2.0 * c->symbol_rate ||
+            fabs(c->deviation) >= c->sample_rate / 2.0 || c->bt < 0.0 || c->gain <= 0.0f || c->gain > 1.0f) {
+        return false;
+    }
+
+    m->sps = c->sample_rate / c->symbol_rate;
+    m->bits_per_symbol = c->type == MOD_FSK4 ? 2 : 1;
+    m->dev_inc = c->deviation / c->sample_rate * 4294967296.0;
+
+    for (size_t k = 0; k < MOD_TABLE_SIZE; k++) {
+        m->table[k] = (float) cos(2.0 * M_PI * (double) k / MOD_TABLE_SIZE);
+    }
+
+    if (c->type == MOD_OOK) {
+        // keying edges are raised cosine ramps, at most one symbol long
+        double width = (double) c->ramp < m->sps ? (double) c->ramp / m->sps : 1.0;
+        if (c->ramp > 0) {
+            if (!step_alloc(m, 0.0, width)) {
+                return false;
+            }
+            for (size_t k = 0; k < m->step_len; k++) {
+                double x = (double) k / MOD_STEP_RES / width;
+                m->step[k] = x >= 1.0 ? 1.0f : (float) (0.5 - 0.5 * cos(M_PI * x));
+            }
+        }
+    } else if (c->bt > 0.0) {
+        // gaussian filtered nrz, each transition follows the integrated gaussian
+        double sigma = sqrt(log(2.0)) / (2.0 * M_PI * c->bt);
+        double half = MOD_GAUSS_SPAN * sigma;
+        if (!step_alloc(m, -half, half)) {
+            return false;
+        }
+        for (size_t k = 0; k < m->step_len; k++) {
+            double x = m->step_lo + (double) k / MOD_STEP_RES;
+            m->step[k] = (float) (0.5 * (1.0 + erf(x / (sqrt(2.0) * sigma))));
+        }
+    }
+
+    if (c->ramp > 0) {
+        m->ramp = malloc(c->ramp * sizeof(float));
+        if (m->ramp == NULL) {
+            modulator_deinit(m);
+            return false;
+        }
+        for (size_t k = 0; k < c->ramp; k++) {
+            m->ramp[k] = (float) (0.5 - 0.5 * cos(M_PI * ((double) k + 0.5) / (double) c->ramp));
+        }
+    }
+
+    return true;
+}
+
+void modulator_deinit(struct modulator *m) {
+    free(m->step);
+    free(m->ramp);
+    m->step = NULL;
+    m->ramp = NULL;
+}
+
+static size_t symbol_count(const struct modulator *m, size_t n_bits) {
+    return (n_bits + m->bits_per_symbol - 1) / m->bits_per_symbol;
+}
+
+size_t modulator_length(const struct modulator *m, size_t n_bits) {
+    size_t body = (size_t) ceil((double) symbol_count(m, n_bits) * m->sps - 1e-9);
+    size_t lead = m->config.type == MOD_OOK ? 0 : m->config.ramp;
+    return lead + body + m->config.ramp;
+}
+
+static inline int get_bit(const uint8_t *data, size_t n_bits, size_t idx) {
+    return idx < n_bits ? (data[idx >> 3] >> (7 - (idx & 7))) & 1 : 0;
+}
+
+// frequency (fsk) or amplitude (ook) of symbol k
+static float level(const struct modulator *m, const uint8_t *data, size_t n_bits, size_t n_sym, long k) {
+    if (m->config.type == MOD_OOK) {
+        return k >= 0 && (size_t) k < n_sym ? (float) get_bit(data, n_bits, (size_t) k) : 0.0f;
+    }
+
+    // fsk holds the first and last symbol during the ramps
+    size_t s = k < 0 ? 0 : ((size_t) k >= n_sym ? n_sym - 1 : (size_t) k);
+    if (m->bits_per_symbol == 1) {
+        return get_bit(data, n_bits, s) ? 1.0f : -1.0f;
+    }
+
+    // gray coded dibits: 01 +3, 00 +1, 10 -1, 11 -3
+    static const float fsk4[4] = {1.0f / 3.0f, 1.0f, -1.0f / 3.0f, -1.0f};
+    int sym = get_bit(data, n_bits, 2 * s) << 1 | get_bit(data, n_bits, 2 * s + 1);
+    return fsk4[sym];
+}
+
+size_t modulator_process(struct modulator *m, const uint8_t *data, size_t n_bits, int8_t *out) {
+    size_t n_sym = symbol_count(m, n_bits);
+    size_t total = modulator_length(m, n_bits);
+    if (n_sym == 0) {
+        return 0;
+    }
+
+    bool ook = m->config.type == MOD_OOK;
+    size_t ramp = m->config.ramp;
+    size_t lead = ook ? 0 : ramp;
+    float scale = 127.0f * m->config.gain;
+    int64_t carrier = (int64_t) llrint(m->dev_inc);
+
+    for (size_t n = 0; n < total; n++) {
+        double t = ((double) n - (double) lead) / m->sps;
+        float v;
+
+        if (m->step == NULL) {
+            v = level(m, data, n_bits, n_sym, (long) floor(t));
+        } else {
+            long k_lo = (long) floor(t - m->step_hi);
+            long k_hi = (long) floor(t - m->step_lo);
+            float prev = level(m, data, n_bits, n_sym, k_lo);
+            v = prev;
+            for (long k = k_lo + 1; k <= k_hi; k++) {
+                float cur = level(m, data, n_bits, n_sym, k);
+                if (cur != prev) {
+                    size_t idx = (size_t) ((t - (double) k - m->step_lo) * MOD_STEP_RES + 0.5);
+                    v += (cur - prev) * m->step[idx < m->step_len ? idx : m->step_len - 1];
+                }
+                prev = cur;
+            }
+        }
+
+        float env;
+        int64_t inc;
+        if (ook) {
+            env = v;
+            inc = carrier;
+        } else {
+            env = n < lead ? m->ramp[n] : (n >= total - ramp ? m->ramp[total - 1 - n] : 1.0f);
+            inc = (int64_t) llrint((double) v * m->dev_inc);
+        }
+
+        uint32_t idx = m->phase >> (32 - MOD_TABLE_BITS);
+        float a = env * scale;
+        float re = m->table[idx] * a;
+        float im = m->table[(idx - MOD_TABLE_SIZE / 4) & (MOD_TABLE_SIZE - 1)] * a;
+        out[2 * n] = (int8_t) lrintf(re);
+        out[2 * n + 1] = (int8_t) lrintf(im);
+
+        m->phase += (uint32_t) inc;
+    }
+
+    return total;
+}
@@ -0,0 +1,93 @@
+#ifndef MODULATOR_H
+#define MODULATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MOD_TABLE_BITS 10
+#define MOD_STEP_RES 256
+
+enum mod_type {
+    MOD_OOK,
+    MOD_FSK2,
+    MOD_FSK4,
+    MOD_GFSK,
+};
+
+/**
+ * Modulator parameters. Frequencies are in Hz
+ */
+struct mod_config {
+    enum mod_type type;
+    double sample_rate;     // tx sample rate
+    double symbol_rate;
+    double deviation;       // fsk peak deviation, ook carrier offset
+    double bt;              // gaussian filter bandwidth-time product, 0 disables shaping
+    size_t ramp;            // amplitude ramp length in samples
+    float gain;             // 1.0 maps full amplitude to 127
+};
+
+/**
+ * Bit to waveform modulator. Frequency is integrated by a 32-bit phase
+ * accumulator driving a sine table, symbol transitions are shaped by a
+ * precomputed step response
+ */
+struct modulator {
+    struct mod_config config;
+    double sps;             // samples per symbol
+    size_t bits_per_symbol;
+    double dev_inc;         // phase increment per sample at full deviation, 2^32 = one cycle
+    uint32_t phase;
+    float table[1 << MOD_TABLE_BITS];
+
+    // symbol transition step response over [step_lo, step_hi] symbols
+    float *step;
+    size_t step_len;
+    double step_lo;
+    double step_hi;
+
+    float *ramp;            // raised cosine, config.ramp entries
+};
+
+/**
+ * Initialize modulator
+ *
+ * @param m modulator
+ * @param config parameters
+ *
+ * @return false if parameters are invalid or memory allocation failed
+ */
+bool modulator_init(struct modulator *m, const struct mod_config *config);
+
+/**
+ * Destroy modulator
+ *
+ * @param m modulator
+ */
+void modulator_deinit(struct modulator *m);
+
+/**
+ * Number of samples produced for a burst
+ *
+ * @param m modulator
+ * @param n_bits number of bits
+ *
+ * @return number of complex samples including ramps
+ */
+size_t modulator_length(const struct modulator *m, size_t n_bits);
+
+/**
+ * Modulate a burst. Bits are taken MSB first, a partial 4-FSK symbol is
+ * padded with zeros. Carrier phase is continuous between bursts
+ *
+ * @param m modulator
+ * @param data packed bits
+ * @param n_bits number of bits
+ * @param out interleaved int8 IQ, must hold modulator_length() samples
+ *
+ * @return number of complex samples written
+ */
+size_t modulator_process(struct modulator *m, const uint8_t *data, size_t n_bits, int8_t *out);
+
+#endif // MODULATOR_H
@@ -0,0 +1,67 @@
+#include "nco.h"
+#include <math.h>
+
+void nco_init(struct nco *n, double freq) {
+    double w = 2.0 * M_PI * freq;
+    for (size_t k = 0; k <= NCO_CHUNK; k++) {
+        n->table[2 * k] = (float) cos(w * (double) k);
+        n->table[2 * k + 1] = (float) sin(w * (double) k);
+    }
+    nco_reset(n);
+}
+
+void nco_reset(struct nco *n) {
+    n->re = 1.0;
+    n->im = 0.0;
+}
+
+// advance the phasor by len samples
+static void advance(struct nco *n, size_t len) {
+    double sr = n->table[2 * len], si = n->table[2 * len + 1];
+    double re = n->re * sr - n->im * si;
+    double im = n->re * si + n->im * sr;
+    double mag = sqrt(re * re + im * im);
+    n->re = re / mag;
+    n->im = im / mag;
+}
+
+void nco_mix_int8(struct nco *n, const int8_t *in, float *out, size_t n_samples) {
+    for (size_t base = 0; base < n_samples; base += NCO_CHUNK) {
+        size_t len = n_samples - base < NCO_CHUNK ? n_samples - base : NCO_CHUNK;
+        const int8_t *x = in + 2 * base;
+        float *y = out + 2 * base;
+        const float *t = n->table;
+        float pr = (float) n->re, pi = (float) n->im;
+
+        for (size_t k = 0; k < len; k++) {
+            float xr = (float) x[2 * k] * (1.0f / 128.0f);
+            float xi = (float) x[2 * k + 1] * (1.0f / 128.0f);
+            float cr = t[2 * k] * pr - t[2 * k + 1] * pi;
+            float ci = t[2 * k] * pi + t[2 * k + 1] * pr;
+            y[2 * k] = xr * cr - xi * ci;
+            y[2 * k + 1] = xr * ci + xi * cr;
+        }
+
+        advance(n, len);
+    }
+}
+
+void nco_mix_cf32(struct nco *n, const float *in, float *out, size_t n_samples) {
+    for (size_t base = 0; base < n_samples; base += NCO_CHUNK) {
+        size_t len = n_samples - base < NCO_CHUNK ? n_samples - base : NCO_CHUNK;
+        const float *x = in + 2 * base;
+        float *y = out + 2 * base;
+        const float *t = n->table;
+        float pr = (float) n->re, pi = (float) n->im;
+
+        for (size_t k = 0; k < len; k++) {
+            float xr = x[2 * k], xi = x[2 * k + 1];
+            float cr = t[2 * k] * pr - t[2 * k + 1] * pi;
+            float ci = t[2 * k] * pi + t[2 * k + 1] * pr;
+            y[2 * k] = xr * cr - xi * ci;
+            y[2 * k + 1] = xr * ci + xi * cr;
+        }
+
+        advance(n, len);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef NCO_H
+#define NCO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NCO_CHUNK 1024
+
+/**
+ * Numerically controlled oscillator for frequency shifting. A table of one
+ * chunk of phasors is rotated by a double precision phasor that is
+ * renormalized after every chunk
+ */
+struct nco {
+    float table[2 * (NCO_CHUNK + 1)];
+    double re;
+    double im;
+};
+
+/**
+ * Initialize oscillator
+ *
+ * @param n nco
+ * @param freq frequency shift normalized to the sample rate (cycles per sample)
+ */
+void nco_init(struct nco *n, double freq);
+
+/**
+ * Reset phase to 0
+ *
+ * @param n nco
+ */
+void nco_reset(struct nco *n);
+
+/**
+ * Convert interleaved int8 samples to float32 scaled to [-1, 1) and shift them
+ *
+ * @param n nco
+ * @param in interleaved int8 IQ
+ * @param out interleaved float32 IQ
+ * @param n_samples number of complex samples
+ */
+void nco_mix_int8(struct nco *n, const int8_t *in, float *out, size_t n_samples);
+
+/**
+ * Shift interleaved float32 samples, in and out may be the same buffer
+ *
+ * @param n nco
+ * @param in interleaved float32 IQ
+ * @param out interleaved float32 IQ
+ * @param n_samples number of complex samples
+ */
+void nco_mix_cf32(struct nco *n, const float *in, float *out, size_t n_samples);
+
+#endif // NCO_H
@@ -3,10 +3,28 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
-#include <signal.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <semaphore.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
+#include <unistd.h>
 #include <libhackrf/hackrf.h>
 #include "queue.h"
+#include "iq_correction.h"
+#include "agc.h"
+#include "squelch.h"
+#include "correlator.h"
+#include "demod.h"
+#include "tx_baseband.h"
+#include "modulator.h"
+#include "hop.h"
+#include "rt.h"
+#include "snapshot.h"
+#include "recorder.h"
+#include "sweep_demux.h"
+#include "spill.h"
 
 #if defined(DEBUG) && (DEBUG == 1)
 #include <stdio.h>
@@ -15,9 +33,57 @@
 #define DEBUG_OUT(...)
 #endif
 
+#define MAX_DEMODS 8
+#define BYTES_PER_TRANSFER (BYTES_PER_BLOCK * 16)
+#define TX_RESAMPLER_TAPS 24
+
+// configure() applies fields in this order: clock and filter first, then tuning, gains last
+enum radio_field {
+    RADIO_SAMPLE_RATE,
+    RADIO_BASEBAND_FILTER,
+    RADIO_FREQ,
+    RADIO_AMP,
+    RADIO_LNA_GAIN,
+    RADIO_VGA_GAIN,
+    RADIO_TX_GAIN,
+    RADIO_ANTENNA,
+    RADIO_FIELDS,
+};
+
+// sub-objects that blocking consumers wait on without holding the object lock
+enum waiter_kind {
+    WAITER_AUDIO,
+    WAITER_SNAPSHOT,
+    WAITER_SWEEP,
+    WAITER_SPILL,
+    WAITER_KINDS,
+};
+
+static const char *radio_field_names[RADIO_FIELDS] = {
+    "sample_rate", "baseband_filter_bandwidth", "freq", "amp", "lna_gain", "vga_gain", "tx_gain", "antenna",
+};
+
+/**
+ * Last value successfully written to the device for each field
+ */
+struct radio_cache {
+    pthread_mutex_t lock;   // agc and hop threads write gains and frequency
+    uint64_t value[RADIO_FIELDS];
+    bool valid[RADIO_FIELDS];
+};
+
 struct packet {
     int8_t *buf;
     size_t size;
+    uint64_t sample_idx;
+    size_t samples;
+    float power;
+    uint32_t clipped;
+    uint8_t lna_gain;
+    uint8_t vga_gain;
+    uint64_t freq;
+    uint64_t retune_idx;
+    Py_buffer view;             // caller buffer held instead of a copy, view.obj is NULL otherwise
 };
 
 typedef struct {
@@ -25,18 +91,108 @@ typedef struct {
     hackrf_device *device;
     struct queue pkt_queue;
     struct packet data_pkt;
+    struct queue tx_done;       // consumed caller buffers, released with the GIL
+    pthread_mutex_t tx_push_lock;   // one producer of caller buffers at a time, tx_done is sized for it
+    atomic_ullong tx_released;
+    atomic_int tx_event_fd;
+    atomic_llong tx_buffered;   // bytes queued and not sent yet
+    atomic_llong tx_watermark;  // bytes, 0 disables low buffer notifications
+    atomic_bool tx_low_pending; // notified since the buffer last reached the watermark
+    atomic_ullong tx_underruns;
+    bool tx_sent;               // the last tx transfer carried data, running dry after it is an underrun
+    atomic_ullong tx_leaked;    // caller buffers tx_done could not take back, stays 0 unless its bound breaks
+    atomic_int tx_low_fd;
+    sem_t tx_low_sem;
+    pthread_t tx_low_thread;
+    atomic_bool tx_low_thread_running;  // cleared once the thread has been joined
+    atomic_bool tx_low_stop;
+    PyObject *tx_low_callback;
+    PyInterpreterState *tx_low_interp;
+    pthread_mutex_t tx_low_lock;    // serializes set_tx_watermark
+    struct iq_correction iq_corr;
+    struct radio_cache radio;
+    struct agc agc;
+    struct hop hop;
+    atomic_ullong freq;         // read by the rx callback
+    struct squelch squelch;
+    struct correlator correlator;
+    struct queue event_queue;
+    atomic_ullong events_dropped;
+    struct demod *demods[MAX_DEMODS];
+    int n_demods;
+    _Atomic double sample_rate; // read by the rx callback
+    struct tx_baseband *tx_bb;
+    struct modulator *mod;
+    pthread_mutex_t tx_lock;    // guards tx_bb and mod
+    struct packet rx_tags;
+    bool rx_restart;            // the next shared block follows a retune
     size_t tx_len;
     size_t tx_idx;
     size_t rx_idx;
-    bool allow_overruns;
-    volatile bool busy;
+    atomic_ullong rx_samples;
+    atomic_bool allow_overruns;
+    bool iq_corr_enabled;
+    bool squelch_enabled;
+    bool correlator_enabled;
+    bool sweep;
+    atomic_bool busy;           // cleared by the callbacks when a transfer ends
+    atomic_bool streaming;      // cleared only once hackrf_stop_* has returned
+    pthread_mutex_t lock;       // serializes methods that change configuration or stream state
+    unsigned int waiters[WAITER_KINDS]; // consumers inside a wait, guarded by lock
+    pthread_cond_t waiters_done;
+    struct rt_thread_config rt_callback;
+    struct rt_thread_config rt_workers;
+    bool rt_lock_memory;
+    bool rt_huge_pages;
+    atomic_bool rt_callback_pending;    // apply placement from the next transfer callback
+    atomic_int rt_callback_applied;
+    int rt_workers_applied;
+    int rt_workers_count;
+    bool rt_fifo_locked;
+    struct buf_pool *pool;      // NULL without memory placement
+    struct buf_pool *pools_retired; // replaced while consumers still held slots
+    pthread_mutex_t pool_lock;  // consumers return slots while the pool is replaced
+    struct snapshot snapshot;
+    bool snapshot_enabled;
+    bool snapshot_timed;        // period derived from interval_ms at the sample rate
+    struct recorder *rec;
+    pthread_mutex_t rec_lock;   // guards rec against the rx callback
+    struct sweep_demux sweep_demux;
+    bool sweep_demux_enabled;
+    struct spill spill;
+    atomic_bool spill_enabled;
+    pthread_mutex_t spill_pop_lock; // a record is peeked and consumed by one reader
 } HackrfObject;
 
-static struct queue **queue_list;
-static int queue_list_size;
-static void (*py_sigint_handler)(int);
+typedef struct {
+    PyObject_HEAD
+    struct iq_reader reader;
+    bool open;
+    bool lock_init;
+    pthread_mutex_t lock;       // the payload buffer is shared, one block is decoded at a time
+} ReaderObject;
+
+static const char *codec_names[] = {"raw", "pack4", "pack6", "rice"};
+
+struct module_state {
+    PyTypeObject *hackrf_type;
+    PyTypeObject *reader_type;
+    bool lib_ref;
+};
+
+// libhackrf state is process wide, shared by every interpreter that imports the module
+static pthread_mutex_t lib_lock = PTHREAD_MUTEX_INITIALIZER;
+static int lib_users;
+
+#define WAIT_SLICE_MS 50
+
+static void pkt_free(HackrfObject *self);
 
 static int pkt_allocate(HackrfObject *self, size_t size) {
+    if (self->data_pkt.view.obj != NULL) {
+        pkt_free(self);
+    }
+
     if (self->data_pkt.buf != NULL) {
         DEBUG_OUT("buffer is dirty - reallocation\n");
         self->data_pkt.buf = (int8_t *) realloc(self->data_pkt.buf, size);
@@ -54,7 +210,11 @@ static int pkt_allocate(HackrfObject *self, size_t size) {
 }
 
 static void pkt_free(HackrfObject *self) {
-    if (self->data_pkt.buf != NULL) {
+    if (self->data_pkt.view.obj != NULL) {
+        PyBuffer_Release(&self->data_pkt.view);
+        self->data_pkt.buf = NULL;
+        self->data_pkt.size = 0;
+    } else if (self->data_pkt.buf != NULL) {
         DEBUG_OUT("freeing buffer\n");
         free(self->data_pkt.buf);
         self->data_pkt.buf = NULL;
@@ -62,13 +222,220 @@ static void pkt_free(HackrfObject *self) {
     }
 }
 
-static void flush_queue(struct queue *q) {
+// rx packet buffers come from the pool when memory placement is enabled
+static void *pkt_buf_alloc(HackrfObject *self, size_t size) {
+    // the pool is only replaced while no transfer callback runs
+    void *buf = self->pool != NULL ? buf_pool_get(self->pool, size) : NULL;
+    return buf != NULL ? buf : malloc(size);
+}
+
+static void pkt_buf_free(HackrfObject *self, void *buf) {
+    pthread_mutex_lock(&self->pool_lock);
+    bool pooled = self->pool != NULL && buf_pool_put(self->pool, buf);
+
+    // a replaced pool is unmapped with its last slot
+    for (struct buf_pool **p = &self->pools_retired; !pooled && *p != NULL; p = &(*p)->next) {
+        struct buf_pool *pool = *p;
+        if (buf_pool_put(pool, buf)) {
+            pooled = true;
+            if (buf_pool_outstanding(pool) == 0) {
+                *p = pool->next;
+                buf_pool_deinit(pool);
+                free(pool);
+            }
+        }
+    }
+    pthread_mutex_unlock(&self->pool_lock);
+
+    if (!pooled) {
+        free(buf);
+    }
+}
+
+/**
+ * Drop the current pool, it stays mapped until consumers have returned the
+ * slots they still hold. The stream must be stopped
+ */
+static void pool_release(HackrfObject *self) {
+    pthread_mutex_lock(&self->pool_lock);
+    struct buf_pool *pool = self->pool;
+    self->pool = NULL;
+    if (pool != NULL && buf_pool_outstanding(pool) > 0) {
+        pool->next = self->pools_retired;
+        self->pools_retired = pool;
+        pool = NULL;
+    }
+    pthread_mutex_unlock(&self->pool_lock);
+
+    if (pool != NULL) {
+        buf_pool_deinit(pool);
+        free(pool);
+    }
+}
+
+static void fifo_unlock(HackrfObject *self) {
+    if (self->rt_fifo_locked) {
+        rt_unlock_region(self->pkt_queue.data, self->pkt_queue.size);
+        self->rt_fifo_locked = false;
+    }
+}
+
+// called by the spill writer thread once a packet is on disk
+static void spill_free(void *ctx, void *buf) {
+    pkt_buf_free((HackrfObject *) ctx, buf);
+}
+
+/**
+ * Release caller buffers consumed by the tx callback, needs the GIL
+ *
+ * @return number of buffers released
+ */
+static size_t tx_release_done(HackrfObject *self) {
+    size_t n = 0;
+    Py_buffer view;
+    while (queue_pop_noblock(&self->tx_done, &view)) {
+        PyBuffer_Release(&view);
+        n++;
+    }
+    return n;
+}
+
+// hand a caller buffer back to a thread holding the GIL
+static void tx_view_done(HackrfObject *self, Py_buffer *view) {
+    // tx_done is sized for every buffer that can be in flight
+    if (!queue_push_noblock(&self->tx_done, view)) {
+        atomic_fetch_add(&self->tx_leaked, 1);
+    }
+    memset(view, 0, sizeof(*view));
+}
+
+// a consumed tx packet, caller buffers are handed back to a thread holding the GIL
+static void tx_pkt_done(HackrfObject *self, struct packet *pkt) {
+    if (pkt->view.obj != NULL) {
+        tx_view_done(self, &pkt->view);
+        atomic_fetch_add(&self->tx_released, 1);
+    } else {
+        free(pkt->buf);
+    }
+    pkt->buf = NULL;
+}
+
+static void mutex_lock_nogil(pthread_mutex_t *m) {
+    // never wait for the lock while holding the GIL, the owner may need it back
+    if (pthread_mutex_trylock(m) != 0) {
+        Py_BEGIN_ALLOW_THREADS
+        pthread_mutex_lock(m);
+        Py_END_ALLOW_THREADS
+    }
+}
+
+static void flush_queue(HackrfObject *self) {
     struct packet pkt;
-    while (queue_pop_noblock(q, &pkt)) {
-        if (pkt.buf != NULL) {
-            free(pkt.buf);
+    while (queue_pop_noblock(&self->pkt_queue, &pkt)) {
+        if (pkt.view.obj != NULL) {
+            PyBuffer_Release(&pkt.view);
+            atomic_fetch_add(&self->tx_released, 1);
+        } else if (pkt.buf != NULL) {
+            pkt_buf_free(self, pkt.buf);
+        }
+    }
+    tx_release_done(self);
+    atomic_store(&self->tx_buffered, 0);
+
+    if (self->spill_enabled) {
+        mutex_lock_nogil(&self->spill_pop_lock);
+        spill_flush(&self->spill);
+        pthread_mutex_unlock(&self->spill_pop_lock);
+    }
+}
+
+// worker threads started later are placed when they are created
+static void rt_apply_workers(HackrfObject *self) {
+    self->rt_workers_applied = 0;
+    self->rt_workers_count = 0;
+    if (!self->rt_workers.pin && self->rt_workers.priority == 0) {
+        return;
+    }
+
+    pthread_t threads[MAX_DEMODS + 2];
+    int n = 0;
+    if (self->agc.running) {
+        threads[n++] = self->agc.thread;
+    }
+    if (self->hop.running) {
+        threads[n++] = self->hop.thread;
+    }
+    for (int i = 0; i < MAX_DEMODS; i++) {
+        if (self->demods[i] != NULL && self->demods[i]->running) {
+            threads[n++] = self->demods[i]->thread;
         }
     }
+
+    int applied = RT_AFFINITY | RT_PRIORITY;
+    for (int i = 0; i < n; i++) {
+        applied &= rt_apply_thread(threads[i], &self->rt_workers);
+    }
+
+    self->rt_workers_applied = n > 0 ? applied : 0;
+    self->rt_workers_count = n;
+}
+
+static void rt_stream_start(HackrfObject *self) {
+    atomic_store(&self->rt_callback_pending, self->rt_callback.pin || self->rt_callback.priority > 0);
+    rt_apply_workers(self);
+}
+
+/**
+ * Lock the FIFO and map the rx packet pool. The pool holds one packet per FIFO
+ * slot plus the ones owned by the callback and the consumer. Rebuilding it
+ * drops queued packets
+ *
+ * @return false if the pool could not be mapped
+ */
+static bool rt_prepare_memory(HackrfObject *self, bool rebuild) {
+    fifo_unlock(self);
+    if (!self->rt_lock_memory && !self->rt_huge_pages) {
+        if (self->pool != NULL) {
+            flush_queue(self);
+            pool_release(self);
+        }
+        return true;
+    }
+
+    if (self->rt_lock_memory) {
+        self->rt_fifo_locked = rt_lock_region(self->pkt_queue.data, self->pkt_queue.size);
+    }
+
+    // iq corrected packets are float32
+    size_t n_slots = self->pkt_queue.size / sizeof(struct packet) + 1;
+    size_t slot_size = BYTES_PER_TRANSFER * (self->iq_corr_enabled ? sizeof(float) : 1);
+    if (!rebuild && self->pool != NULL && self->pool->n_slots == n_slots && self->pool->slot_size >= slot_size) {
+        return true;
+    }
+
+    flush_queue(self);
+    pool_release(self);
+
+    struct buf_pool *pool = malloc(sizeof(*pool));
+    if (pool == NULL) {
+        return false;
+    }
+    if (!buf_pool_init(pool, n_slots, slot_size, self->rt_lock_memory, self->rt_huge_pages)) {
+        free(pool);
+        return false;
+    }
+
+    pthread_mutex_lock(&self->pool_lock);
+    self->pool = pool;
+    pthread_mutex_unlock(&self->pool_lock);
+    return true;
+}
+
+static void flush_events(struct queue *q) {
+    struct correlator_event e;
+    while (queue_pop_noblock(q, &e)) {
+        free(e.window);
+    }
 }
 
 static void flush_callback(void *flush_ctx, int success) {
@@ -77,8 +444,225 @@ static void flush_callback(void *flush_ctx, int success) {
     self->busy = false;
 }
 
+/**
+ * Push to or pop from a queue without the GIL. Blocking waits are split in
+ * slices so signal handlers run while waiting and Ctrl-C interrupts them
+ *
+ * @return 1 on success, 0 if the queue was full/empty, terminated or timed out,
+ * -1 if a signal handler raised an exception
+ */
+static int queue_wait(struct queue *q, void *item, bool push, bool block, uint32_t timeout_ms) {
+    if (!block) {
+        return push ? queue_push_noblock(q, item) : queue_pop_noblock(q, item);
+    }
+
+    uint32_t waited = 0;
+    for (;;) {
+        uint32_t slice = WAIT_SLICE_MS;
+        if (timeout_ms > 0 && timeout_ms - waited < slice) {
+            slice = timeout_ms - waited;
+        }
+
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = push ? queue_push(q, item, slice) : queue_pop(q, item, slice);
+        Py_END_ALLOW_THREADS
+
+        if (ok) {
+            return 1;
+        }
+
+        if (queue_terminated(q)) {
+            return 0;
+        }
+
+        if (PyErr_CheckSignals() < 0) {
+            return -1;
+        }
+
+        waited += slice;
+        if (timeout_ms > 0 && waited >= timeout_ms) {
+            return 0;
+        }
+    }
+}
+
+static void object_lock(HackrfObject *self) {
+    mutex_lock_nogil(&self->lock);
+}
+
+static void object_unlock(HackrfObject *self) {
+    pthread_mutex_unlock(&self->lock);
+}
+
+static void stream_stop(HackrfObject *self) {
+    self->busy = false;
+    Py_BEGIN_ALLOW_THREADS
+    hackrf_stop_tx(self->device); // same code used for rx
+    Py_END_ALLOW_THREADS
+    atomic_store(&self->streaming, false);
+}
+
+/**
+ * Check that no transfer callback can run, state used by the callbacks may
+ * only change then. A callback clears busy while other transfers are still in
+ * flight, a stream that ended on its own is stopped here
+ *
+ * @return false while streaming
+ */
+static bool stream_stopped(HackrfObject *self) {
+    if (!atomic_load(&self->streaming)) {
+        return true;
+    }
+
+    if (self->busy) {
+        return false;
+    }
+
+    stream_stop(self);
+    return true;
+}
+
+/**
+ * Register a consumer that waits on a sub-object without the object lock. The
+ * object lock must be held, the sub-object is not freed until waiter_leave
+ */
+static void waiter_enter(HackrfObject *self, enum waiter_kind kind) {
+    self->waiters[kind]++;
+}
+
+static void waiter_leave(HackrfObject *self, enum waiter_kind kind) {
+    object_lock(self);
+    if (--self->waiters[kind] == 0) {
+        pthread_cond_broadcast(&self->waiters_done);
+    }
+    object_unlock(self);
+}
+
+/**
+ * Wait until consumers of a sub-object have left, the object lock must be held
+ * and the sub-object already unpublished so that no new consumer enters. A
+ * consumer waits for at most one slice before it leaves
+ */
+static void waiters_drain(HackrfObject *self, enum waiter_kind kind) {
+    while (self->waiters[kind] > 0) {
+        Py_BEGIN_ALLOW_THREADS
+        pthread_cond_wait(&self->waiters_done, &self->lock);
+        Py_END_ALLOW_THREADS
+    }
+}
+
+static void rx_update_stats(HackrfObject *self, const int8_t *buf, size_t len, struct packet *pkt) {
+    struct rx_stats stats;
+    uint32_t lna_gain, vga_gain;
+
+    rx_stats_compute(buf, len, &stats);
+    agc_update(&self->agc, &stats, &lna_gain, &vga_gain);
+
+    if (pkt != NULL) {
+        pkt->sample_idx = atomic_load(&self->rx_samples);
+        pkt->samples = len / 2;
+        pkt->power = stats.power;
+        pkt->clipped = stats.clipped;
+        pkt->lna_gain = (uint8_t) lna_gain;
+        pkt->vga_gain = (uint8_t) vga_gain;
+    }
+
+    atomic_fetch_add(&self->rx_samples, len / 2);
+}
+
+static void radio_store(HackrfObject *self, enum radio_field field, uint64_t value) {
+    pthread_mutex_lock(&self->radio.lock);
+    self->radio.value[field] = value;
+    self->radio.valid[field] = true;
+    pthread_mutex_unlock(&self->radio.lock);
+}
+
+// issue the control transfer for one field and cache the value on success
+static int radio_apply(HackrfObject *self, enum radio_field field, uint64_t value) {
+    int ret = HACKRF_ERROR_INVALID_PARAM;
+
+    switch (field) {
+    case RADIO_SAMPLE_RATE:
+        ret = hackrf_set_sample_rate(self->device, (double) value);
+        break;
+    case RADIO_BASEBAND_FILTER:
+        ret = hackrf_set_baseband_filter_bandwidth(self->device, (uint32_t) value);
+        break;
+    case RADIO_FREQ:
+        ret = hackrf_set_freq(self->device, value);
+        break;
+    case RADIO_AMP:
+        ret = hackrf_set_amp_enable(self->device, (uint8_t) value);
+        break;
+    case RADIO_LNA_GAIN:
+        ret = hackrf_set_lna_gain(self->device, (uint32_t) value);
+        break;
+    case RADIO_VGA_GAIN:
+        ret = hackrf_set_vga_gain(self->device, (uint32_t) value);
+        break;
+    case RADIO_TX_GAIN:
+        ret = hackrf_set_txvga_gain(self->device, (uint32_t) value);
+        break;
+    case RADIO_ANTENNA:
+        ret = hackrf_set_antenna_enable(self->device, (uint8_t) value);
+        break;
+    case RADIO_FIELDS:
+        break;
+    }
+
+    if (ret == HACKRF_SUCCESS) {
+        radio_store(self, field, field == RADIO_BASEBAND_FILTER ?
+                hackrf_compute_baseband_filter_bw((uint32_t) value) : value);
+    }
+
+    return ret;
+}
+
+static int hop_set_freq(void *ctx, uint64_t freq) {
+    HackrfObject *self = (HackrfObject *) ctx;
+
+    if (radio_apply(self, RADIO_FREQ, freq) != HACKRF_SUCCESS) {
+        DEBUG_OUT("hop: could not set freq\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int agc_set_gain(void *ctx, uint32_t lna_gain, uint32_t vga_gain) {
+    HackrfObject *self = (HackrfObject *) ctx;
+
+    if (radio_apply(self, RADIO_LNA_GAIN, lna_gain) != HACKRF_SUCCESS) {
+        DEBUG_OUT("agc: could not set lna_gain\n");
+        return -1;
+    }
+
+    if (radio_apply(self, RADIO_VGA_GAIN, vga_gain) != HACKRF_SUCCESS) {
+        DEBUG_OUT("agc: could not set vga_gain\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static double wall_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+// placement of the libusb event thread can only be set from the thread itself
+static inline void rt_callback_check(HackrfObject *self) {
+    if (atomic_load_explicit(&self->rt_callback_pending, memory_order_relaxed) &&
+            atomic_exchange(&self->rt_callback_pending, false)) {
+        atomic_store(&self->rt_callback_applied, rt_apply_thread(pthread_self(), &self->rt_callback));
+    }
+}
+
 static int tx_callback(hackrf_transfer *transfer) {
     HackrfObject *self = (HackrfObject *) transfer->tx_ctx;
+    rt_callback_check(self);
 
     int ret = 0;
     if (!self->busy) {
@@ -87,6 +671,11 @@ static int tx_callback(hackrf_transfer *transfer) {
     }
 
     size_t buffer_length = transfer->buffer_length;
+    if (self->tx_idx >= self->data_pkt.size) {
+        memset(transfer->buffer, 0, buffer_length);
+        return -1;
+    }
+
     size_t len = buffer_length;
     if (self->tx_idx + buffer_length >= self->data_pkt.size) {
         len = self->data_pkt.size - self->tx_idx;
@@ -96,14 +685,22 @@ static int tx_callback(hackrf_transfer *transfer) {
     DEBUG_OUT("buffer_length = %zu, len = %zu\n", buffer_length, len);
 
     memcpy(transfer->buffer, self->data_pkt.buf + self->tx_idx, len);
+    memset(transfer->buffer + len, 0, buffer_length - len);
     self->tx_idx += buffer_length;
 
+    // the last chunk is out, the caller may resize its buffer again
+    if (ret != 0 && self->data_pkt.view.obj != NULL) {
+        tx_view_done(self, &self->data_pkt.view);
+        self->data_pkt.buf = NULL;
+    }
+
     return ret;
 }
 
 static int rx_callback(hackrf_transfer *transfer) {
     DEBUG_OUT("buffer_length = %d\n", transfer->valid_length);
     HackrfObject *self = (HackrfObject *) transfer->rx_ctx;
+    rt_callback_check(self);
 
     if (!self->busy) {
         DEBUG_OUT("rx done!\n");
@@ -111,6 +708,8 @@ static int rx_callback(hackrf_transfer *transfer) {
     }
 
     size_t len = transfer->valid_length;
+    rx_update_stats(self, (const int8_t *) transfer->buffer, len, NULL);
+
     if (self->rx_idx + len >= self->data_pkt.size) {
         len = self->data_pkt.size - self->rx_idx;
         DEBUG_OUT("rx last chunk, len = %zu\n", len);
@@ -125,76 +724,297 @@ static int rx_callback(hackrf_transfer *transfer) {
     return 0;
 }
 
+static bool rx_queue_packet(HackrfObject *self, struct packet *pkt) {
+    // once packets spill, later ones follow them until the consumer has drained the spill
+    bool spill = self->spill_enabled;
+    if ((!spill || spill_depth(&self->spill) == 0) && queue_push_noblock(&self->pkt_queue, pkt)) {
+        return true;
+    }
+
+    if (spill) {
+        if (spill_submit(&self->spill, pkt, pkt->buf, pkt->size)) {
+            return true;
+        }
+
+        // dropping the oldest packet would reorder the stream, drop the new one
+        if (self->allow_overruns) {
+            pkt_buf_free(self, pkt->buf);
+            return true;
+        }
+        return false;
+    }
+
+    if (!self->allow_overruns) {
+        return false;
+    }
+
+    // pop first element and push new one (circular buffer)
+    struct packet p;
+    if (!queue_pop_noblock(&self->pkt_queue, &p)) {
+        return false;
+    }
+    pkt_buf_free(self, p.buf);
+
+    return queue_push_noblock(&self->pkt_queue, pkt);
+}
+
+static bool rx_packet_fill(HackrfObject *self, struct packet *pkt, const int8_t *buf, size_t len) {
+    // corrected samples are converted to float32, 4 bytes per int8
+    bool corrected = self->iq_corr_enabled && !self->sweep;
+    pkt->size = corrected ? len * sizeof(float) : len;
+    pkt->buf = pkt_buf_alloc(self, pkt->size);
+    if (pkt->buf == NULL) {
+        DEBUG_OUT("unable to allocate memory for rx stream\n");
+        return false;
+    }
+
+    if (corrected) {
+        iq_correction_process(&self->iq_corr, buf, (float *) pkt->buf, len / 2);
+    } else {
+        memcpy(pkt->buf, buf, len);
+    }
+
+    return true;
+}
+
+static bool squelch_emit(void *ctx, int8_t *buf, size_t len, uint64_t start_idx) {
+    HackrfObject *self = (HackrfObject *) ctx;
+    struct packet pkt = self->rx_tags;
+
+    if (self->iq_corr_enabled) {
+        bool ok = rx_packet_fill(self, &pkt, buf, len);
+        free(buf);
+        if (!ok) {
+            return false;
+        }
+    } else {
+        pkt.buf = buf;
+        pkt.size = len;
+    }
+
+    pkt.sample_idx = start_idx;
+    pkt.samples = len / 2;
+
+    if (!rx_queue_packet(self, &pkt)) {
+        DEBUG_OUT("rx queue full - dropping burst\n");
+        pkt_buf_free(self, pkt.buf);
+        return false;
+    }
+
+    return true;
+}
+
+static bool correlator_emit(void *ctx, struct correlator_event *event) {
+    HackrfObject *self = (HackrfObject *) ctx;
+
+    if (!queue_push_noblock(&self->event_queue, event)) {
+        DEBUG_OUT("event queue full - dropping event\n");
+        free(event->window);
+        atomic_fetch_add(&self->events_dropped, 1);
+    }
+
+    return true;
+}
+
+// samples before and after a retune are not contiguous, stateful consumers start over at idx
+static bool rx_retuned(HackrfObject *self, uint64_t idx) {
+    bool ok = true;
+    self->rx_restart = true;
+    if (self->squelch_enabled) {
+        ok = squelch_flush(&self->squelch);
+    }
+    if (self->correlator_enabled) {
+        ok = correlator_restart(&self->correlator, idx) && ok;
+    }
+    return ok;
+}
+
 static int rx_stream_callback(hackrf_transfer *transfer) {
     DEBUG_OUT("rx_len = %d\n", transfer->valid_length);
     HackrfObject *self = (HackrfObject *) transfer->rx_ctx;
     struct packet pkt;
+    rt_callback_check(self);
 
     if (!self->busy) {
         DEBUG_OUT("rx done!\n");
         return -1;
     }
 
-    if (transfer->valid_length > 0) {
-        pkt.buf = malloc(transfer->valid_length);
-        if (pkt.buf == NULL) {
-            DEBUG_OUT("unable to allocate memory for rx stream\n");
-            return -1;
+    if (transfer->valid_length <= 0) {
+        return 0;
+    }
+
+    const int8_t *buf = (const int8_t *) transfer->buffer;
+    size_t len = transfer->valid_length;
+    uint64_t base_idx = atomic_load(&self->rx_samples);
+    rx_update_stats(self, buf, len, &self->rx_tags);
+
+    // everything downstream only sees samples captured at a settled frequency
+    struct hop_range range;
+    if (!self->sweep && hop_update(&self->hop, base_idx, len / 2, &range)) {
+        if (range.retune_idx != self->rx_tags.retune_idx && !rx_retuned(self, base_idx + range.start)) {
+            goto RX_STREAM_STOP;
+        }
+        self->rx_tags.freq = range.freq;
+        self->rx_tags.retune_idx = range.retune_idx;
+        if (range.start == range.end) {
+            return 0;
         }
+        buf += 2 * range.start;
+        len = 2 * (range.end - range.start);
+        base_idx += range.start;
+        self->rx_tags.sample_idx = base_idx;
+        self->rx_tags.samples = len / 2;
+    } else {
+        self->rx_tags.freq = self->sweep ? 0 : self->freq;
+        self->rx_tags.retune_idx = 0;
+    }
 
-        memcpy(pkt.buf, transfer->buffer, transfer->valid_length);
-        pkt.size = transfer->valid_length;
+    // demultiplexed sweeps replace the packet FIFO
+    if (self->sweep && self->sweep_demux_enabled) {
+        sweep_demux_process(&self->sweep_demux, (const uint8_t *) buf, len);
+        return 0;
+    }
 
-        if (!queue_push_noblock(&self->pkt_queue, &pkt)) {
-            if (!self->allow_overruns) {
-                goto RX_STREAM_CLEANUP;
+    double now = wall_time();
+
+    // demodulators and the recorder share one copy of the transfer
+    if (!self->sweep) {
+        pthread_mutex_lock(&self->rec_lock);
+        struct recorder *rec = self->rec;
+        int refs = self->n_demods + (rec != NULL);
+        if (refs > 0) {
+            struct shared_block *b = shared_block_new(buf, len, base_idx, refs);
+            if (b != NULL) {
+                b->restart = self->rx_restart;
+                self->rx_restart = false;
+                for (int i = 0; i < MAX_DEMODS; i++) {
+                    if (self->demods[i] != NULL) {
+                        demod_submit(self->demods[i], b);
+                    }
+                }
+                if (rec != NULL) {
+                    struct record_item item = {
+                        .block = b,
+                        .freq = self->rx_tags.freq,
+                        .timestamp = now - (double) (len / 2) / self->sample_rate,
+                    };
+                    recorder_submit(rec, &item);
+                }
+            } else if (rec != NULL) {
+                atomic_fetch_add(&rec->dropped, 1);
             }
+        }
+        pthread_mutex_unlock(&self->rec_lock);
+    }
 
-            // pop first element and push new one (circular buffer)
-            struct packet p;
-            if (!queue_pop_noblock(&self->pkt_queue, &p)) {
-                goto RX_STREAM_CLEANUP;
-            }
-            free(p.buf);
+    // correlate corrected samples when they are available, raw ones otherwise
+    bool snapshot = self->snapshot_enabled && !self->sweep;
+    bool correlate = self->correlator_enabled && !self->sweep;
+    bool corrected = self->iq_corr_enabled && !self->squelch_enabled && !snapshot && !self->sweep;
+    if (correlate && !corrected) {
+        correlator_process_int8(&self->correlator, buf, len / 2, base_idx);
+    }
 
-            if (!queue_push_noblock(&self->pkt_queue, &pkt)) {
-                goto RX_STREAM_CLEANUP;
-            }
+    // snapshots replace the packet FIFO
+    if (snapshot) {
+        snapshot_process(&self->snapshot, buf, len / 2, base_idx, now, self->sample_rate);
+        return 0;
+    }
+
+    if (self->squelch_enabled && !self->sweep) {
+        if (!squelch_process(&self->squelch, buf, len / 2, base_idx)) {
+            goto RX_STREAM_STOP;
         }
+        return 0;
+    }
+
+    pkt = self->rx_tags;
+    if (!rx_packet_fill(self, &pkt, buf, len)) {
+        return -1;
+    }
+
+    if (correlate && corrected) {
+        correlator_process_cf32(&self->correlator, (const float *) pkt.buf, len / 2, base_idx);
+    }
+
+    if (!rx_queue_packet(self, &pkt)) {
+        DEBUG_OUT("rx queue full - dropping pkt\n");
+        pkt_buf_free(self, pkt.buf);
+        goto RX_STREAM_STOP;
     }
 
     return 0;
 
-RX_STREAM_CLEANUP:
-    DEBUG_OUT("rx queue full - dropping pkt\n");
-    free(pkt.buf);
+RX_STREAM_STOP:
     self->busy = false;
 
     return -1;
 }
 
+static void tx_queued(HackrfObject *self, size_t bytes) {
+    long long total = atomic_fetch_add(&self->tx_buffered, (long long) bytes) + (long long) bytes;
+    if (total >= atomic_load(&self->tx_watermark)) {
+        atomic_store(&self->tx_low_pending, false);
+    }
+}
+
+// account for sent bytes and wake the producer once when the buffer runs low
+static void tx_consumed(HackrfObject *self, size_t bytes) {
+    long long left = atomic_fetch_sub(&self->tx_buffered, (long long) bytes) - (long long) bytes;
+    long long watermark = atomic_load(&self->tx_watermark);
+    if (watermark == 0 || left >= watermark || atomic_exchange(&self->tx_low_pending, true)) {
+        return;
+    }
+
+    int fd = atomic_load(&self->tx_low_fd);
+    if (fd >= 0) {
+        uint64_t one = 1;
+        ssize_t ret = write(fd, &one, sizeof(one));
+        (void) ret;
+    }
+
+    // the python callback runs on its own thread, never on the usb thread
+    if (atomic_load(&self->tx_low_thread_running)) {
+        sem_post(&self->tx_low_sem);
+    }
+}
+
+// signal the producer once per transfer that freed caller buffers
+static void tx_notify(HackrfObject *self, uint64_t released_before) {
+    int fd = atomic_load(&self->tx_event_fd);
+    uint64_t n = atomic_load(&self->tx_released) - released_before;
+    if (fd >= 0 && n > 0) {
+        ssize_t ret = write(fd, &n, sizeof(n));
+        (void) ret;
+    }
+}
+
 static int tx_stream_callback(hackrf_transfer *transfer) {
     HackrfObject *self = (HackrfObject *) transfer->tx_ctx;
     size_t idx = 0;
+    rt_callback_check(self);
 
     if (!self->busy) {
         DEBUG_OUT("tx done!\n");
         return -1;
     }
 
+    uint64_t released = atomic_load(&self->tx_released);
     if (self->data_pkt.buf) {
         if (self->tx_len > (size_t) transfer->buffer_length) {
             DEBUG_OUT("tx draining pkt: %zu\n", self->tx_len);
             memcpy(transfer->buffer, self->data_pkt.buf + self->tx_idx, transfer->buffer_length);
             self->tx_idx += transfer->buffer_length;
             self->tx_len -= transfer->buffer_length;
+            self->tx_sent = true;
+            tx_consumed(self, transfer->buffer_length);
             return 0;
         } else {
             DEBUG_OUT("tx drained pkt: %zu\n", self->tx_len);
             memcpy(transfer->buffer, self->data_pkt.buf + self->tx_idx, self->tx_len);
             idx = self->tx_len;
-            free(self->data_pkt.buf);
-            self->data_pkt.buf = NULL;
+            tx_pkt_done(self, &self->data_pkt);
         }
     }
 
@@ -204,6 +1024,14 @@ static int tx_stream_callback(hackrf_transfer *transfer) {
         if (!queue_pop_noblock(&self->pkt_queue, &self->data_pkt)) {
             DEBUG_OUT("tx queue is empty - idling\n");
             memset(transfer->buffer + idx, 0, remaining_bytes);
+
+            // idling before the first push or after the last one is not a gap
+            if (idx > 0 || self->tx_sent) {
+                atomic_fetch_add(&self->tx_underruns, 1);
+            }
+            self->tx_sent = false;
+            tx_consumed(self, idx);
+            tx_notify(self, released);
             return self->allow_overruns ? 0 : -1;
         }
 
@@ -212,29 +1040,75 @@ static int tx_stream_callback(hackrf_transfer *transfer) {
             memcpy(transfer->buffer + idx, self->data_pkt.buf, remaining_bytes);
             self->tx_idx = remaining_bytes;
             self->tx_len = self->data_pkt.size - remaining_bytes;
+            self->tx_sent = true;
+            tx_consumed(self, transfer->buffer_length);
+            tx_notify(self, released);
             return 0;
         }
 
         DEBUG_OUT("tx copy %zu, idx = %zu\n", self->data_pkt.size, idx);
         memcpy(transfer->buffer + idx, self->data_pkt.buf, self->data_pkt.size);
         idx += self->data_pkt.size;
-        free(self->data_pkt.buf);
-        self->data_pkt.buf = NULL;
+        remaining_bytes -= self->data_pkt.size;
+        tx_pkt_done(self, &self->data_pkt);
     }
 
     DEBUG_OUT("tx %d\n", transfer->buffer_length);
+    self->tx_sent = true;
+    tx_consumed(self, transfer->buffer_length);
+    tx_notify(self, released);
 
     return 0;
 }
 
-static PyObject *py_set_sample_rate(HackrfObject *self, PyObject *args) {
-    uint64_t sample_rate;
-    if (!PyArg_ParseTuple(args, "K", &sample_rate)) {
-        PyErr_SetString(PyExc_TypeError, "argument must be unsigned long long");
+// objects that captured the sample rate when they were created
+static const char *rate_dependent(HackrfObject *self) {
+    if (self->n_demods > 0) {
+        return "demodulators";
+    }
+    if (self->tx_bb != NULL) {
+        return "the tx resampler";
+    }
+    if (self->mod != NULL) {
+        return "the modulator";
+    }
+    if (self->snapshot_enabled && self->snapshot_timed) {
+        return "interval snapshots";
+    }
+
+    // the file header and block timestamps use the rate the recording started with
+    pthread_mutex_lock(&self->rec_lock);
+    bool recording = self->rec != NULL;
+    pthread_mutex_unlock(&self->rec_lock);
+    if (recording) {
+        return "the recorder";
+    }
+    return NULL;
+}
+
+static bool rate_change_allowed(HackrfObject *self, double sample_rate) {
+    const char *dep = sample_rate != self->sample_rate ? rate_dependent(self) : NULL;
+    if (dep != NULL) {
+        PyErr_Format(PyExc_RuntimeError, "remove %s before changing the sample rate", dep);
+        return false;
+    }
+    return true;
+}
+
+static PyObject *py_set_sample_rate(HackrfObject *self, PyObject *args) {
+    uint64_t sample_rate;
+    if (!PyArg_ParseTuple(args, "K", &sample_rate)) {
+        PyErr_SetString(PyExc_TypeError, "argument must be unsigned long long");
         Py_RETURN_NONE;
     }
 
-    hackrf_set_sample_rate(self->device, sample_rate);
+    if (!rate_change_allowed(self, (double) sample_rate)) {
+        return NULL;
+    }
+
+    if (radio_apply(self, RADIO_SAMPLE_RATE, sample_rate) == HACKRF_SUCCESS) {
+        self->sample_rate = (double) sample_rate;
+    }
 
     Py_RETURN_NONE;
 }
@@ -246,7 +1120,9 @@ static PyObject *py_set_freq(HackrfObject *self, PyObject *args) {
         Py_RETURN_NONE;
     }
 
-    hackrf_set_freq(self->device, freq);
+    if (radio_apply(self, RADIO_FREQ, freq) == HACKRF_SUCCESS) {
+        self->freq = freq;
+    }
 
     Py_RETURN_NONE;
 }
@@ -258,7 +1134,7 @@ static PyObject *py_set_baseband_filter_bandwidth(HackrfObject *self, PyObject *
         Py_RETURN_NONE;
     }
 
-    int ok = hackrf_set_baseband_filter_bandwidth(self->device, freq);
+    int ok = radio_apply(self, RADIO_BASEBAND_FILTER, freq);
     return PyLong_FromLong(ok);
 }
 
@@ -269,7 +1145,7 @@ static PyObject *py_set_tx_gain(HackrfObject *self, PyObject *args) {
         Py_RETURN_NONE;
     }
 
-    int ok = hackrf_set_txvga_gain(self->device, gain);
+    int ok = radio_apply(self, RADIO_TX_GAIN, gain);
     return PyLong_FromLong(ok);
 }
 
@@ -282,16 +1158,20 @@ static PyObject *py_set_rx_gain(HackrfObject *self, PyObject *args) {
         Py_RETURN_NONE;
     }
 
-    if (hackrf_set_vga_gain(self->device, vga_gain) != HACKRF_SUCCESS) {
+    if (radio_apply(self, RADIO_VGA_GAIN, vga_gain) != HACKRF_SUCCESS) {
         ok = -1;
         DEBUG_OUT("could not set vga_gain\n");
     }
 
-    if (hackrf_set_lna_gain(self->device, lna_gain) != HACKRF_SUCCESS) {
+    if (radio_apply(self, RADIO_LNA_GAIN, lna_gain) != HACKRF_SUCCESS) {
         ok = -1;
         DEBUG_OUT("could not set lna_gain\n");
     }
 
+    if (ok == 0) {
+        agc_set_gains(&self->agc, lna_gain, vga_gain);
+    }
+
     return PyLong_FromLong(ok);
 }
 
@@ -302,7 +1182,7 @@ static PyObject *py_set_amp(HackrfObject *self, PyObject *args) {
         Py_RETURN_NONE;
     }
 
-    int ok = hackrf_set_amp_enable(self->device, (uint8_t) enable);
+    int ok = radio_apply(self, RADIO_AMP, (uint8_t) enable);
     return PyLong_FromLong(ok);
 }
 
@@ -313,10 +1193,149 @@ static PyObject *py_set_antenna_enable(HackrfObject *self, PyObject *args) {
         Py_RETURN_NONE;
     }
 
-    int ok = hackrf_set_antenna_enable(self->device, (uint8_t) enable);
+    int ok = radio_apply(self, RADIO_ANTENNA, (uint8_t) enable);
     return PyLong_FromLong(ok);
 }
 
+static PyObject *py_configure(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    uint64_t values[RADIO_FIELDS];
+    bool requested[RADIO_FIELDS] = {false};
+    bool force = false;
+
+    if (PyTuple_GET_SIZE(args) != 0) {
+        PyErr_SetString(PyExc_TypeError, "configure() takes keyword arguments only");
+        return NULL;
+    }
+
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    while (kwds != NULL && PyDict_Next(kwds, &pos, &key, &value)) {
+        const char *name = PyUnicode_AsUTF8(key);
+        if (name == NULL) {
+            return NULL;
+        }
+
+        if (strcmp(name, "force") == 0) {
+            force = PyObject_IsTrue(value) > 0;
+            continue;
+        }
+
+        int field = 0;
+        while (field < RADIO_FIELDS && strcmp(name, radio_field_names[field]) != 0) {
+            field++;
+        }
+        if (field == RADIO_FIELDS) {
+            PyErr_Format(PyExc_TypeError, "configure() got an unexpected keyword argument '%s'", name);
+            return NULL;
+        }
+
+        if (value == Py_None) {
+            continue;
+        }
+
+        if (field == RADIO_AMP || field == RADIO_ANTENNA) {
+            int enable = PyObject_IsTrue(value);
+            if (enable < 0) {
+                return NULL;
+            }
+            values[field] = (uint64_t) enable;
+        } else {
+            values[field] = PyLong_AsUnsignedLongLong(value);
+            if (PyErr_Occurred()) {
+                return NULL;
+            }
+        }
+
+        // the firmware rounds to a supported bandwidth, compare against what will be set
+        if (field == RADIO_BASEBAND_FILTER) {
+            values[field] = hackrf_compute_baseband_filter_bw((uint32_t) values[field]);
+        }
+        requested[field] = true;
+    }
+
+    if (requested[RADIO_SAMPLE_RATE] && !rate_change_allowed(self, (double) values[RADIO_SAMPLE_RATE])) {
+        return NULL;
+    }
+
+    // drop fields the device already has
+    pthread_mutex_lock(&self->radio.lock);
+    for (int field = 0; field < RADIO_FIELDS; field++) {
+        if (requested[field] && !force && self->radio.valid[field] && self->radio.value[field] == values[field]) {
+            requested[field] = false;
+        }
+    }
+    pthread_mutex_unlock(&self->radio.lock);
+
+    double elapsed[RADIO_FIELDS];
+    int failed = -1;
+    int ret = HACKRF_SUCCESS;
+
+    Py_BEGIN_ALLOW_THREADS
+    for (int field = 0; field < RADIO_FIELDS; field++) {
+        if (!requested[field]) {
+            continue;
+        }
+
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        ret = radio_apply(self, (enum radio_field) field, values[field]);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        elapsed[field] = (double) (t1.tv_sec - t0.tv_sec) + (double) (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+        if (ret != HACKRF_SUCCESS) {
+            failed = field;
+            break;
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    // keep the state derived from the applied fields in sync
+    for (int field = 0; field < RADIO_FIELDS && field != failed; field++) {
+        if (!requested[field]) {
+            continue;
+        }
+        if (field == RADIO_SAMPLE_RATE) {
+            self->sample_rate = (double) values[field];
+        } else if (field == RADIO_FREQ) {
+            self->freq = values[field];
+        }
+    }
+    if (requested[RADIO_LNA_GAIN] || requested[RADIO_VGA_GAIN]) {
+        pthread_mutex_lock(&self->radio.lock);
+        if (self->radio.valid[RADIO_LNA_GAIN] && self->radio.valid[RADIO_VGA_GAIN]) {
+            agc_set_gains(&self->agc, (uint32_t) self->radio.value[RADIO_LNA_GAIN],
+                    (uint32_t) self->radio.value[RADIO_VGA_GAIN]);
+        }
+        pthread_mutex_unlock(&self->radio.lock);
+    }
+
+    if (failed >= 0) {
+        PyErr_Format(PyExc_RuntimeError, "failed to set %s: %s (%d)", radio_field_names[failed],
+                hackrf_error_name((enum hackrf_error) ret), ret);
+        return NULL;
+    }
+
+    PyObject *timing = PyDict_New();
+    if (timing == NULL) {
+        return NULL;
+    }
+
+    for (int field = 0; field < RADIO_FIELDS; field++) {
+        if (!requested[field]) {
+            continue;
+        }
+        PyObject *t = PyFloat_FromDouble(elapsed[field]);
+        if (t == NULL || PyDict_SetItemString(timing, radio_field_names[field], t) != 0) {
+            Py_XDECREF(t);
+            Py_DECREF(timing);
+            return NULL;
+        }
+        Py_DECREF(t);
+    }
+
+    return timing;
+}
+
 static PyObject *py_set_hw_sync_mode(HackrfObject *self, PyObject *args) {
     int enable;
     if (!PyArg_ParseTuple(args, "p", &enable)) {
@@ -329,7 +1348,7 @@ static PyObject *py_set_hw_sync_mode(HackrfObject *self, PyObject *args) {
 }
 
 static PyObject *py_read(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
-    if (self->busy) {
+    if (!stream_stopped(self)) {
         DEBUG_OUT("rx busy\n");
         Py_RETURN_NONE;
     }
@@ -341,11 +1360,102 @@ static PyObject *py_read(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
     return array;
 }
 
+static PyObject *packet_meta(const struct packet *pkt) {
+    return Py_BuildValue("{s:K,s:n,s:f,s:I,s:I,s:I,s:K,s:K}",
+            "sample_index", (unsigned long long) pkt->sample_idx,
+            "samples", (Py_ssize_t) pkt->samples,
+            "power", pkt->power,
+            "clipped", pkt->clipped,
+            "lna_gain", (unsigned int) pkt->lna_gain,
+            "vga_gain", (unsigned int) pkt->vga_gain,
+            "freq", (unsigned long long) pkt->freq,
+            "retune_index", (unsigned long long) pkt->retune_idx);
+}
+
+/**
+ * Pop from the FIFO and the spill in stream order. The FIFO holds the oldest
+ * packets, spilled ones follow and new packets bypass the spill once it is
+ * drained
+ *
+ * @return 1 with pkt or array set, 0 on timeout, -1 on error, 2 if spilling
+ * is disabled
+ */
+static int pop_spilled(HackrfObject *self, struct packet *pkt, PyObject **array, bool block, uint32_t timeout_ms) {
+    uint32_t waited = 0;
+    for (;;) {
+        // the spill is destroyed by set_spill, check it is still there for every slice
+        object_lock(self);
+        if (!self->spill_enabled) {
+            object_unlock(self);
+            return 2;
+        }
+        waiter_enter(self, WAITER_SPILL);
+        object_unlock(self);
+        mutex_lock_nogil(&self->spill_pop_lock);
+
+        if (queue_pop_noblock(&self->pkt_queue, pkt)) {
+            pthread_mutex_unlock(&self->spill_pop_lock);
+            waiter_leave(self, WAITER_SPILL);
+            return 1;
+        }
+
+        uint32_t slice = block ? WAIT_SLICE_MS : 0;
+        if (timeout_ms > 0 && timeout_ms - waited < slice) {
+            slice = timeout_ms - waited;
+        }
+
+        bool ok;
+        if (spill_depth(&self->spill) > 0) {
+            const void *meta, *data;
+            size_t len;
+            Py_BEGIN_ALLOW_THREADS
+            ok = spill_peek(&self->spill, &meta, &data, &len, slice);
+            Py_END_ALLOW_THREADS
+
+            if (ok) {
+                memcpy(pkt, meta, sizeof(*pkt));
+                pkt->buf = NULL;
+                *array = PyByteArray_FromStringAndSize((const char *) data, (Py_ssize_t) len);
+                spill_consume(&self->spill);
+                pthread_mutex_unlock(&self->spill_pop_lock);
+                waiter_leave(self, WAITER_SPILL);
+                return *array != NULL ? 1 : -1;
+            }
+        } else {
+            Py_BEGIN_ALLOW_THREADS
+            ok = slice > 0 && queue_pop(&self->pkt_queue, pkt, slice);
+            Py_END_ALLOW_THREADS
+
+            if (ok) {
+                pthread_mutex_unlock(&self->spill_pop_lock);
+                waiter_leave(self, WAITER_SPILL);
+                return 1;
+            }
+        }
+        pthread_mutex_unlock(&self->spill_pop_lock);
+        waiter_leave(self, WAITER_SPILL);
+
+        if (!block) {
+            return 0;
+        }
+
+        if (PyErr_CheckSignals() < 0) {
+            return -1;
+        }
+
+        waited += slice;
+        if (timeout_ms > 0 && waited >= timeout_ms) {
+            return 0;
+        }
+    }
+}
+
 static PyObject *py_pop(HackrfObject *self, PyObject *args, PyObject *kwds) {
-    static char *kwlist[] = {"block", "timeout", NULL};
-    bool block = true;
+    static char *kwlist[] = {"block", "timeout", "meta", NULL};
+    int block = true;
     uint32_t timeout = 0;
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|pI", kwlist, &block, &timeout)) {
+    int meta = false;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|pIp", kwlist, &block, &timeout, &meta)) {
         PyErr_SetString(PyExc_TypeError, "invalid argument");
         Py_RETURN_NONE;
     }
@@ -356,18 +1466,30 @@ static PyObject *py_pop(HackrfObject *self, PyObject *args, PyObject *kwds) {
     }
 
     struct packet pkt = {0};
-    bool ok = block ? queue_pop(&self->pkt_queue, &pkt, timeout) :
-            queue_pop_noblock(&self->pkt_queue, &pkt);
-    if (ok) {
-        if (pkt.buf == NULL) {
-            DEBUG_OUT("rx thread: buffer is null\n");
-            Py_RETURN_NONE;
-        }
+    PyObject *array = NULL;
+    int ret = atomic_load(&self->spill_enabled) ? pop_spilled(self, &pkt, &array, block, timeout) : 2;
+    if (ret == 2) {
+        ret = queue_wait(&self->pkt_queue, &pkt, false, block, timeout);
+    }
+    if (ret < 0) {
+        return NULL;
+    }
 
-        DEBUG_OUT("pop %zu bytes\n", pkt.size);
+    if (ret > 0) {
+        if (array == NULL) {
+            if (pkt.buf == NULL) {
+                DEBUG_OUT("rx thread: buffer is null\n");
+                Py_RETURN_NONE;
+            }
 
-        PyObject *array = PyByteArray_FromStringAndSize((const char *) pkt.buf, pkt.size);
-        free(pkt.buf);
+            DEBUG_OUT("pop %zu bytes\n", pkt.size);
+
+            array = PyByteArray_FromStringAndSize((const char *) pkt.buf, pkt.size);
+            pkt_buf_free(self, pkt.buf);
+        }
+        if (meta && array != NULL) {
+            return Py_BuildValue("(NN)", array, packet_meta(&pkt));
+        }
         return array;
     }
 
@@ -375,187 +1497,766 @@ static PyObject *py_pop(HackrfObject *self, PyObject *args, PyObject *kwds) {
 }
 
 static PyObject *py_push(HackrfObject *self, PyObject *args, PyObject *kwds) {
-    static char *kwlist[] = {"item", "block", "timeout", NULL};
-    bool block = true;
+    static char *kwlist[] = {"item", "block", "timeout", "copy", NULL};
+    Py_buffer view;
+    int block = true;
     uint32_t timeout = 0;
-    PyObject *tx_buf;
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|pI", kwlist, &tx_buf, &timeout, &block)) {
+    PyObject *copy_obj = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|pIO", kwlist, &view, &block, &timeout, &copy_obj)) {
         PyErr_SetString(PyExc_TypeError, "invalid argument");
-        Py_RETURN_NONE;
-    }
-
-    if (!PyByteArray_Check(tx_buf)) {
-        PyErr_SetString(PyExc_TypeError, "argument must be a bytearray");
-        Py_RETURN_NONE;
+        return NULL;
     }
 
     if (self->pkt_queue.size == 0) {
+        PyBuffer_Release(&view);
         PyErr_SetString(PyExc_RuntimeError, "queue not initialized");
-        Py_RETURN_NONE;
+        return NULL;
+    }
+
+    // only read-only buffers are sent without a copy unless the caller asks for it
+    int copy = copy_obj == Py_None ? !view.readonly : PyObject_IsTrue(copy_obj);
+    if (copy < 0) {
+        PyBuffer_Release(&view);
+        return NULL;
     }
 
-    size_t len = PyByteArray_GET_SIZE(tx_buf);
+    // concurrent producers could hold more caller buffers than tx_done can take back
+    if (!copy) {
+        mutex_lock_nogil(&self->tx_push_lock);
+    }
+    tx_release_done(self);
 
+    // the packet keeps the caller buffer until the tx callback has copied it
     struct packet pkt;
-    pkt.size = len;
-    pkt.buf = malloc(len);
-    if (pkt.buf == NULL) {
-        PyErr_NoMemory();
-        Py_RETURN_NONE;
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.size = view.len;
+    if (copy) {
+        pkt.buf = malloc(view.len + 1);
+        if (pkt.buf == NULL) {
+            PyBuffer_Release(&view);
+            return PyErr_NoMemory();
+        }
+        memcpy(pkt.buf, view.buf, view.len);
+        PyBuffer_Release(&view);
+    } else {
+        pkt.buf = view.buf;
+        pkt.view = view;
     }
-    memcpy(pkt.buf, PyByteArray_AS_STRING(tx_buf), len);
 
-    bool ok = block ? queue_push(&self->pkt_queue, &pkt, timeout) :
-            queue_push_noblock(&self->pkt_queue, &pkt);
-    if (!ok) {
-        DEBUG_OUT("rx queue full - dropping pkt\n");
-        free(pkt.buf);
+    // counted before the callback can see the packet
+    tx_queued(self, pkt.size);
+    int ret = queue_wait(&self->pkt_queue, &pkt, true, block, timeout);
+    if (!copy) {
+        pthread_mutex_unlock(&self->tx_push_lock);
+    }
+    if (ret <= 0) {
+        DEBUG_OUT("tx queue full - dropping pkt\n");
+        atomic_fetch_sub(&self->tx_buffered, (long long) pkt.size);
+        if (pkt.view.obj != NULL) {
+            PyBuffer_Release(&pkt.view);
+        } else {
+            free(pkt.buf);
+        }
+        if (ret < 0) {
+            return NULL;
+        }
         Py_RETURN_FALSE;
     }
 
     Py_RETURN_TRUE;
 }
 
-static PyObject *py_start_rx(HackrfObject *self, PyObject *args) {
-    if (self->busy) {
-        Py_RETURN_FALSE;
-    }
+static PyObject *py_tx_released(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
+    tx_release_done(self);
+    return PyLong_FromUnsignedLongLong(atomic_load(&self->tx_released));
+}
 
-    size_t rx_len = 0;
-    if (!PyArg_ParseTuple(args, "K", &rx_len)) {
-        PyErr_SetString(PyExc_TypeError, "invalid length");
-        Py_RETURN_NONE;
+static PyObject *py_tx_release_fd(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
+    int fd = atomic_load(&self->tx_event_fd);
+    if (fd < 0) {
+        fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
+            return PyErr_SetFromErrno(PyExc_OSError);
+        }
+        atomic_store(&self->tx_event_fd, fd);
     }
 
-    if (pkt_allocate(self, rx_len) != 0) {
-        PyErr_NoMemory();
-        Py_RETURN_NONE;
-    }
+    return PyLong_FromLong(fd);
+}
 
-    self->rx_idx = 0;
-    int ok = hackrf_start_rx(self->device, rx_callback, (void *) self);
+static void *tx_low_thread(void *arg) {
+    HackrfObject *self = (HackrfObject *) arg;
+    PyThreadState *ts = PyThreadState_New(self->tx_low_interp);
 
-    self->busy = (ok == HACKRF_SUCCESS);
-    return PyBool_FromLong(ok);
-}
+    for (;;) {
+        while (sem_wait(&self->tx_low_sem) != 0) {
+        }
+        if (atomic_load(&self->tx_low_stop)) {
+            break;
+        }
 
-static PyObject *py_start_rx_stream(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
-    if (self->busy) {
-        Py_RETURN_FALSE;
-    }
+        long long left = atomic_load(&self->tx_buffered);
+        PyEval_AcquireThread(ts);
 
-    if (self->pkt_queue.size == 0) {
-        PyErr_SetString(PyExc_RuntimeError, "queue not initialized");
-        Py_RETURN_NONE;
+        // the callback may replace or drop itself through set_tx_watermark
+        PyObject *callback = Py_XNewRef(self->tx_low_callback);
+        if (callback != NULL) {
+            PyObject *ret = PyObject_CallFunction(callback, "L", (left > 0 ? left : 0) / 2);
+            if (ret == NULL) {
+                PyErr_WriteUnraisable(callback);
+            }
+            Py_XDECREF(ret);
+            Py_DECREF(callback);
+        }
+        PyEval_ReleaseThread(ts);
     }
 
-    flush_queue(&self->pkt_queue);
+    PyEval_AcquireThread(ts);
+    PyThreadState_Clear(ts);
+    PyThreadState_DeleteCurrent();
+    return NULL;
+}
 
-    int ok = hackrf_start_rx(self->device, rx_stream_callback, (void *) self);
-    self->busy = (ok == HACKRF_SUCCESS);
+// stop the notifier, the GIL is released while it finishes a running callback
+static void tx_low_stop_thread(HackrfObject *self) {
+    if (!atomic_load(&self->tx_low_thread_running)) {
+        return;
+    }
 
-    return PyBool_FromLong(ok);
+    atomic_store(&self->tx_low_stop, true);
+    sem_post(&self->tx_low_sem);
+    Py_BEGIN_ALLOW_THREADS
+    pthread_join(self->tx_low_thread, NULL);
+    Py_END_ALLOW_THREADS
+    atomic_store(&self->tx_low_thread_running, false);
+    Py_CLEAR(self->tx_low_callback);
 }
 
-static PyObject *py_start_tx(HackrfObject *self, PyObject *args) {
-    if (self->busy) {
-        Py_RETURN_FALSE;
-    }
+// called from the notifier thread, which can neither join itself nor wait for tx_low_lock
+static bool tx_low_on_thread(HackrfObject *self) {
+    return atomic_load(&self->tx_low_thread_running) && pthread_equal(pthread_self(), self->tx_low_thread);
+}
 
-    PyObject *tx_buf;
-    if (!PyArg_ParseTuple(args, "O", &tx_buf)) {
-        Py_RETURN_NONE;
+static PyObject *py_set_tx_watermark(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"samples", "callback", NULL};
+    unsigned long long samples;
+    PyObject *callback = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "K|O", kwlist, &samples, &callback)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
     }
 
-    if (!PyByteArray_Check(tx_buf)) {
-        PyErr_SetString(PyExc_TypeError, "argument must be a bytearray");
-        Py_RETURN_NONE;
+    if (callback != Py_None && !PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "callback must be callable");
+        return NULL;
     }
 
-    size_t len = PyByteArray_GET_SIZE(tx_buf);
-
-    if (pkt_allocate(self, len) != 0) {
-        PyErr_NoMemory();
-        Py_RETURN_NONE;
+    if (samples > (unsigned long long) LLONG_MAX / 2) {
+        PyErr_SetString(PyExc_ValueError, "watermark too large");
+        return NULL;
     }
 
-    memcpy(self->data_pkt.buf, PyByteArray_AS_STRING(tx_buf), len);
-
-    self->busy = true;
-    self->tx_idx = 0;
+    // swapped in place under the GIL, the thread keeps running without a callback
+    if (tx_low_on_thread(self)) {
+        atomic_store(&self->tx_watermark, (long long) (2 * samples));
+        atomic_store(&self->tx_low_pending, false);
+        if (samples > 0 && callback != Py_None) {
+            Py_XSETREF(self->tx_low_callback, Py_NewRef(callback));
+        } else {
+            Py_CLEAR(self->tx_low_callback);
+        }
+        Py_RETURN_TRUE;
+    }
 
-    int ok = hackrf_start_tx(self->device, tx_callback, (void *) self);
-    return PyBool_FromLong(ok);
-}
+    // not taken with the object lock, a running callback may call any method
+    mutex_lock_nogil(&self->tx_low_lock);
+    tx_low_stop_thread(self);
 
-static PyObject *py_start_tx_stream(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
-    if (self->busy) {
-        Py_RETURN_FALSE;
-    }
+    atomic_store(&self->tx_watermark, (long long) (2 * samples));
+    atomic_store(&self->tx_low_pending, false);
 
-    if (self->pkt_queue.size == 0) {
-        PyErr_SetString(PyExc_RuntimeError, "queue not initialized");
-        Py_RETURN_NONE;
+    if (samples > 0 && callback != Py_None) {
+        while (sem_trywait(&self->tx_low_sem) == 0) {
+        }
+        self->tx_low_callback = Py_NewRef(callback);
+        self->tx_low_interp = PyInterpreterState_Get();
+        atomic_store(&self->tx_low_stop, false);
+        if (pthread_create(&self->tx_low_thread, NULL, tx_low_thread, self) != 0) {
+            Py_CLEAR(self->tx_low_callback);
+            pthread_mutex_unlock(&self->tx_low_lock);
+            PyErr_SetString(PyExc_RuntimeError, "failed to start notification thread");
+            return NULL;
+        }
+        atomic_store(&self->tx_low_thread_running, true);
     }
+    pthread_mutex_unlock(&self->tx_low_lock);
 
-    flush_queue(&self->pkt_queue);
+    Py_RETURN_TRUE;
+}
 
-    self->busy = true;
-    self->tx_len = 0;
-    self->tx_idx = 0;
+static PyObject *py_tx_watermark_fd(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
+    int fd = atomic_load(&self->tx_low_fd);
+    if (fd < 0) {
+        fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
+            return PyErr_SetFromErrno(PyExc_OSError);
+        }
+        atomic_store(&self->tx_low_fd, fd);
+    }
 
-    int ok = hackrf_start_tx(self->device, tx_stream_callback, (void *) self);
-    return PyBool_FromLong(ok);
+    return PyLong_FromLong(fd);
 }
 
-static PyObject *py_start_sweep(HackrfObject *self, PyObject *args, PyObject *kwds) {
-    static char *kwlist[] = {"freqs_list", "chunks", "step_width", "offset", NULL};
-
-    uint16_t frequencies[MAX_SWEEP_RANGES * 2];
-    uint32_t chunks;
-    uint32_t step_width;
-    uint32_t offset;
+static PyObject *py_tx_buffered(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
+    long long left = atomic_load(&self->tx_buffered);
+    return PyLong_FromLongLong((left > 0 ? left : 0) / 2);
+}
 
-    PyObject *freqs_list;
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OIII", kwlist,
-            &freqs_list, &chunks, &step_width, &offset)) {
+static PyObject *py_set_tx_resampler(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"ratio", "freq_offset", "gain", NULL};
+    double ratio;
+    double freq_offset = 0.0;
+    float gain = 1.0f;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "d|df", kwlist, &ratio, &freq_offset, &gain)) {
         PyErr_SetString(PyExc_TypeError, "invalid argument");
-        Py_RETURN_NONE;
-    }
-
-    Py_ssize_t size = PyList_Size(freqs_list);
-    if (size >= MAX_SWEEP_RANGES) {
-        PyErr_SetString(PyExc_ValueError, "number of ranges exceeds MAX_SWEEP_RANGES");
         return NULL;
     }
 
-    int ctr = 0;
-    for (Py_ssize_t i = 0; i < size; i++) {
-        PyObject* tuple = PyList_GetItem(freqs_list, i);
-
-        if (!PyTuple_Check(tuple) || PyTuple_Size(tuple) != 2) {
-            PyErr_SetString(PyExc_TypeError, "each element must be a tuple with two integers");
+    struct tx_baseband *t = NULL;
+    if (ratio > 0.0) {
+        if (ratio < 1.0 || fabs(freq_offset) >= self->sample_rate / 2.0 || gain <= 0.0f) {
+            PyErr_SetString(PyExc_ValueError, "invalid resampler parameters");
             return NULL;
         }
 
-        PyObject* v0 = PyTuple_GetItem(tuple, 0);
-        PyObject* v1 = PyTuple_GetItem(tuple, 1);
+        t = malloc(sizeof(struct tx_baseband));
+        if (t == NULL) {
+            PyErr_NoMemory();
+            return NULL;
+        }
 
-        if (!PyLong_Check(v0) || !PyLong_Check(v1)) {
-            PyErr_SetString(PyExc_TypeError, "both elements in the tuple must be integers");
+        if (!tx_baseband_init(t, ratio, freq_offset / self->sample_rate, gain, TX_RESAMPLER_TAPS)) {
+            free(t);
+            PyErr_NoMemory();
             return NULL;
         }
+    }
 
-        // Extract integer values
-        uint32_t freq_min = PyLong_AsLong(v0);
-        uint32_t freq_max = PyLong_AsLong(v1);
+    pthread_mutex_lock(&self->tx_lock);
+    struct tx_baseband *old = self->tx_bb;
+    self->tx_bb = t;
+    pthread_mutex_unlock(&self->tx_lock);
 
-        frequencies[ctr++] = freq_min;
-        frequencies[ctr++] = freq_max;
+    if (old != NULL) {
+        tx_baseband_deinit(old);
+        free(old);
     }
 
-    int ok = hackrf_init_sweep(
-        self->device,
+    Py_RETURN_TRUE;
+}
+
+static PyObject *py_push_baseband(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"samples", "block", "timeout", NULL};
+    Py_buffer view;
+    int block = true;
+    uint32_t timeout = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|pI", kwlist, &view, &block, &timeout)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    if (self->pkt_queue.size == 0) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_RuntimeError, "queue not initialized");
+        return NULL;
+    }
+
+    if (view.len % (2 * sizeof(float)) != 0) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "samples must be interleaved float32 IQ (complex64)");
+        return NULL;
+    }
+
+    size_t n_in = view.len / (2 * sizeof(float));
+    struct packet pkt;
+    memset(&pkt, 0, sizeof(pkt));
+    bool configured = true;
+
+    // interpolation runs without the GIL, the lock keeps set_tx_resampler out
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->tx_lock);
+    if (self->tx_bb == NULL) {
+        configured = false;
+    } else {
+        pkt.buf = malloc(2 * tx_baseband_max_output(self->tx_bb, n_in) + 1);
+        if (pkt.buf != NULL) {
+            pkt.size = 2 * tx_baseband_process(self->tx_bb, (const float *) view.buf, n_in, pkt.buf);
+        }
+    }
+    pthread_mutex_unlock(&self->tx_lock);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&view);
+
+    if (!configured) {
+        PyErr_SetString(PyExc_RuntimeError, "tx resampler not configured");
+        return NULL;
+    }
+
+    if (pkt.buf == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    // short input may not complete an output sample yet
+    tx_queued(self, pkt.size);
+    int ret = pkt.size > 0 ? queue_wait(&self->pkt_queue, &pkt, true, block, timeout) : 0;
+    if (ret <= 0) {
+        atomic_fetch_sub(&self->tx_buffered, (long long) pkt.size);
+        free(pkt.buf);
+        if (ret < 0) {
+            return NULL;
+        }
+        if (pkt.size == 0) {
+            Py_RETURN_TRUE;
+        }
+        DEBUG_OUT("tx queue full - dropping pkt\n");
+        Py_RETURN_FALSE;
+    }
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject *py_set_modulator(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"mode", "symbol_rate", "deviation", "bt", "ramp", "gain", NULL};
+    const char *mode = NULL;
+    struct mod_config config = {0};
+    config.deviation = NAN;
+    config.gain = 1.0f;
+    uint32_t ramp = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "z|dddIf", kwlist, &mode, &config.symbol_rate,
+            &config.deviation, &config.bt, &ramp, &config.gain)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    struct modulator *m = NULL;
+    if (mode != NULL) {
+        if (strcmp(mode, "ook") == 0) {
+            config.type = MOD_OOK;
+        } else if (strcmp(mode, "fsk") == 0) {
+            config.type = MOD_FSK2;
+        } else if (strcmp(mode, "4fsk") == 0) {
+            config.type = MOD_FSK4;
+        } else if (strcmp(mode, "gfsk") == 0) {
+            config.type = MOD_GFSK;
+        } else {
+            PyErr_SetString(PyExc_ValueError, "mode must be one of 'ook', 'fsk', '4fsk', 'gfsk'");
+            return NULL;
+        }
+
+        if (isnan(config.deviation)) {
+            config.deviation = config.type == MOD_OOK ? 0.0 : config.symbol_rate / 2.0;
+        }
+        config.sample_rate = self->sample_rate;
+        config.ramp = ramp;
+
+        m = malloc(sizeof(struct modulator));
+        if (m == NULL) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+
+        if (!modulator_init(m, &config)) {
+            modulator_deinit(m);
+            free(m);
+            PyErr_SetString(PyExc_ValueError, "invalid modulator parameters");
+            return NULL;
+        }
+    }
+
+    pthread_mutex_lock(&self->tx_lock);
+    struct modulator *old = self->mod;
+    self->mod = m;
+    pthread_mutex_unlock(&self->tx_lock);
+
+    if (old != NULL) {
+        modulator_deinit(old);
+        free(old);
+    }
+
+    Py_RETURN_TRUE;
+}
+
+// modulate a burst into a new packet, called without the GIL
+static bool modulate(HackrfObject *self, const uint8_t *data, size_t n_bits, struct packet *pkt, bool *configured) {
+    bool ok = false;
+
+    pthread_mutex_lock(&self->tx_lock);
+    *configured = self->mod != NULL;
+    if (*configured) {
+        pkt->size = 2 * modulator_length(self->mod, n_bits);
+        pkt->buf = malloc(pkt->size + 1);
+        if (pkt->buf != NULL) {
+            modulator_process(self->mod, data, n_bits, pkt->buf);
+            ok = true;
+        }
+    }
+    pthread_mutex_unlock(&self->tx_lock);
+
+    return ok;
+}
+
+static bool parse_bits(Py_buffer *view, unsigned long long bits, size_t *n_bits) {
+    if (bits == 0) {
+        bits = 8 * (unsigned long long) view->len;
+    }
+
+    if (bits > 8 * (unsigned long long) view->len) {
+        PyBuffer_Release(view);
+        PyErr_SetString(PyExc_ValueError, "bits exceeds data length");
+        return false;
+    }
+
+    *n_bits = (size_t) bits;
+    return true;
+}
+
+static PyObject *py_push_bits(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"data", "bits", "block", "timeout", NULL};
+    Py_buffer view;
+    unsigned long long bits = 0;
+    int block = true;
+    uint32_t timeout = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|KpI", kwlist, &view, &bits, &block, &timeout)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    size_t n_bits;
+    if (!parse_bits(&view, bits, &n_bits)) {
+        return NULL;
+    }
+
+    if (self->pkt_queue.size == 0) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_RuntimeError, "queue not initialized");
+        return NULL;
+    }
+
+    struct packet pkt;
+    memset(&pkt, 0, sizeof(pkt));
+    bool configured;
+
+    Py_BEGIN_ALLOW_THREADS
+    modulate(self, (const uint8_t *) view.buf, n_bits, &pkt, &configured);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&view);
+
+    if (!configured) {
+        PyErr_SetString(PyExc_RuntimeError, "modulator not configured");
+        return NULL;
+    }
+
+    if (pkt.buf == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    tx_queued(self, pkt.size);
+    int ret = pkt.size > 0 ? queue_wait(&self->pkt_queue, &pkt, true, block, timeout) : 0;
+    if (ret <= 0) {
+        atomic_fetch_sub(&self->tx_buffered, (long long) pkt.size);
+        free(pkt.buf);
+        if (ret < 0) {
+            return NULL;
+        }
+        if (pkt.size == 0) {
+            Py_RETURN_TRUE;
+        }
+        DEBUG_OUT("tx queue full - dropping pkt\n");
+        Py_RETURN_FALSE;
+    }
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject *py_start_tx_bits(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"data", "bits", NULL};
+    Py_buffer view;
+    unsigned long long bits = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|K", kwlist, &view, &bits)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    size_t n_bits;
+    if (!parse_bits(&view, bits, &n_bits)) {
+        return NULL;
+    }
+
+    if (!stream_stopped(self)) {
+        PyBuffer_Release(&view);
+        Py_RETURN_FALSE;
+    }
+
+    struct packet pkt;
+    memset(&pkt, 0, sizeof(pkt));
+    bool configured;
+    bool ok;
+
+    Py_BEGIN_ALLOW_THREADS
+    ok = modulate(self, (const uint8_t *) view.buf, n_bits, &pkt, &configured);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&view);
+
+    if (!configured) {
+        PyErr_SetString(PyExc_RuntimeError, "modulator not configured");
+        return NULL;
+    }
+
+    if (!ok) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    if (pkt.size == 0) {
+        free(pkt.buf);
+        PyErr_SetString(PyExc_ValueError, "burst has no samples");
+        return NULL;
+    }
+
+    pkt_free(self);
+    self->data_pkt = pkt;
+
+    self->busy = true;
+    self->tx_idx = 0;
+
+    rt_stream_start(self);
+    int ret = hackrf_start_tx(self->device, tx_callback, (void *) self);
+    atomic_store(&self->streaming, ret == HACKRF_SUCCESS);
+    if (ret != HACKRF_SUCCESS) {
+        self->busy = false;
+        PyErr_Format(PyExc_RuntimeError, "failed to start tx: %s (%d)", hackrf_error_name((enum hackrf_error) ret), ret);
+        return NULL;
+    }
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject *py_start_rx(HackrfObject *self, PyObject *args) {
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    size_t rx_len = 0;
+    if (!PyArg_ParseTuple(args, "K", &rx_len)) {
+        PyErr_SetString(PyExc_TypeError, "invalid length");
+        Py_RETURN_NONE;
+    }
+
+    if (pkt_allocate(self, rx_len) != 0) {
+        PyErr_NoMemory();
+        Py_RETURN_NONE;
+    }
+
+    self->rx_idx = 0;
+    atomic_store(&self->rx_samples, 0);
+    agc_reset_stats(&self->agc);
+    rt_stream_start(self);
+    int ok = hackrf_start_rx(self->device, rx_callback, (void *) self);
+
+    self->busy = (ok == HACKRF_SUCCESS);
+    atomic_store(&self->streaming, ok == HACKRF_SUCCESS);
+    return PyBool_FromLong(ok);
+}
+
+static PyObject *py_start_rx_stream(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    if (self->pkt_queue.size == 0) {
+        PyErr_SetString(PyExc_RuntimeError, "queue not initialized");
+        Py_RETURN_NONE;
+    }
+
+    flush_queue(self);
+    if (!rt_prepare_memory(self, false)) {
+        return PyErr_NoMemory();
+    }
+
+    self->sweep = false;
+    atomic_store(&self->rx_samples, 0);
+    self->rx_restart = false;
+    agc_reset_stats(&self->agc);
+    hop_rewind(&self->hop);
+    if (self->squelch_enabled) {
+        squelch_reset(&self->squelch);
+    }
+    if (self->snapshot_enabled) {
+        snapshot_reset(&self->snapshot);
+    }
+    if (self->correlator_enabled) {
+        correlator_reset(&self->correlator);
+        flush_events(&self->event_queue);
+    }
+    for (int i = 0; i < MAX_DEMODS; i++) {
+        if (self->demods[i] != NULL) {
+            demod_reset(self->demods[i]);
+        }
+    }
+    rt_stream_start(self);
+    int ok = hackrf_start_rx(self->device, rx_stream_callback, (void *) self);
+    self->busy = (ok == HACKRF_SUCCESS);
+    atomic_store(&self->streaming, ok == HACKRF_SUCCESS);
+
+    return PyBool_FromLong(ok);
+}
+
+static PyObject *py_start_tx(HackrfObject *self, PyObject *args) {
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    Py_buffer view;
+    if (!PyArg_ParseTuple(args, "y*", &view)) {
+        PyErr_SetString(PyExc_TypeError, "argument must be a bytes-like object");
+        return NULL;
+    }
+
+    // the callback hands the buffer back through tx_done, make room for it
+    tx_release_done(self);
+    pkt_free(self);
+
+    // like push(), only read-only buffers are sent straight from the caller buffer
+    if (view.readonly) {
+        self->data_pkt.buf = view.buf;
+        self->data_pkt.size = view.len;
+        self->data_pkt.view = view;
+    } else {
+        if (pkt_allocate(self, view.len + 1) != 0) {
+            PyBuffer_Release(&view);
+            return PyErr_NoMemory();
+        }
+        memcpy(self->data_pkt.buf, view.buf, view.len);
+        self->data_pkt.size = view.len;
+        PyBuffer_Release(&view);
+    }
+
+    self->busy = true;
+    self->tx_idx = 0;
+
+    rt_stream_start(self);
+    int ok = hackrf_start_tx(self->device, tx_callback, (void *) self);
+    atomic_store(&self->streaming, ok == HACKRF_SUCCESS);
+    if (ok != HACKRF_SUCCESS) {
+        self->busy = false;
+        pkt_free(self);
+    }
+    return PyBool_FromLong(ok);
+}
+
+static PyObject *py_start_tx_stream(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    if (self->pkt_queue.size == 0) {
+        PyErr_SetString(PyExc_RuntimeError, "queue not initialized");
+        Py_RETURN_NONE;
+    }
+
+    flush_queue(self);
+
+    pthread_mutex_lock(&self->tx_lock);
+    if (self->tx_bb != NULL) {
+        tx_baseband_reset(self->tx_bb);
+    }
+    pthread_mutex_unlock(&self->tx_lock);
+
+    atomic_store(&self->tx_underruns, 0);
+    atomic_store(&self->tx_low_pending, false);
+
+    self->busy = true;
+    self->tx_len = 0;
+    self->tx_idx = 0;
+    self->tx_sent = false;
+
+    rt_stream_start(self);
+    int ok = hackrf_start_tx(self->device, tx_stream_callback, (void *) self);
+    atomic_store(&self->streaming, ok == HACKRF_SUCCESS);
+    if (ok != HACKRF_SUCCESS) {
+        self->busy = false;
+    }
+    return PyBool_FromLong(ok);
+}
+
+static PyObject *py_start_sweep(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"freqs_list", "chunks", "step_width", "offset", NULL};
+
+    uint16_t frequencies[MAX_SWEEP_RANGES * 2];
+    uint32_t chunks;
+    uint32_t step_width;
+    uint32_t offset;
+
+    PyObject *freqs_list;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OIII", kwlist,
+            &freqs_list, &chunks, &step_width, &offset)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        Py_RETURN_NONE;
+    }
+
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    // a step that does not fit its ring is overwritten before it can be popped as a segment
+    if (self->sweep_demux_enabled && self->sweep_demux.stream) {
+        size_t step = (size_t) chunks * SWEEP_BLOCK_SAMPLES;
+        step = step > self->sweep_demux.settle ? step - self->sweep_demux.settle : 0;
+        if (step > self->sweep_demux.capacity) {
+            PyErr_Format(PyExc_ValueError, "ring_samples must hold a sweep step of %zu samples", step);
+            return NULL;
+        }
+    }
+
+    Py_ssize_t size = PyList_Size(freqs_list);
+    if (size >= MAX_SWEEP_RANGES) {
+        PyErr_SetString(PyExc_ValueError, "number of ranges exceeds MAX_SWEEP_RANGES");
+        return NULL;
+    }
+
+    int ctr = 0;
+    for (Py_ssize_t i = 0; i < size; i++) {
+        PyObject* tuple = PyList_GetItem(freqs_list, i);
+
+        if (!PyTuple_Check(tuple) || PyTuple_Size(tuple) != 2) {
+            PyErr_SetString(PyExc_TypeError, "each element must be a tuple with two integers");
+            return NULL;
+        }
+
+        PyObject* v0 = PyTuple_GetItem(tuple, 0);
+        PyObject* v1 = PyTuple_GetItem(tuple, 1);
+
+        if (!PyLong_Check(v0) || !PyLong_Check(v1)) {
+            PyErr_SetString(PyExc_TypeError, "both elements in the tuple must be integers");
+            return NULL;
+        }
+
+        // Extract integer values
+        uint32_t freq_min = PyLong_AsLong(v0);
+        uint32_t freq_max = PyLong_AsLong(v1);
+
+        frequencies[ctr++] = freq_min;
+        frequencies[ctr++] = freq_max;
+    }
+
+    int ok = hackrf_init_sweep(
+        self->device,
         frequencies,
         size,
         chunks * BYTES_PER_BLOCK,
@@ -563,37 +2264,1055 @@ static PyObject *py_start_sweep(HackrfObject *self, PyObject *args, PyObject *kw
         offset,
         INTERLEAVED);
 
-    if (ok != HACKRF_SUCCESS) {
-        PyErr_SetString(PyExc_RuntimeError, "failed to initialize sweep");
-        Py_RETURN_FALSE;
+    if (ok != HACKRF_SUCCESS) {
+        PyErr_SetString(PyExc_RuntimeError, "failed to initialize sweep");
+        Py_RETURN_FALSE;
+    }
+
+    if (!rt_prepare_memory(self, false)) {
+        return PyErr_NoMemory();
+    }
+
+    if (self->sweep_demux_enabled) {
+        sweep_demux_reset(&self->sweep_demux, chunks);
+    }
+
+    self->sweep = true;
+    atomic_store(&self->rx_samples, 0);
+    agc_reset_stats(&self->agc);
+    rt_stream_start(self);
+    ok = hackrf_start_rx_sweep(self->device, rx_stream_callback, (void *) self);
+    self->busy = (ok == HACKRF_SUCCESS);
+    atomic_store(&self->streaming, ok == HACKRF_SUCCESS);
+    return PyBool_FromLong(ok);
+}
+
+static PyObject *py_allow_overruns(HackrfObject *self, PyObject *args) {
+    PyObject *val;
+
+    if (!PyArg_ParseTuple(args, "O", &val)) {
+        PyErr_SetString(PyExc_TypeError, "argument must be bool");
+        Py_RETURN_NONE;
+    }
+
+    self->allow_overruns = (PyObject_IsTrue(val) > 0);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *py_set_iq_correction(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"enable", "dc_alpha", "iq_alpha", NULL};
+    int enable;
+    float dc_alpha = 1e-4f;
+    float iq_alpha = 1e-5f;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "p|ff", kwlist, &enable, &dc_alpha, &iq_alpha)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        Py_RETURN_NONE;
+    }
+
+    if (dc_alpha <= 0.0f || dc_alpha >= 1.0f || iq_alpha <= 0.0f || iq_alpha >= 1.0f) {
+        PyErr_SetString(PyExc_ValueError, "alpha must be in range (0, 1)");
+        return NULL;
+    }
+
+    // output format changes with correction, don't switch mid-stream
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    self->iq_corr.dc_alpha = dc_alpha;
+    self->iq_corr.iq_alpha = iq_alpha;
+    iq_correction_reset(&self->iq_corr);
+    self->iq_corr_enabled = enable;
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject *py_freeze_iq_correction(HackrfObject *self, PyObject *args) {
+    int freeze;
+    if (!PyArg_ParseTuple(args, "p", &freeze)) {
+        PyErr_SetString(PyExc_TypeError, "argument must be bool");
+        Py_RETURN_NONE;
+    }
+
+    iq_correction_freeze(&self->iq_corr, freeze);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *py_iq_correction(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
+    struct iq_estimates e;
+    iq_correction_get(&self->iq_corr, &e);
+
+    return Py_BuildValue("{s:O,s:f,s:f,s:f,s:f,s:O}",
+            "enabled", self->iq_corr_enabled ? Py_True : Py_False,
+            "dc_i", e.dc_i,
+            "dc_q", e.dc_q,
+            "gain", e.gain,
+            "phase", e.phase,
+            "frozen", e.frozen ? Py_True : Py_False);
+}
+
+static PyObject *py_set_agc(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"enable", "target", "hysteresis", "clip_limit",
+            "lna_min", "lna_max", "vga_min", "vga_max", "holdoff", NULL};
+    int enable;
+    struct agc_config config = {
+        .target_db = -20.0f,
+        .hysteresis_db = 3.0f,
+        .clip_limit = 1e-4f,
+        .lna_min = 0,
+        .lna_max = 40,
+        .vga_min = 0,
+        .vga_max = 62,
+        .holdoff = 2,
+    };
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "p|fffIIIII", kwlist, &enable,
+            &config.target_db, &config.hysteresis_db, &config.clip_limit,
+            &config.lna_min, &config.lna_max, &config.vga_min, &config.vga_max, &config.holdoff)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        Py_RETURN_NONE;
+    }
+
+    if (!enable) {
+        agc_stop(&self->agc);
+        Py_RETURN_TRUE;
+    }
+
+    if (config.lna_min > config.lna_max || config.lna_max > 40 ||
+            config.vga_min > config.vga_max || config.vga_max > 62) {
+        PyErr_SetString(PyExc_ValueError, "invalid gain limits");
+        return NULL;
+    }
+
+    bool ok = agc_start(&self->agc, &config);
+    rt_apply_workers(self);
+
+    return PyBool_FromLong(ok);
+}
+
+static PyObject *py_set_squelch(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"enable", "threshold", "attack", "release", "pre", "post",
+            "smoothing", "max_len", NULL};
+    int enable;
+    float threshold_db = -40.0f;
+    struct squelch_config config = {
+        .smoothing = 0.05f,
+        .attack = 8,
+        .release = 512,
+        .pre = 256,
+        .post = 256,
+        .max_len = 1 << 20,
+    };
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "p|fIIIIfn", kwlist, &enable, &threshold_db,
+            &config.attack, &config.release, &config.pre, &config.post, &config.smoothing, &config.max_len)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        Py_RETURN_NONE;
+    }
+
+    if (config.attack == 0 || config.release == 0 || config.smoothing <= 0.0f || config.smoothing > 1.0f ||
+            config.max_len <= (size_t) config.pre + config.attack) {
+        PyErr_SetString(PyExc_ValueError, "invalid squelch parameters");
+        return NULL;
+    }
+
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    if (self->squelch_enabled) {
+        squelch_deinit(&self->squelch);
+        self->squelch_enabled = false;
+    }
+
+    if (enable) {
+        config.threshold = powf(10.0f, threshold_db / 10.0f);
+        if (!squelch_init(&self->squelch, &config, squelch_emit, (void *) self)) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        self->squelch_enabled = true;
+    }
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject *py_add_template(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"samples", "threshold", NULL};
+    Py_buffer view;
+    float threshold = 0.5f;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|f", kwlist, &view, &threshold)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    if (view.len == 0 || view.len % (2 * sizeof(float)) != 0 || threshold <= 0.0f || threshold > 1.0f) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "template must be non-empty complex64 data, threshold in (0, 1]");
+        return NULL;
+    }
+
+    if (!stream_stopped(self)) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_RuntimeError, "cannot add templates while streaming");
+        return NULL;
+    }
+
+    int id = correlator_add_template(&self->correlator, (const float *) view.buf,
+            view.len / (2 * sizeof(float)), threshold);
+    PyBuffer_Release(&view);
+
+    if (id < 0) {
+        PyErr_SetString(PyExc_ValueError, "too many templates or zero-energy template");
+        return NULL;
+    }
+
+    // template set changed, buffers are rebuilt by set_correlator
+    self->correlator_enabled = false;
+
+    return PyLong_FromLong(id);
+}
+
+static PyObject *py_clear_templates(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    self->correlator_enabled = false;
+    correlator_clear(&self->correlator);
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject *py_set_correlator(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"enable", "window_pre", "window_post", "fifo_len", NULL};
+    int enable;
+    Py_ssize_t pre = 0;
+    Py_ssize_t post = 0;
+    uint32_t fifo_len = 1024;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "p|nnI", kwlist, &enable, &pre, &post, &fifo_len)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        Py_RETURN_NONE;
+    }
+
+    if (pre < 0 || post < 0 || fifo_len < 2) {
+        PyErr_SetString(PyExc_ValueError, "invalid correlator parameters");
+        return NULL;
+    }
+
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    self->correlator_enabled = false;
+    flush_events(&self->event_queue);
+
+    if (!enable) {
+        Py_RETURN_TRUE;
+    }
+
+    if (self->correlator.n_templates == 0) {
+        PyErr_SetString(PyExc_RuntimeError, "no templates registered");
+        return NULL;
+    }
+
+    if (!queue_resize(&self->event_queue, fifo_len) ||
+            !correlator_prepare(&self->correlator, pre, post, correlator_emit, (void *) self)) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    atomic_store(&self->events_dropped, 0);
+    self->correlator_enabled = true;
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject *py_pop_event(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"block", "timeout", NULL};
+    int block = true;
+    uint32_t timeout = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|pI", kwlist, &block, &timeout)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        Py_RETURN_NONE;
+    }
+
+    if (self->event_queue.size == 0) {
+        PyErr_SetString(PyExc_RuntimeError, "correlator not initialized");
+        Py_RETURN_NONE;
+    }
+
+    struct correlator_event e;
+    int ret = queue_wait(&self->event_queue, &e, false, block, timeout);
+    if (ret < 0) {
+        return NULL;
+    }
+
+    if (ret == 0) {
+        Py_RETURN_NONE;
+    }
+
+    PyObject *window = Py_NewRef(Py_None);
+    if (e.window != NULL) {
+        Py_DECREF(window);
+        window = PyByteArray_FromStringAndSize((const char *) e.window, e.window_len * 2 * sizeof(float));
+        free(e.window);
+        if (window == NULL) {
+            return NULL;
+        }
+    }
+
+    return Py_BuildValue("(IKfKN)", e.template_id, (unsigned long long) e.sample_idx, e.score,
+            (unsigned long long) e.window_idx, window);
+}
+
+static struct demod *get_demod(HackrfObject *self, int id) {
+    if (id < 0 || id >= MAX_DEMODS || self->demods[id] == NULL) {
+        PyErr_SetString(PyExc_ValueError, "invalid demodulator id");
+        return NULL;
+    }
+
+    return self->demods[id];
+}
+
+static PyObject *py_add_demod(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"mode", "offset", "audio_rate", "bandwidth", "deviation", "deemphasis",
+            "fifo_len", NULL};
+    const char *mode;
+    struct demod_config config = {
+        .offset = 0.0,
+        .audio_rate = 48000.0,
+        .bandwidth = 0.0,
+        .deviation = 2500.0,
+        .deemphasis = 75e-6,
+    };
+    uint32_t fifo_len = 64;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|dddddI", kwlist, &mode, &config.offset,
+            &config.audio_rate, &config.bandwidth, &config.deviation, &config.deemphasis, &fifo_len)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    double default_bw;
+    if (strcmp(mode, "fm") == 0) {
+        config.mode = DEMOD_FM;
+        default_bw = 12500.0;
+    } else if (strcmp(mode, "am") == 0) {
+        config.mode = DEMOD_AM;
+        default_bw = 10000.0;
+    } else if (strcmp(mode, "usb") == 0) {
+        config.mode = DEMOD_USB;
+        default_bw = 3000.0;
+    } else if (strcmp(mode, "lsb") == 0) {
+        config.mode = DEMOD_LSB;
+        default_bw = 3000.0;
+    } else {
+        PyErr_SetString(PyExc_ValueError, "mode must be one of 'fm', 'am', 'usb', 'lsb'");
+        return NULL;
+    }
+
+    if (config.bandwidth <= 0.0) {
+        config.bandwidth = default_bw;
+    }
+    config.sample_rate = self->sample_rate;
+
+    if (!stream_stopped(self)) {
+        PyErr_SetString(PyExc_RuntimeError, "cannot add demodulators while streaming");
+        return NULL;
+    }
+
+    int id = 0;
+    while (id < MAX_DEMODS && self->demods[id] != NULL) {
+        id++;
+    }
+    if (id == MAX_DEMODS) {
+        PyErr_SetString(PyExc_RuntimeError, "too many demodulators");
+        return NULL;
+    }
+
+    struct demod *d = malloc(sizeof(struct demod));
+    if (d == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    if (fifo_len < 2 || !demod_init(d, &config, 16, fifo_len)) {
+        free(d);
+        PyErr_SetString(PyExc_ValueError, "invalid demodulator parameters");
+        return NULL;
+    }
+
+    self->demods[id] = d;
+    self->n_demods++;
+    rt_apply_workers(self);
+
+    return PyLong_FromLong(id);
+}
+
+static PyObject *py_remove_demod(HackrfObject *self, PyObject *args) {
+    int id;
+    if (!PyArg_ParseTuple(args, "i", &id)) {
+        PyErr_SetString(PyExc_TypeError, "argument must be int");
+        return NULL;
+    }
+
+    struct demod *d = get_demod(self, id);
+    if (d == NULL) {
+        return NULL;
+    }
+
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    self->demods[id] = NULL;
+    self->n_demods--;
+    waiters_drain(self, WAITER_AUDIO);
+    demod_deinit(d);
+    free(d);
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject *py_set_snapshot(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"enable", "length", "period", "interval_ms", NULL};
+    int enable;
+    Py_ssize_t length = 0;
+    unsigned long long period = 0;
+    double interval_ms = 0.0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "p|nKd", kwlist, &enable, &length, &period, &interval_ms)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    if (interval_ms > 0.0) {
+        period = (unsigned long long) llround(interval_ms * 1e-3 * self->sample_rate);
+    }
+
+    if (enable && (length <= 0 || period < (unsigned long long) length)) {
+        PyErr_SetString(PyExc_ValueError, "invalid snapshot parameters");
+        return NULL;
+    }
+
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    if (self->snapshot_enabled) {
+        self->snapshot_enabled = false;
+        waiters_drain(self, WAITER_SNAPSHOT);
+        snapshot_deinit(&self->snapshot);
+    }
+
+    if (enable) {
+        if (!snapshot_init(&self->snapshot, (size_t) length, period)) {
+            return PyErr_NoMemory();
+        }
+        self->snapshot_enabled = true;
+        self->snapshot_timed = interval_ms > 0.0;
+    }
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject *py_pop_snapshot(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"block", "timeout", NULL};
+    int block = true;
+    uint32_t timeout = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|pI", kwlist, &block, &timeout)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    // the slots are freed by set_snapshot, check they are still there for every slice
+    uint32_t waited = 0;
+    for (;;) {
+        object_lock(self);
+        if (!self->snapshot_enabled) {
+            object_unlock(self);
+            PyErr_SetString(PyExc_RuntimeError, "snapshots not enabled");
+            return NULL;
+        }
+        waiter_enter(self, WAITER_SNAPSHOT);
+        object_unlock(self);
+
+        uint32_t slice = WAIT_SLICE_MS;
+        if (timeout > 0 && timeout - waited < slice) {
+            slice = timeout - waited;
+        }
+
+        struct snapshot_info info;
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = snapshot_pop(&self->snapshot, &info, block, slice);
+        Py_END_ALLOW_THREADS
+
+        if (ok) {
+            PyObject *array = PyByteArray_FromStringAndSize((const char *) self->snapshot.slots[info.slot],
+                    2 * self->snapshot.length);
+            snapshot_release(&self->snapshot, info.slot);
+            waiter_leave(self, WAITER_SNAPSHOT);
+            if (array == NULL) {
+                return NULL;
+            }
+
+            return Py_BuildValue("(N{s:K,s:d})", array,
+                    "sample_index", (unsigned long long) info.sample_idx,
+                    "timestamp", info.timestamp);
+        }
+        waiter_leave(self, WAITER_SNAPSHOT);
+
+        if (!block) {
+            Py_RETURN_NONE;
+        }
+
+        if (PyErr_CheckSignals() < 0) {
+            return NULL;
+        }
+
+        waited += slice;
+        if (timeout > 0 && waited >= timeout) {
+            Py_RETURN_NONE;
+        }
+    }
+}
+
+static int parse_codec(const char *name) {
+    for (int i = 0; i < (int) (sizeof(codec_names) / sizeof(codec_names[0])); i++) {
+        if (strcmp(name, codec_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static PyObject *py_start_recording(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"path", "codec", "block_samples", "fifo_len", NULL};
+    PyObject *path;
+    const char *codec_name = "rice";
+    uint32_t block_samples = 65536;
+    uint32_t fifo_len = 64;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O&|sII", kwlist, PyUnicode_FSConverter, &path,
+            &codec_name, &block_samples, &fifo_len)) {
+        return NULL;
+    }
+
+    int codec = parse_codec(codec_name);
+    if (codec < 0 || block_samples == 0 || block_samples > IQFILE_MAX_BLOCK_SAMPLES || fifo_len < 2) {
+        Py_DECREF(path);
+        PyErr_SetString(PyExc_ValueError, "invalid recording parameters");
+        return NULL;
+    }
+
+    if (self->rec != NULL) {
+        Py_DECREF(path);
+        Py_RETURN_FALSE;
+    }
+
+    struct recorder *rec = malloc(sizeof(struct recorder));
+    if (rec == NULL) {
+        Py_DECREF(path);
+        return PyErr_NoMemory();
+    }
+
+    int ret = recorder_open(rec, PyBytes_AS_STRING(path), (enum iq_codec) codec, block_samples,
+            self->sample_rate, fifo_len);
+    if (ret != 0) {
+        free(rec);
+        if (ret == -1) {
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        } else {
+            PyErr_SetString(PyExc_ValueError, "invalid recording parameters");
+        }
+        Py_DECREF(path);
+        return NULL;
+    }
+    Py_DECREF(path);
+
+    pthread_mutex_lock(&self->rec_lock);
+    self->rec = rec;
+    pthread_mutex_unlock(&self->rec_lock);
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject *py_stop_recording(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
+    pthread_mutex_lock(&self->rec_lock);
+    struct recorder *rec = self->rec;
+    self->rec = NULL;
+    pthread_mutex_unlock(&self->rec_lock);
+
+    if (rec == NULL) {
+        Py_RETURN_NONE;
+    }
+
+    // the writer may still have a backlog to encode
+    struct recorder_summary s;
+    Py_BEGIN_ALLOW_THREADS
+    recorder_close(rec, &s);
+    Py_END_ALLOW_THREADS
+    free(rec);
+
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:O}",
+            "blocks", (unsigned long long) s.blocks,
+            "samples", (unsigned long long) s.samples,
+            "bytes", (unsigned long long) s.bytes,
+            "dropped", (unsigned long long) s.dropped,
+            "failed", s.failed ? Py_True : Py_False);
+}
+
+static PyObject *py_set_sweep_demux(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"enable", "ring_samples", "max_tunings", "settle", "stream_len", NULL};
+    int enable;
+    Py_ssize_t ring_samples = 65536;
+    int max_tunings = 128;
+    Py_ssize_t settle = 0;
+    Py_ssize_t stream_len = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "p|ninn", kwlist, &enable, &ring_samples, &max_tunings,
+            &settle, &stream_len)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    if (enable && (ring_samples < SWEEP_BLOCK_SAMPLES || max_tunings <= 0 || settle < 0 || stream_len < 0)) {
+        PyErr_SetString(PyExc_ValueError, "invalid sweep demux parameters");
+        return NULL;
+    }
+
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    if (self->sweep_demux_enabled) {
+        self->sweep_demux_enabled = false;
+        waiters_drain(self, WAITER_SWEEP);
+        sweep_demux_deinit(&self->sweep_demux);
+    }
+
+    if (enable) {
+        if (!sweep_demux_init(&self->sweep_demux, (size_t) ring_samples, max_tunings, (size_t) settle,
+                (size_t) stream_len)) {
+            return PyErr_NoMemory();
+        }
+        self->sweep_demux_enabled = true;
+    }
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject *py_pop_sweep(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"freq", "max_samples", "block", "timeout", NULL};
+    unsigned long long freq;
+    Py_ssize_t max_samples = 0;
+    int block = true;
+    uint32_t timeout = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "K|npI", kwlist, &freq, &max_samples, &block, &timeout)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    // the rings are freed by set_sweep_demux, check they are still there for every slice
+    uint32_t waited = 0;
+    for (;;) {
+        object_lock(self);
+        if (!self->sweep_demux_enabled) {
+            object_unlock(self);
+            PyErr_SetString(PyExc_RuntimeError, "sweep demux not enabled");
+            return NULL;
+        }
+        waiter_enter(self, WAITER_SWEEP);
+        object_unlock(self);
+
+        uint32_t slice = block ? WAIT_SLICE_MS : 0;
+        if (timeout > 0 && timeout - waited < slice) {
+            slice = timeout - waited;
+        }
+
+        size_t n;
+        Py_BEGIN_ALLOW_THREADS
+        n = sweep_demux_wait(&self->sweep_demux, freq, slice);
+        Py_END_ALLOW_THREADS
+
+        if (n > 0) {
+            if (max_samples > 0 && n > (size_t) max_samples) {
+                n = (size_t) max_samples;
+            }
+
+            // more samples may arrive meanwhile, never fewer
+            PyObject *array = PyByteArray_FromStringAndSize(NULL, (Py_ssize_t) (2 * n));
+            if (array != NULL) {
+                sweep_demux_read(&self->sweep_demux, freq, (int8_t *) PyByteArray_AS_STRING(array), n);
+            }
+            waiter_leave(self, WAITER_SWEEP);
+            return array;
+        }
+        waiter_leave(self, WAITER_SWEEP);
+
+        if (!block) {
+            Py_RETURN_NONE;
+        }
+
+        if (PyErr_CheckSignals() < 0) {
+            return NULL;
+        }
+
+        waited += slice;
+        if (timeout > 0 && waited >= timeout) {
+            Py_RETURN_NONE;
+        }
+    }
+}
+
+static PyObject *py_pop_sweep_stream(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"block", "timeout", NULL};
+    int block = true;
+    uint32_t timeout = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|pI", kwlist, &block, &timeout)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    uint32_t waited = 0;
+    for (;;) {
+        object_lock(self);
+        if (!self->sweep_demux_enabled || !self->sweep_demux.stream) {
+            object_unlock(self);
+            PyErr_SetString(PyExc_RuntimeError, "sweep stream not enabled");
+            return NULL;
+        }
+        waiter_enter(self, WAITER_SWEEP);
+        object_unlock(self);
+
+        uint32_t slice = WAIT_SLICE_MS;
+        if (timeout > 0 && timeout - waited < slice) {
+            slice = timeout - waited;
+        }
+
+        struct sweep_segment seg;
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = sweep_demux_pop_segment(&self->sweep_demux, &seg, block, slice);
+        Py_END_ALLOW_THREADS
+
+        if (ok) {
+            PyObject *array = PyByteArray_FromStringAndSize(NULL, (Py_ssize_t) (2 * seg.samples));
+            if (array == NULL) {
+                waiter_leave(self, WAITER_SWEEP);
+                return NULL;
+            }
+
+            // a segment overwritten before it was popped is skipped
+            if (sweep_demux_copy_segment(&self->sweep_demux, &seg, (int8_t *) PyByteArray_AS_STRING(array))) {
+                waiter_leave(self, WAITER_SWEEP);
+                return Py_BuildValue("(KKN)", (unsigned long long) seg.index, (unsigned long long) seg.freq, array);
+            }
+            waiter_leave(self, WAITER_SWEEP);
+            Py_DECREF(array);
+            continue;
+        }
+        waiter_leave(self, WAITER_SWEEP);
+
+        if (!block) {
+            Py_RETURN_NONE;
+        }
+
+        if (PyErr_CheckSignals() < 0) {
+            return NULL;
+        }
+
+        waited += slice;
+        if (timeout > 0 && waited >= timeout) {
+            Py_RETURN_NONE;
+        }
+    }
+}
+
+static PyObject *py_sweep_tunings(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
+    if (!self->sweep_demux_enabled) {
+        PyErr_SetString(PyExc_RuntimeError, "sweep demux not enabled");
+        return NULL;
+    }
+
+    int max = self->sweep_demux.max_rings;
+    uint64_t *freqs = malloc((size_t) max * sizeof(uint64_t));
+    size_t *buffered = malloc((size_t) max * sizeof(size_t));
+    if (freqs == NULL || buffered == NULL) {
+        free(freqs);
+        free(buffered);
+        return PyErr_NoMemory();
+    }
+
+    int n = sweep_demux_tunings(&self->sweep_demux, freqs, buffered);
+    PyObject *dict = PyDict_New();
+    for (int i = 0; dict != NULL && i < n; i++) {
+        PyObject *key = PyLong_FromUnsignedLongLong(freqs[i]);
+        PyObject *value = PyLong_FromSize_t(buffered[i]);
+        if (key == NULL || value == NULL || PyDict_SetItem(dict, key, value) < 0) {
+            Py_CLEAR(dict);
+        }
+        Py_XDECREF(key);
+        Py_XDECREF(value);
+    }
+    free(freqs);
+    free(buffered);
+
+    return dict;
+}
+
+static PyObject *py_set_spill(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"enable", "path", "size", "fifo_len", NULL};
+    int enable;
+    PyObject *path = NULL;
+    unsigned long long size = 256ULL << 20;
+    Py_ssize_t fifo_len = 256;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "p|O&Kn", kwlist, &enable, PyUnicode_FSConverter, &path,
+            &size, &fifo_len)) {
+        return NULL;
+    }
+
+    if (enable && (path == NULL || size == 0 || fifo_len < 2)) {
+        Py_XDECREF(path);
+        PyErr_SetString(PyExc_ValueError, "invalid spill parameters");
+        return NULL;
+    }
+
+    if (!stream_stopped(self)) {
+        Py_XDECREF(path);
+        Py_RETURN_FALSE;
+    }
+
+    if (self->spill_enabled) {
+        self->spill_enabled = false;
+        waiters_drain(self, WAITER_SPILL);
+        spill_deinit(&self->spill);
+    }
+
+    if (enable) {
+        int ret;
+        Py_BEGIN_ALLOW_THREADS
+        ret = spill_init(&self->spill, PyBytes_AS_STRING(path), (size_t) size, sizeof(struct packet),
+                (size_t) fifo_len, spill_free, self);
+        Py_END_ALLOW_THREADS
+
+        if (ret != 0) {
+            if (ret == -1) {
+                PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+            } else {
+                PyErr_SetString(PyExc_ValueError, "invalid spill parameters");
+            }
+            Py_DECREF(path);
+            return NULL;
+        }
+        self->spill_enabled = true;
+    }
+    Py_XDECREF(path);
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject *py_pop_audio(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"id", "block", "timeout", NULL};
+    int id;
+    int block = true;
+    uint32_t timeout = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|pI", kwlist, &id, &block, &timeout)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    // the demodulator can be removed by another thread, look it up again for every slice
+    struct audio_packet p;
+    uint32_t waited = 0;
+    for (;;) {
+        object_lock(self);
+        struct demod *d = get_demod(self, id);
+        if (d == NULL) {
+            object_unlock(self);
+            return NULL;
+        }
+        waiter_enter(self, WAITER_AUDIO);
+        object_unlock(self);
+
+        uint32_t slice = WAIT_SLICE_MS;
+        if (timeout > 0 && timeout - waited < slice) {
+            slice = timeout - waited;
+        }
+
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = demod_pop(d, &p, block, slice);
+        Py_END_ALLOW_THREADS
+        waiter_leave(self, WAITER_AUDIO);
+
+        if (ok) {
+            break;
+        }
+
+        if (!block) {
+            Py_RETURN_NONE;
+        }
+
+        if (PyErr_CheckSignals() < 0) {
+            return NULL;
+        }
+
+        waited += slice;
+        if (timeout > 0 && waited >= timeout) {
+            Py_RETURN_NONE;
+        }
+    }
+
+    PyObject *array = PyByteArray_FromStringAndSize((const char *) p.buf, p.samples * sizeof(float));
+    free(p.buf);
+    return array;
+}
+
+static PyObject *py_demod_info(HackrfObject *self, PyObject *args) {
+    int id;
+    if (!PyArg_ParseTuple(args, "i", &id)) {
+        PyErr_SetString(PyExc_TypeError, "argument must be int");
+        return NULL;
+    }
+
+    struct demod *d = get_demod(self, id);
+    if (d == NULL) {
+        return NULL;
     }
 
-    ok = hackrf_start_rx_sweep(self->device, rx_stream_callback, (void *) self);
-    self->busy = (ok == HACKRF_SUCCESS);
+    return Py_BuildValue("{s:d,s:d,s:n,s:K,s:K}",
+            "audio_rate", d->config.audio_rate,
+            "if_rate", d->if_rate,
+            "decimation", (Py_ssize_t) d->decimator.factor,
+            "overruns", (unsigned long long) atomic_load(&d->overruns),
+            "dropped", (unsigned long long) atomic_load(&d->dropped));
+}
+
+static PyObject *py_set_hop_schedule(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"freqs", "dwell", "settle", NULL};
+    PyObject *freqs_list;
+    unsigned long long dwell = 0;
+    unsigned long long settle = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|KK", kwlist, &freqs_list, &dwell, &settle)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    PyObject *seq = PySequence_Fast(freqs_list, "freqs must be a sequence");
+    if (seq == NULL) {
+        return NULL;
+    }
+
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    if (n == 0) {
+        Py_DECREF(seq);
+        uint64_t freq;
+        hop_stop(&self->hop, &freq);
+        atomic_store(&self->freq, freq);
+        Py_RETURN_TRUE;
+    }
+
+    if (n > 1 && dwell == 0) {
+        Py_DECREF(seq);
+        PyErr_SetString(PyExc_ValueError, "dwell must be positive");
+        return NULL;
+    }
+
+    uint64_t *freqs = malloc(n * sizeof(uint64_t));
+    if (freqs == NULL) {
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+
+    for (Py_ssize_t i = 0; i < n; i++) {
+        freqs[i] = PyLong_AsUnsignedLongLong(PySequence_Fast_GET_ITEM(seq, i));
+        if (PyErr_Occurred()) {
+            free(freqs);
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+    Py_DECREF(seq);
+
+    bool ok = hop_start(&self->hop, freqs, (size_t) n, dwell, settle);
+    free(freqs);
+    rt_apply_workers(self);
+
     return PyBool_FromLong(ok);
 }
 
-static PyObject *py_allow_overruns(HackrfObject *self, PyObject *args) {
-    PyObject *val;
+static PyObject *py_stats(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
+    struct agc_status st;
+    agc_get_status(&self->agc, &st);
+    uint64_t hops, hop_failures;
+    hop_get_counts(&self->hop, &hops, &hop_failures);
 
-    if (!PyArg_ParseTuple(args, "O", &val)) {
-        PyErr_SetString(PyExc_TypeError, "argument must be bool");
-        Py_RETURN_NONE;
+    uint64_t snapshots = 0, snapshots_dropped = 0;
+    if (self->snapshot_enabled) {
+        snapshots = atomic_load(&self->snapshot.taken);
+        snapshots_dropped = atomic_load(&self->snapshot.dropped);
     }
 
-    self->allow_overruns = (PyObject_IsTrue(val) > 0);
+    uint64_t tx_underruns = atomic_load(&self->tx_underruns);
+    uint64_t tx_leaked = atomic_load(&self->tx_leaked);
 
-    Py_RETURN_NONE;
+    uint64_t spill_packets = 0, spill_bytes = 0, spilled = 0, spill_dropped = 0;
+    if (self->spill_enabled) {
+        spill_packets = spill_depth(&self->spill);
+        spill_bytes = spill_used(&self->spill);
+        spilled = atomic_load(&self->spill.spilled);
+        spill_dropped = atomic_load(&self->spill.dropped);
+    }
+
+    uint64_t sweep_blocks = 0, sweep_dropped = 0, sweep_overwritten = 0, sweep_segments_dropped = 0;
+    if (self->sweep_demux_enabled) {
+        sweep_blocks = atomic_load(&self->sweep_demux.blocks);
+        sweep_dropped = atomic_load(&self->sweep_demux.dropped_blocks);
+        sweep_overwritten = atomic_load(&self->sweep_demux.overwritten);
+        sweep_segments_dropped = atomic_load(&self->sweep_demux.segments_dropped);
+    }
+
+    return Py_BuildValue("{s:f,s:f,s:I,s:K,s:K,s:K,s:I,s:I,s:O,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K}",
+            "power", st.last.power,
+            "power_db", st.power_db,
+            "clipped", st.last.clipped,
+            "clipped_total", (unsigned long long) st.clipped_total,
+            "transfers", (unsigned long long) st.transfers,
+            "samples", (unsigned long long) atomic_load(&self->rx_samples),
+            "lna_gain", st.lna_gain,
+            "vga_gain", st.vga_gain,
+            "agc", st.running ? Py_True : Py_False,
+            "agc_adjustments", (unsigned long long) st.adjustments,
+            "bursts", (unsigned long long) (self->squelch_enabled ? atomic_load(&self->squelch.bursts) : 0),
+            "events", (unsigned long long) (self->correlator_enabled ? atomic_load(&self->correlator.events) : 0),
+            "events_dropped", (unsigned long long) atomic_load(&self->events_dropped),
+            "hops", (unsigned long long) hops,
+            "hop_failures", (unsigned long long) hop_failures,
+            "snapshots", (unsigned long long) snapshots,
+            "snapshots_dropped", (unsigned long long) snapshots_dropped,
+            "sweep_blocks", (unsigned long long) sweep_blocks,
+            "sweep_blocks_dropped", (unsigned long long) sweep_dropped,
+            "sweep_overwritten", (unsigned long long) sweep_overwritten,
+            "sweep_steps_dropped", (unsigned long long) sweep_segments_dropped,
+            "spill_depth", (unsigned long long) spill_packets,
+            "spill_bytes", (unsigned long long) spill_bytes,
+            "spilled", (unsigned long long) spilled,
+            "spill_dropped", (unsigned long long) spill_dropped,
+            "tx_underruns", (unsigned long long) tx_underruns,
+            "tx_leaked", (unsigned long long) tx_leaked);
 }
 
 static PyObject *py_stop_transfer(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
-    self->busy = false;
-    hackrf_stop_tx(self->device); // same code used for rx
+    stream_stop(self);
 
     Py_RETURN_NONE;
 }
 
 static PyObject *py_busy(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
+    // callers polling for the end of start_tx get their buffer back here
+    tx_release_done(self);
     return Py_NewRef(self->busy ? Py_True : Py_False);
 }
 
@@ -604,14 +3323,129 @@ static PyObject *py_set_fifo_size(HackrfObject *self, PyObject *args) {
         Py_RETURN_NONE;
     }
 
-    flush_queue(&self->pkt_queue);
+    // resizing drops queued packets, nothing may add to the queues in between
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    mutex_lock_nogil(&self->tx_push_lock);
+    flush_queue(self);
+    fifo_unlock(self);
 
-    if (!queue_resize(&self->pkt_queue, q_len)) {
-        PyErr_NoMemory();
-        Py_RETURN_NONE;
+    bool ok = queue_resize(&self->pkt_queue, q_len) && queue_resize(&self->tx_done, q_len + 2);
+    pthread_mutex_unlock(&self->tx_push_lock);
+    if (!ok || !rt_prepare_memory(self, false)) {
+        return PyErr_NoMemory();
     }
 
-    Py_RETURN_NONE;
+    Py_RETURN_TRUE;
+}
+
+static PyObject *rt_status(HackrfObject *self) {
+    int callback = atomic_load(&self->rt_callback_applied);
+    struct buf_pool empty = {0};
+    struct buf_pool *pool = self->pool != NULL ? self->pool : &empty;
+    int mem = pool->mem_flags;
+    const char *huge_pages = "none";
+    if (mem & RT_HUGETLB) {
+        huge_pages = "hugetlb";
+    } else if (mem & RT_THP) {
+        huge_pages = "thp";
+    }
+
+    return Py_BuildValue("{s:O,s:O,s:i,s:O,s:O,s:O,s:O,s:s,s:n,s:n,s:K}",
+            "callback_affinity", (callback & RT_AFFINITY) ? Py_True : Py_False,
+            "callback_priority", (callback & RT_PRIORITY) ? Py_True : Py_False,
+            "worker_threads", self->rt_workers_count,
+            "worker_affinity", (self->rt_workers_applied & RT_AFFINITY) ? Py_True : Py_False,
+            "worker_priority", (self->rt_workers_applied & RT_PRIORITY) ? Py_True : Py_False,
+            "fifo_locked", self->rt_fifo_locked ? Py_True : Py_False,
+            "pool_locked", (mem & RT_LOCKED) ? Py_True : Py_False,
+            "huge_pages", huge_pages,
+            "pool_slots", (Py_ssize_t) pool->n_slots,
+            "pool_slot_size", (Py_ssize_t) pool->slot_size,
+            "pool_misses", (unsigned long long) atomic_load(&pool->misses));
+}
+
+static bool parse_cpus(PyObject *obj, struct rt_thread_config *config) {
+    CPU_ZERO(&config->cpus);
+    config->pin = false;
+    if (obj == NULL || obj == Py_None) {
+        return true;
+    }
+
+    PyObject *seq = PySequence_Fast(obj, "cpus must be a sequence of integers");
+    if (seq == NULL) {
+        return false;
+    }
+
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    for (Py_ssize_t i = 0; i < n; i++) {
+        long cpu = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+        if (cpu == -1 && PyErr_Occurred()) {
+            Py_DECREF(seq);
+            return false;
+        }
+
+        if (cpu < 0 || cpu >= CPU_SETSIZE) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_ValueError, "invalid cpu");
+            return false;
+        }
+
+        CPU_SET((int) cpu, &config->cpus);
+    }
+
+    Py_DECREF(seq);
+    config->pin = n > 0;
+    return true;
+}
+
+static PyObject *py_set_realtime(HackrfObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"callback_cpus", "worker_cpus", "priority", "lock_memory", "huge_pages", NULL};
+    PyObject *callback_cpus = NULL;
+    PyObject *worker_cpus = NULL;
+    int priority = 0;
+    int lock_memory = false;
+    int huge_pages = false;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OOipp", kwlist,
+            &callback_cpus, &worker_cpus, &priority, &lock_memory, &huge_pages)) {
+        PyErr_SetString(PyExc_TypeError, "invalid argument");
+        return NULL;
+    }
+
+    struct rt_thread_config callback, workers;
+    if (!parse_cpus(callback_cpus, &callback) || !parse_cpus(worker_cpus, &workers)) {
+        return NULL;
+    }
+
+    if (priority < 0 || priority > sched_get_priority_max(SCHED_FIFO)) {
+        PyErr_SetString(PyExc_ValueError, "invalid priority");
+        return NULL;
+    }
+
+    if (!stream_stopped(self)) {
+        Py_RETURN_FALSE;
+    }
+
+    callback.priority = priority;
+    workers.priority = priority;
+    self->rt_callback = callback;
+    self->rt_workers = workers;
+    self->rt_lock_memory = lock_memory;
+    self->rt_huge_pages = huge_pages;
+    atomic_store(&self->rt_callback_applied, 0);
+
+    rt_apply_workers(self);
+    if (!rt_prepare_memory(self, true)) {
+        return PyErr_NoMemory();
+    }
+
+    return rt_status(self);
+}
+
+static PyObject *py_realtime(HackrfObject *self, PyObject *Py_UNUSED(unused)) {
+    return rt_status(self);
 }
 
 static int py_init(HackrfObject *self, PyObject *args, PyObject *kwds) {
@@ -635,32 +3469,180 @@ static int py_init(HackrfObject *self, PyObject *args, PyObject *kwds) {
         return -1;
     }
 
-    // keep track of queues - used for cleanup
-    queue_list_size++;
-    queue_list = realloc(queue_list, queue_list_size * sizeof(struct queue *));
-    if (queue_list == NULL) {
-        PyErr_NoMemory();
+    // holds every caller buffer that can be in flight
+    if (!queue_init(&self->tx_done, sizeof(Py_buffer), q_len + 2)) {
+        PyErr_SetString(PyExc_RuntimeError, "failed to initialize queue");
+        return -1;
+    }
+    atomic_init(&self->tx_released, 0);
+    pthread_mutex_init(&self->tx_push_lock, NULL);
+    atomic_init(&self->tx_event_fd, -1);
+    atomic_init(&self->tx_buffered, 0);
+    atomic_init(&self->tx_watermark, 0);
+    atomic_init(&self->tx_low_pending, false);
+    atomic_init(&self->tx_underruns, 0);
+    atomic_init(&self->tx_leaked, 0);
+    self->tx_sent = false;
+    atomic_init(&self->tx_low_fd, -1);
+    sem_init(&self->tx_low_sem, 0, 0);
+    atomic_init(&self->tx_low_thread_running, false);
+    atomic_init(&self->tx_low_stop, false);
+    self->tx_low_callback = NULL;
+    pthread_mutex_init(&self->tx_low_lock, NULL);
+
+    // event queue is sized by set_correlator
+    if (!queue_init(&self->event_queue, sizeof(struct correlator_event), 0)) {
+        PyErr_SetString(PyExc_RuntimeError, "failed to initialize queue");
         return -1;
     }
-    queue_list[queue_list_size - 1] = &self->pkt_queue;
+    correlator_init(&self->correlator);
 
     hackrf_set_hw_sync_mode(self->device, 0);
     hackrf_enable_tx_flush(self->device, flush_callback, (void*) self);
 
+    pthread_mutex_init(&self->lock, NULL);
+    memset(self->waiters, 0, sizeof(self->waiters));
+    pthread_cond_init(&self->waiters_done, NULL);
     self->busy = false;
+    atomic_init(&self->streaming, false);
     self->allow_overruns = false;
+    self->iq_corr_enabled = false;
+    self->squelch_enabled = false;
+    self->correlator_enabled = false;
+    atomic_init(&self->events_dropped, 0);
+    memset(self->demods, 0, sizeof(self->demods));
+    self->n_demods = 0;
+    self->sample_rate = 10e6;
+    self->tx_bb = NULL;
+    self->mod = NULL;
+    pthread_mutex_init(&self->tx_lock, NULL);
+    self->sweep = false;
+    self->rx_restart = false;
     memset(&self->data_pkt, 0, sizeof(struct packet));
+    iq_correction_init(&self->iq_corr, 1e-4f, 1e-5f);
+    pthread_mutex_init(&self->radio.lock, NULL);
+    memset(self->radio.valid, 0, sizeof(self->radio.valid));
+    agc_init(&self->agc, agc_set_gain, (void *) self);
+    hop_init(&self->hop, hop_set_freq, (void *) self);
+    self->freq = 0;
+    atomic_init(&self->rx_samples, 0);
+    memset(&self->rt_callback, 0, sizeof(self->rt_callback));
+    memset(&self->rt_workers, 0, sizeof(self->rt_workers));
+    self->rt_lock_memory = false;
+    self->rt_huge_pages = false;
+    atomic_init(&self->rt_callback_pending, false);
+    atomic_init(&self->rt_callback_applied, 0);
+    self->rt_workers_applied = 0;
+    self->rt_workers_count = 0;
+    self->rt_fifo_locked = false;
+    self->pool = NULL;
+    self->pools_retired = NULL;
+    pthread_mutex_init(&self->pool_lock, NULL);
+    self->snapshot_enabled = false;
+    self->snapshot_timed = false;
+    self->rec = NULL;
+    pthread_mutex_init(&self->rec_lock, NULL);
+    self->sweep_demux_enabled = false;
+    atomic_init(&self->spill_enabled, false);
+    pthread_mutex_init(&self->spill_pop_lock, NULL);
+
+    return 0;
+}
 
+static int py_traverse(HackrfObject *self, visitproc visit, void *arg) {
+    Py_VISIT(self->tx_low_callback);
+    Py_VISIT(Py_TYPE(self));
+    return 0;
+}
+
+// breaks cycles through the watermark callback, the notifier thread then idles until dealloc
+static int py_clear(HackrfObject *self) {
+    Py_CLEAR(self->tx_low_callback);
     return 0;
 }
 
 static void py_dealloc(HackrfObject *self) {
+    PyTypeObject *type = Py_TYPE(self);
+    PyObject_GC_UnTrack(self);
+
+    // __init__ failed before anything was set up
+    if (self->device == NULL) {
+        type->tp_free((PyObject *) self);
+        Py_DECREF(type);
+        return;
+    }
+
+    agc_deinit(&self->agc);
+    hop_deinit(&self->hop);
+    pthread_mutex_destroy(&self->radio.lock);
     hackrf_close(self->device);
-    flush_queue(&self->pkt_queue);
+    if (self->squelch_enabled) {
+        squelch_deinit(&self->squelch);
+    }
+    if (self->snapshot_enabled) {
+        snapshot_deinit(&self->snapshot);
+    }
+    if (self->rec != NULL) {
+        struct recorder_summary s;
+        recorder_close(self->rec, &s);
+        free(self->rec);
+    }
+    pthread_mutex_destroy(&self->rec_lock);
+    if (self->sweep_demux_enabled) {
+        sweep_demux_deinit(&self->sweep_demux);
+    }
+    correlator_clear(&self->correlator);
+    flush_events(&self->event_queue);
+    queue_deinit(&self->event_queue);
+    for (int i = 0; i < MAX_DEMODS; i++) {
+        if (self->demods[i] != NULL) {
+            demod_deinit(self->demods[i]);
+            free(self->demods[i]);
+        }
+    }
+    flush_queue(self);
+    if (self->spill_enabled) {
+        spill_deinit(&self->spill);
+    }
+    pthread_mutex_destroy(&self->spill_pop_lock);
+    fifo_unlock(self);
     queue_deinit(&self->pkt_queue);
+    tx_release_done(self);
+    queue_deinit(&self->tx_done);
+    pthread_mutex_destroy(&self->tx_push_lock);
+    if (atomic_load(&self->tx_event_fd) >= 0) {
+        close(atomic_load(&self->tx_event_fd));
+    }
+    tx_low_stop_thread(self);
+    if (atomic_load(&self->tx_low_fd) >= 0) {
+        close(atomic_load(&self->tx_low_fd));
+    }
+    sem_destroy(&self->tx_low_sem);
+    pthread_mutex_destroy(&self->tx_low_lock);
+    pool_release(self);
+    while (self->pools_retired != NULL) {
+        struct buf_pool *pool = self->pools_retired;
+        self->pools_retired = pool->next;
+        buf_pool_deinit(pool);
+        free(pool);
+    }
+    pthread_mutex_destroy(&self->pool_lock);
+    if (self->tx_bb != NULL) {
+        tx_baseband_deinit(self->tx_bb);
+        free(self->tx_bb);
+    }
+    if (self->mod != NULL) {
+        modulator_deinit(self->mod);
+        free(self->mod);
+    }
+    pthread_mutex_destroy(&self->tx_lock);
+    iq_correction_deinit(&self->iq_corr);
     pkt_free(self);
+    pthread_cond_destroy(&self->waiters_done);
+    pthread_mutex_destroy(&self->lock);
 
-    Py_TYPE(self)->tp_free((PyObject *) self);
+    type->tp_free((PyObject *) self);
+    Py_DECREF(type);
 }
 
 static PyObject *py_device_list(PyObject *Py_UNUSED(unused)) {
@@ -679,103 +3661,649 @@ static PyObject *py_device_list(PyObject *Py_UNUSED(unused)) {
 
 static PyObject *py_bytes_per_transfer(PyObject *Py_UNUSED(unused)) {
     // 16 blocks per transfer, defined in hackrf_sweep.c
-    return PyLong_FromLong(BYTES_PER_BLOCK * 16);
+    return PyLong_FromLong(BYTES_PER_TRANSFER);
 }
 
-static void cleanup() {
-    hackrf_exit();
-}
+#define LOCKED_NOARGS(fn) \
+    static PyObject *fn##_locked(HackrfObject *self, PyObject *unused) { \
+        object_lock(self); \
+        PyObject *ret = fn(self, unused); \
+        object_unlock(self); \
+        return ret; \
+    }
 
-static void sigint_handler(int signum) {
-    DEBUG_OUT("terminating..\n");
+#define LOCKED_VARARGS(fn) \
+    static PyObject *fn##_locked(HackrfObject *self, PyObject *args) { \
+        object_lock(self); \
+        PyObject *ret = fn(self, args); \
+        object_unlock(self); \
+        return ret; \
+    }
 
-    for (int i = 0; i < queue_list_size; i++)
-        queue_terminate(queue_list[i]);
+#define LOCKED_KEYWORDS(fn) \
+    static PyObject *fn##_locked(HackrfObject *self, PyObject *args, PyObject *kwds) { \
+        object_lock(self); \
+        PyObject *ret = fn(self, args, kwds); \
+        object_unlock(self); \
+        return ret; \
+    }
 
-    if (py_sigint_handler)
-        py_sigint_handler(signum);
-}
+// queue operations are thread-safe on their own, everything else is serialized per object
+LOCKED_VARARGS(py_set_fifo_size)
+LOCKED_VARARGS(py_start_tx)
+LOCKED_VARARGS(py_start_rx)
+LOCKED_NOARGS(py_start_rx_stream)
+LOCKED_NOARGS(py_start_tx_stream)
+LOCKED_KEYWORDS(py_start_sweep)
+LOCKED_VARARGS(py_allow_overruns)
+LOCKED_KEYWORDS(py_set_iq_correction)
+LOCKED_KEYWORDS(py_set_agc)
+LOCKED_KEYWORDS(py_set_squelch)
+LOCKED_KEYWORDS(py_add_template)
+LOCKED_NOARGS(py_clear_templates)
+LOCKED_KEYWORDS(py_set_correlator)
+LOCKED_KEYWORDS(py_add_demod)
+LOCKED_VARARGS(py_remove_demod)
+LOCKED_VARARGS(py_demod_info)
+LOCKED_KEYWORDS(py_set_hop_schedule)
+LOCKED_NOARGS(py_stats)
+LOCKED_VARARGS(py_freeze_iq_correction)
+LOCKED_NOARGS(py_iq_correction)
+LOCKED_KEYWORDS(py_set_tx_resampler)
+LOCKED_KEYWORDS(py_set_modulator)
+LOCKED_KEYWORDS(py_start_tx_bits)
+LOCKED_NOARGS(py_read)
+LOCKED_VARARGS(py_set_sample_rate)
+LOCKED_VARARGS(py_set_freq)
+LOCKED_VARARGS(py_set_baseband_filter_bandwidth)
+LOCKED_KEYWORDS(py_configure)
+LOCKED_VARARGS(py_set_tx_gain)
+LOCKED_VARARGS(py_set_rx_gain)
+LOCKED_VARARGS(py_set_amp)
+LOCKED_VARARGS(py_set_antenna_enable)
+LOCKED_VARARGS(py_set_hw_sync_mode)
+LOCKED_NOARGS(py_stop_transfer)
+LOCKED_KEYWORDS(py_set_realtime)
+LOCKED_NOARGS(py_realtime)
+LOCKED_KEYWORDS(py_set_snapshot)
+LOCKED_KEYWORDS(py_start_recording)
+LOCKED_NOARGS(py_stop_recording)
+LOCKED_KEYWORDS(py_set_sweep_demux)
+LOCKED_NOARGS(py_sweep_tunings)
+LOCKED_NOARGS(py_tx_release_fd)
+LOCKED_KEYWORDS(py_set_spill)
+LOCKED_NOARGS(py_tx_watermark_fd)
 
 static PyMethodDef hackrf_methods[] = {
     {"busy", (PyCFunction) py_busy, METH_NOARGS, "check if transmission is in progress"},
-    {"set_fifo_size", (PyCFunction) py_set_fifo_size, METH_VARARGS, "set FIFO size"},
-    {"start_tx", (PyCFunction) py_start_tx, METH_VARARGS, "start transmission"},
-    {"start_rx", (PyCFunction) py_start_rx, METH_VARARGS, "start reception of fixed length"},
-    {"start_rx_stream", (PyCFunction) py_start_rx_stream, METH_NOARGS, "start rx stream"},
-    {"start_tx_stream", (PyCFunction) py_start_tx_stream, METH_NOARGS, "start tx stream"},
-    {"start_sweep", (PyCFunction) py_start_sweep, METH_VARARGS | METH_KEYWORDS,
+    {"set_fifo_size", (PyCFunction) py_set_fifo_size_locked, METH_VARARGS,
+        "set FIFO size, queued packets are dropped. Returns False while streaming"},
+    {"start_tx", (PyCFunction) py_start_tx_locked, METH_VARARGS,
+        "start transmission of a bytes-like object. Mutable buffers are copied, read-only ones such as bytes\n"
+        "are sent from the caller buffer and released once the last chunk is sent"},
+    {"start_rx", (PyCFunction) py_start_rx_locked, METH_VARARGS, "start reception of fixed length"},
+    {"start_rx_stream", (PyCFunction) py_start_rx_stream_locked, METH_NOARGS, "start rx stream"},
+    {"start_tx_stream", (PyCFunction) py_start_tx_stream_locked, METH_NOARGS, "start tx stream"},
+    {"start_sweep", (PyCFunction) py_start_sweep_locked, METH_VARARGS | METH_KEYWORDS,
         "start rx sweep.\n"
         "frequency_list - list of start-stop frequency pairs in MHz, must be less than 10\n"
-        "chunks - number of 16384 byte chunks to capture per tuning\n"
+        "chunks - number of 16384 byte chunks to capture per tuning, with a sweep stream a step must fit\n"
+        "ring_samples of set_sweep_demux\n"
         "step_width - width of each tuning step in Hz\n"
         "offset - frequency offset added to tuned frequencies. sample_rate / 2 is a good value"
     },
-    {"allow_overruns", (PyCFunction) py_allow_overruns, METH_VARARGS, "allow dropping packets"},
-    {"push", (PyCFunction) py_push, METH_VARARGS | METH_KEYWORDS, "push data to tx queue"},
-    {"pop", (PyCFunction) py_pop, METH_VARARGS | METH_KEYWORDS, "pop data from rx queue"},
-    {"read", (PyCFunction) py_read, METH_NOARGS, "read received data"},
-    {"set_sample_rate", (PyCFunction) py_set_sample_rate, METH_VARARGS, "set sample rate"},
-    {"set_freq", (PyCFunction) py_set_freq, METH_VARARGS, "set frequency"},
-    {"set_baseband_filter_bandwidth", (PyCFunction) py_set_baseband_filter_bandwidth, METH_VARARGS,
+    {"allow_overruns", (PyCFunction) py_allow_overruns_locked, METH_VARARGS, "allow dropping packets"},
+    {"set_spill", (PyCFunction) py_set_spill_locked, METH_VARARGS | METH_KEYWORDS,
+        "move rx packets that do not fit in the FIFO to a file instead of dropping them, pop() drains it in order\n"
+        "enable - enable/disable\n"
+        "path - scratch file, preallocated to size bytes and unlinked right away\n"
+        "size - file size in bytes\n"
+        "fifo_len - packets waiting for the writer thread.\n"
+        "When the spill is full the stream stops, or new packets are dropped if overruns are allowed"},
+    {"set_iq_correction", (PyCFunction) py_set_iq_correction_locked, METH_VARARGS | METH_KEYWORDS,
+        "enable DC offset removal and IQ imbalance correction on the rx stream.\n"
+        "When enabled, pop() returns interleaved float32 IQ (complex64) scaled to [-1, 1).\n"
+        "enable - bool\n"
+        "dc_alpha - per-sample coefficient of the single-pole DC tracker\n"
+        "iq_alpha - per-sample coefficient of the IQ gain/phase estimator"
+    },
+    {"set_agc", (PyCFunction) py_set_agc_locked, METH_VARARGS | METH_KEYWORDS,
+        "enable automatic rx gain control driven by per-transfer power and clipping statistics.\n"
+        "enable - bool\n"
+        "target - target mean power in dBFS\n"
+        "hysteresis - no adjustment while power is within target +- hysteresis dB\n"
+        "clip_limit - fraction of clipped I/Q values that forces a gain reduction\n"
+        "lna_min, lna_max - lna gain limits (0-40 dB, 8 dB steps)\n"
+        "vga_min, vga_max - vga gain limits (0-62 dB, 2 dB steps)\n"
+        "holdoff - number of transfers ignored after a gain change"
+    },
+    {"set_squelch", (PyCFunction) py_set_squelch_locked, METH_VARARGS | METH_KEYWORDS,
+        "queue only bursts above an energy threshold on the rx stream.\n"
+        "Each packet is one burst, pop(meta=True) reports its start sample index and length.\n"
+        "enable - bool\n"
+        "threshold - power threshold in dBFS\n"
+        "attack - samples above threshold before the squelch opens\n"
+        "release - samples below threshold before the squelch closes\n"
+        "pre, post - samples of padding kept before and after each burst\n"
+        "smoothing - coefficient of the single-pole power envelope\n"
+        "max_len - bursts longer than this number of samples are split"
+    },
+    {"add_template", (PyCFunction) py_add_template_locked, METH_VARARGS | METH_KEYWORDS,
+        "register a complex64 preamble template for the correlator, returns template id.\n"
+        "threshold - normalized correlation threshold in (0, 1]"
+    },
+    {"clear_templates", (PyCFunction) py_clear_templates_locked, METH_NOARGS, "remove all correlator templates"},
+    {"set_correlator", (PyCFunction) py_set_correlator_locked, METH_VARARGS | METH_KEYWORDS,
+        "enable matched-filter detection of registered templates on the rx stream.\n"
+        "window_pre, window_post - samples extracted before and after each match, 0 disables windows\n"
+        "fifo_len - size of the event FIFO"
+    },
+    {"pop_event", (PyCFunction) py_pop_event, METH_VARARGS | METH_KEYWORDS,
+        "pop a correlator event: (template_id, sample_index, score, window_index, window).\n"
+        "window is complex64 data or None"
+    },
+    {"add_demod", (PyCFunction) py_add_demod_locked, METH_VARARGS | METH_KEYWORDS,
+        "add a demodulator on the rx stream producing float32 audio, returns demodulator id.\n"
+        "Several demodulators run in parallel, each on its own thread.\n"
+        "mode - 'fm', 'am', 'usb' or 'lsb'\n"
+        "offset - channel offset from the tuned frequency in Hz\n"
+        "audio_rate - output sample rate in Hz\n"
+        "bandwidth - channel bandwidth in Hz, 0 selects a default for the mode\n"
+        "deviation - fm peak deviation in Hz, maps to audio amplitude 1.0\n"
+        "deemphasis - fm de-emphasis time constant in seconds, 0 disables\n"
+        "fifo_len - size of the audio FIFO"
+    },
+    {"remove_demod", (PyCFunction) py_remove_demod_locked, METH_VARARGS, "remove a demodulator"},
+    {"pop_audio", (PyCFunction) py_pop_audio, METH_VARARGS | METH_KEYWORDS,
+        "pop float32 audio of a demodulator"},
+    {"demod_info", (PyCFunction) py_demod_info_locked, METH_VARARGS,
+        "get demodulator rates and overrun counters"},
+    {"set_snapshot", (PyCFunction) py_set_snapshot_locked, METH_VARARGS | METH_KEYWORDS,
+        "capture periodic windows from the rx stream instead of queueing packets\n"
+        "enable - enable/disable\n"
+        "length - samples per snapshot\n"
+        "period - samples between snapshot starts, at least length\n"
+        "interval_ms - period in milliseconds at the current sample rate, overrides period\n"
+        "two slots are preallocated, a window is dropped while both are waiting to be popped"},
+    {"start_recording", (PyCFunction) py_start_recording_locked, METH_VARARGS | METH_KEYWORDS,
+        "write the rx stream to an indexed recording, can be called while streaming\n"
+        "path - file path, truncated if it exists\n"
+        "codec - 'rice' lossless (default), 'pack4'/'pack6' lossy with per-block scale or 'raw'\n"
+        "block_samples - samples per block, blocks also end on retunes and stream gaps\n"
+        "fifo_len - transfers queued for the writer thread before they are dropped"},
+    {"stop_recording", (PyCFunction) py_stop_recording_locked, METH_NOARGS,
+        "finish the recording and write its index, returns totals or None if not recording"},
+    {"pop_snapshot", (PyCFunction) py_pop_snapshot, METH_VARARGS | METH_KEYWORDS,
+        "pop a snapshot as (int8 IQ, {sample_index, timestamp}), timestamp of the first sample in seconds since the epoch"},
+    {"set_sweep_demux", (PyCFunction) py_set_sweep_demux_locked, METH_VARARGS | METH_KEYWORDS,
+        "split raw sweep IQ into one ring per tuning instead of queueing packets, block headers are stripped\n"
+        "enable - enable/disable\n"
+        "ring_samples - samples buffered per tuning, the oldest are overwritten\n"
+        "max_tunings - number of rings, blocks of further tunings are dropped\n"
+        "settle - samples dropped at the start of each sweep step\n"
+        "stream_len - completed steps queued for pop_sweep_stream, 0 disables the stream.\n"
+        "With the stream enabled ring_samples must hold a whole sweep step after settle"},
+    {"pop_sweep", (PyCFunction) py_pop_sweep, METH_VARARGS | METH_KEYWORDS,
+        "pop the oldest buffered int8 IQ of a tuning\n"
+        "freq - tuned frequency in Hz as reported by the sweep\n"
+        "max_samples - limit, 0 returns everything buffered"},
+    {"pop_sweep_stream", (PyCFunction) py_pop_sweep_stream, METH_VARARGS | METH_KEYWORDS,
+        "pop the next completed sweep step as (index, freq, int8 IQ), steps overwritten before they are popped are skipped"},
+    {"sweep_tunings", (PyCFunction) py_sweep_tunings_locked, METH_NOARGS,
+        "tunings seen by the sweep demux as {freq: buffered samples}"},
+    {"set_hop_schedule", (PyCFunction) py_set_hop_schedule_locked, METH_VARARGS | METH_KEYWORDS,
+        "hop through a list of frequencies against the running rx stream. An empty list stops hopping.\n"
+        "freqs - frequencies in Hz, the first one is tuned immediately\n"
+        "dwell - samples to receive at each frequency, rounded up to whole transfers\n"
+        "settle - samples to drop after each retune.\n"
+        "Stream packets are tagged with the frequency in effect and the sample index of its retune"
+    },
+    {"set_realtime", (PyCFunction) py_set_realtime_locked, METH_VARARGS | METH_KEYWORDS,
+        "place stream threads and buffers, returns realtime() or False while busy\n"
+        "callback_cpus - cpus for the usb transfer thread, applied from the first transfer of a stream\n"
+        "worker_cpus - cpus for agc, hop and demodulator threads\n"
+        "priority - SCHED_FIFO priority for both, 0 keeps the default policy\n"
+        "lock_memory - mlock the FIFO and a prefaulted rx packet pool\n"
+        "huge_pages - back the rx packet pool with huge pages (MAP_HUGETLB, else transparent)\n"
+        "queued rx packets are dropped; clearing a setting does not restore earlier thread placement"},
+    {"realtime", (PyCFunction) py_realtime_locked, METH_NOARGS,
+        "get the placement settings that took effect and rx packet pool usage"},
+    {"stats", (PyCFunction) py_stats_locked, METH_NOARGS,
+        "get rx statistics: power and clipping of the last transfer, totals and gains in effect"},
+    {"freeze_iq_correction", (PyCFunction) py_freeze_iq_correction_locked, METH_VARARGS,
+        "stop (True) or resume (False) updating IQ correction estimates"},
+    {"iq_correction", (PyCFunction) py_iq_correction_locked, METH_NOARGS,
+        "get current DC and IQ imbalance estimates"},
+    {"push", (PyCFunction) py_push, METH_VARARGS | METH_KEYWORDS,
+        "push data to tx queue\n"
+        "item - any contiguous bytes-like object\n"
+        "copy - copy the data so the buffer can be reused right away. By default only read-only buffers such as\n"
+        "bytes are sent from the caller buffer without a copy.\n"
+        "Without copy the buffer must not change until tx_released() counts it, buffers are released in push order.\n"
+        "Pushes without copy from several threads are serialized"},
+    {"tx_released", (PyCFunction) py_tx_released, METH_NOARGS,
+        "number of buffers pushed without copy that the tx stream no longer uses"},
+    {"tx_release_fd", (PyCFunction) py_tx_release_fd_locked, METH_NOARGS,
+        "eventfd that becomes readable when the tx callback releases pushed buffers, for select/poll"},
+    {"tx_buffered", (PyCFunction) py_tx_buffered, METH_NOARGS,
+        "tx samples pushed and not sent yet"},
+    {"set_tx_watermark", (PyCFunction) py_set_tx_watermark, METH_VARARGS | METH_KEYWORDS,
+        "notify when buffered tx samples drop below a level, once per crossing\n"
+        "samples - low watermark in samples, 0 disables\n"
+        "callback - called as callback(buffered_samples) from a notification thread, never from the usb thread.\n"
+        "The callback may call set_tx_watermark to change the level or replace or remove itself.\n"
+        "The eventfd from tx_watermark_fd() is signaled as well. An empty queue still ends the stream unless\n"
+        "allow_overruns is set, then zeros are sent and a queue running dry after data counts as an underrun"},
+    {"tx_watermark_fd", (PyCFunction) py_tx_watermark_fd_locked, METH_NOARGS,
+        "eventfd that becomes readable when buffered tx samples drop below the watermark, for select/poll"},
+    {"set_tx_resampler", (PyCFunction) py_set_tx_resampler_locked, METH_VARARGS | METH_KEYWORDS,
+        "configure conversion of low rate baseband pushed with push_baseband().\n"
+        "ratio - tx sample rate / baseband sample rate, may be fractional. 0 disables\n"
+        "freq_offset - shift in Hz applied after interpolation\n"
+        "gain - scale before int8 quantization, amplitude 1.0 maps to 127. Output saturates"
+    },
+    {"set_modulator", (PyCFunction) py_set_modulator_locked, METH_VARARGS | METH_KEYWORDS,
+        "configure the bit modulator used by push_bits() and start_tx_bits(). None disables.\n"
+        "mode - 'ook', 'fsk', '4fsk' or 'gfsk'\n"
+        "symbol_rate - symbols per second, at most half the sample rate\n"
+        "deviation - fsk peak deviation in Hz (default symbol_rate / 2), ook carrier offset (default 0)\n"
+        "bt - gaussian filter bandwidth-time product for fsk, 0 disables. gfsk defaults to 0.5\n"
+        "ramp - raised cosine amplitude ramp in samples: burst start/end for fsk, key edges for ook\n"
+        "gain - amplitude in range (0, 1], 1.0 maps to 127"
+    },
+    {"push_bits", (PyCFunction) py_push_bits, METH_VARARGS | METH_KEYWORDS,
+        "modulate a burst and push it to tx queue.\n"
+        "data - bytes-like, bits are sent MSB first\n"
+        "bits - number of bits to send, 0 sends all of data"
+    },
+    {"start_tx_bits", (PyCFunction) py_start_tx_bits_locked, METH_VARARGS | METH_KEYWORDS,
+        "modulate a burst and transmit it once, like start_tx().\n"
+        "Returns True once started, False while busy, raises if the burst is empty or tx fails to start"
+    },
+    {"push_baseband", (PyCFunction) py_push_baseband, METH_VARARGS | METH_KEYWORDS,
+        "interpolate float32 IQ (complex64) baseband to the tx sample rate and push it to tx queue.\n"
+        "Filter state carries over between calls, start_tx_stream() resets it"
+    },
+    {"pop", (PyCFunction) py_pop, METH_VARARGS | METH_KEYWORDS,
+        "pop data from rx queue.\n"
+        "meta - return (data, dict) with sample index, number of samples, power, clipping, gains,\n"
+        "frequency and retune index of the packet"
+    },
+    {"read", (PyCFunction) py_read_locked, METH_NOARGS, "read received data"},
+    {"set_sample_rate", (PyCFunction) py_set_sample_rate_locked, METH_VARARGS,
+        "set sample rate, raises RuntimeError while demodulators, the tx resampler, the modulator,\n"
+        "interval snapshots or a recording built for the current rate exist"},
+    {"set_freq", (PyCFunction) py_set_freq_locked, METH_VARARGS, "set frequency"},
+    {"set_baseband_filter_bandwidth", (PyCFunction) py_set_baseband_filter_bandwidth_locked, METH_VARARGS,
         "set baseband filter bandwidth in Hz.\n"
         "Possible values: 1.75, 2.5, 3.5, 5, 5.5, 6, 7, 8, 9, 10, 12, 14, 15, 20, 24, 28MHz"
     },
-    {"set_tx_gain", (PyCFunction) py_set_tx_gain, METH_VARARGS, "set tx gain"},
-    {"set_rx_gain", (PyCFunction) py_set_rx_gain, METH_VARARGS, "set rx lna and vga"},
-    {"set_amp", (PyCFunction) py_set_amp, METH_VARARGS, "set rf amp state"},
-    {"set_antenna_enable", (PyCFunction) py_set_antenna_enable, METH_VARARGS, "toggle antenna port power"},
-    {"set_hw_sync_mode", (PyCFunction) py_set_hw_sync_mode, METH_VARARGS, "toggle hardware sync"},
-    {"stop_transfer", (PyCFunction) py_stop_transfer, METH_NOARGS, "stop rx/tx"},
+    {"configure", (PyCFunction) py_configure_locked, METH_VARARGS | METH_KEYWORDS,
+        "apply several settings at once, skipping values the device already has.\n"
+        "Keywords: sample_rate, baseband_filter_bandwidth, freq, amp, lna_gain, vga_gain, tx_gain, antenna.\n"
+        "Settings are applied in that order without holding the GIL.\n"
+        "force - issue all given settings even if cached values match.\n"
+        "A sample rate change is rejected like set_sample_rate().\n"
+        "Returns a dict of seconds spent per issued setting, raises RuntimeError on failure"
+    },
+    {"set_tx_gain", (PyCFunction) py_set_tx_gain_locked, METH_VARARGS, "set tx gain"},
+    {"set_rx_gain", (PyCFunction) py_set_rx_gain_locked, METH_VARARGS, "set rx lna and vga"},
+    {"set_amp", (PyCFunction) py_set_amp_locked, METH_VARARGS, "set rf amp state"},
+    {"set_antenna_enable", (PyCFunction) py_set_antenna_enable_locked, METH_VARARGS, "toggle antenna port power"},
+    {"set_hw_sync_mode", (PyCFunction) py_set_hw_sync_mode_locked, METH_VARARGS, "toggle hardware sync"},
+    {"stop_transfer", (PyCFunction) py_stop_transfer_locked, METH_NOARGS, "stop rx/tx"},
     {NULL}
 };
 
+static int reader_init(ReaderObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"path", NULL};
+    PyObject *path;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O&", kwlist, PyUnicode_FSConverter, &path)) {
+        return -1;
+    }
+
+    if (self->lock_init) {
+        Py_DECREF(path);
+        PyErr_SetString(PyExc_RuntimeError, "reader already initialized");
+        return -1;
+    }
+
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = iq_reader_open(&self->reader, PyBytes_AS_STRING(path));
+    Py_END_ALLOW_THREADS
+
+    if (ret != 0) {
+        if (ret == -1) {
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        } else {
+            PyErr_SetString(PyExc_ValueError, "not a recording or the index is corrupt");
+        }
+        Py_DECREF(path);
+        return -1;
+    }
+    Py_DECREF(path);
+
+    pthread_mutex_init(&self->lock, NULL);
+    self->lock_init = true;
+    self->open = true;
+    return 0;
+}
+
+static void reader_dealloc(ReaderObject *self) {
+    PyTypeObject *type = Py_TYPE(self);
+
+    if (self->open) {
+        iq_reader_close(&self->reader);
+    }
+    if (self->lock_init) {
+        pthread_mutex_destroy(&self->lock);
+    }
+
+    type->tp_free((PyObject *) self);
+    Py_DECREF(type);
+}
+
+// lock the reader, fails if it is closed
+static bool reader_lock(ReaderObject *self) {
+    if (!self->lock_init) {
+        PyErr_SetString(PyExc_ValueError, "reader is closed");
+        return false;
+    }
+
+    mutex_lock_nogil(&self->lock);
+    if (!self->open) {
+        pthread_mutex_unlock(&self->lock);
+        PyErr_SetString(PyExc_ValueError, "reader is closed");
+        return false;
+    }
+    return true;
+}
+
+static void reader_unlock(ReaderObject *self) {
+    pthread_mutex_unlock(&self->lock);
+}
+
+static PyObject *reader_info(ReaderObject *self, PyObject *Py_UNUSED(unused)) {
+    if (!reader_lock(self)) {
+        return NULL;
+    }
+
+    const struct iq_reader *r = &self->reader;
+    uint64_t samples = 0;
+    for (size_t i = 0; i < r->n_blocks; i++) {
+        samples += r->index[i].samples;
+    }
+
+    const char *codec = r->header.codec <= IQ_CODEC_RICE ? codec_names[r->header.codec] : "unknown";
+    PyObject *info = Py_BuildValue("{s:d,s:s,s:I,s:n,s:K,s:O}",
+            "sample_rate", r->header.sample_rate,
+            "codec", codec,
+            "block_samples", r->header.block_samples,
+            "blocks", (Py_ssize_t) r->n_blocks,
+            "samples", (unsigned long long) samples,
+            "indexed", r->header.index_offset != 0 ? Py_True : Py_False);
+    reader_unlock(self);
+    return info;
+}
+
+static PyObject *reader_index(ReaderObject *self, PyObject *Py_UNUSED(unused)) {
+    if (!reader_lock(self)) {
+        return NULL;
+    }
+
+    const struct iq_reader *r = &self->reader;
+    PyObject *list = PyList_New((Py_ssize_t) r->n_blocks);
+    if (list == NULL) {
+        reader_unlock(self);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < r->n_blocks; i++) {
+        const struct iq_index_entry *e = &r->index[i];
+        PyObject *item = Py_BuildValue("(KdKI)", (unsigned long long) e->sample_idx, e->timestamp,
+                (unsigned long long) e->freq, e->samples);
+        if (item == NULL) {
+            reader_unlock(self);
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, (Py_ssize_t) i, item);
+    }
+
+    reader_unlock(self);
+    return list;
+}
+
+static PyObject *reader_read(ReaderObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"block", "cf32", NULL};
+    Py_ssize_t block;
+    int cf32 = false;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "n|p", kwlist, &block, &cf32)) {
+        return NULL;
+    }
+
+    if (!reader_lock(self)) {
+        return NULL;
+    }
+
+    if (block < 0 || (size_t) block >= self->reader.n_blocks) {
+        reader_unlock(self);
+        PyErr_SetString(PyExc_IndexError, "block out of range");
+        return NULL;
+    }
+
+    size_t samples = self->reader.index[block].samples;
+    PyObject *array = PyByteArray_FromStringAndSize(NULL, (Py_ssize_t) (2 * samples * (cf32 ? sizeof(float) : 1)));
+    if (array == NULL) {
+        reader_unlock(self);
+        return NULL;
+    }
+    char *out = PyByteArray_AS_STRING(array);
+
+    struct iq_block_header h;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    const uint8_t *payload = iq_reader_block(&self->reader, (size_t) block, &h);
+    ok = payload != NULL && h.samples == samples;
+    if (ok) {
+        ok = cf32 ? iq_decode_cf32(&h, payload, (float *) out) : iq_decode_int8(&h, payload, (int8_t *) out);
+    }
+    Py_END_ALLOW_THREADS
+    reader_unlock(self);
+
+    if (!ok) {
+        Py_DECREF(array);
+        PyErr_SetString(PyExc_ValueError, "corrupt block");
+        return NULL;
+    }
+
+    return Py_BuildValue("(N{s:K,s:d,s:K,s:I,s:s})", array,
+            "sample_index", (unsigned long long) h.sample_idx,
+            "timestamp", h.timestamp,
+            "freq", (unsigned long long) h.freq,
+            "samples", h.samples,
+            "codec", codec_names[h.codec]);
+}
+
+static PyObject *reader_find_time(ReaderObject *self, PyObject *args) {
+    double timestamp;
+    if (!PyArg_ParseTuple(args, "d", &timestamp) || !reader_lock(self)) {
+        return NULL;
+    }
+
+    size_t block = iq_reader_find_time(&self->reader, timestamp);
+    reader_unlock(self);
+    return PyLong_FromSize_t(block);
+}
+
+static PyObject *reader_find_sample(ReaderObject *self, PyObject *args) {
+    unsigned long long sample_idx;
+    if (!PyArg_ParseTuple(args, "K", &sample_idx) || !reader_lock(self)) {
+        return NULL;
+    }
+
+    size_t block = iq_reader_find_sample(&self->reader, sample_idx);
+    reader_unlock(self);
+    return PyLong_FromSize_t(block);
+}
+
+static PyObject *reader_close(ReaderObject *self, PyObject *Py_UNUSED(unused)) {
+    if (self->lock_init) {
+        mutex_lock_nogil(&self->lock);
+        if (self->open) {
+            self->open = false;
+            iq_reader_close(&self->reader);
+        }
+        pthread_mutex_unlock(&self->lock);
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef reader_methods[] = {
+    {"info", (PyCFunction) reader_info, METH_NOARGS,
+        "get sample rate, codec, block and sample counts; indexed is False if the index was rebuilt by scanning"},
+    {"index", (PyCFunction) reader_index, METH_NOARGS,
+        "get the block index as a list of (sample_index, timestamp, freq, samples)"},
+    {"read", (PyCFunction) reader_read, METH_VARARGS | METH_KEYWORDS,
+        "decode a block, returns (IQ, {sample_index, timestamp, freq, samples, codec})\n"
+        "block - block number\n"
+        "cf32 - return float32 IQ scaled to [-1, 1) instead of int8"},
+    {"find_time", (PyCFunction) reader_find_time, METH_VARARGS,
+        "get the last block starting at or before a wall clock time"},
+    {"find_sample", (PyCFunction) reader_find_sample, METH_VARARGS,
+        "get the last block starting at or before an rx stream index"},
+    {"close", (PyCFunction) reader_close, METH_NOARGS, "close the file"},
+    {NULL, NULL, 0, NULL}
+};
+
 static PyMethodDef module_method_table[] = {
     {"device_list", (PyCFunction) py_device_list, METH_NOARGS, "list available hackrf devices"},
     {"bytes_per_transfer", (PyCFunction) py_bytes_per_transfer, METH_NOARGS, "get number of bytes per usb transfer"},
     {NULL, NULL, 0, NULL}
 };
 
-static PyTypeObject HackrfType = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    .tp_name = "py_hackrf.hackrf",
-    .tp_doc = "hackrf object",
-    .tp_basicsize = sizeof(HackrfObject),
-    .tp_itemsize = 0,
-    .tp_flags = Py_TPFLAGS_DEFAULT,
-    .tp_new = PyType_GenericNew,
-    .tp_init = (initproc) py_init,
-    .tp_dealloc = (destructor) py_dealloc,
-    .tp_methods = hackrf_methods
+static PyType_Slot hackrf_slots[] = {
+    {Py_tp_doc, "hackrf object"},
+    {Py_tp_new, PyType_GenericNew},
+    {Py_tp_init, py_init},
+    {Py_tp_dealloc, py_dealloc},
+    {Py_tp_traverse, py_traverse},
+    {Py_tp_clear, py_clear},
+    {Py_tp_methods, hackrf_methods},
+    {0, NULL},
 };
 
-static struct PyModuleDef module = {
-    PyModuleDef_HEAD_INIT, "py_hackrf", "hackrf python library", -1, module_method_table
+static PyType_Spec hackrf_spec = {
+    .name = "py_hackrf.hackrf",
+    .basicsize = sizeof(HackrfObject),
+    .itemsize = 0,
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .slots = hackrf_slots,
 };
 
-PyMODINIT_FUNC PyInit_py_hackrf() {
-    if (PyType_Ready(&HackrfType) < 0)
-        return NULL;
+static PyType_Slot reader_slots[] = {
+    {Py_tp_doc, "reader for recordings written by hackrf.start_recording"},
+    {Py_tp_new, PyType_GenericNew},
+    {Py_tp_init, reader_init},
+    {Py_tp_dealloc, reader_dealloc},
+    {Py_tp_methods, reader_methods},
+    {0, NULL},
+};
 
-    PyObject *m = PyModule_Create(&module);
-    if (m == NULL)
-        return NULL;
+static PyType_Spec reader_spec = {
+    .name = "py_hackrf.iq_reader",
+    .basicsize = sizeof(ReaderObject),
+    .itemsize = 0,
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = reader_slots,
+};
 
-    Py_INCREF(&HackrfType);
-    if (PyModule_AddObject(m, "hackrf", (PyObject *) &HackrfType) < 0) {
-        Py_DECREF(&HackrfType);
-        Py_DECREF(m);
-        return NULL;
+static int module_exec(PyObject *m) {
+    struct module_state *st = PyModule_GetState(m);
+
+    pthread_mutex_lock(&lib_lock);
+    int ret = lib_users > 0 ? HACKRF_SUCCESS : hackrf_init();
+    if (ret == HACKRF_SUCCESS) {
+        lib_users++;
     }
+    pthread_mutex_unlock(&lib_lock);
 
-    // save python's sigint handler and set our own
-    py_sigint_handler = signal(SIGINT, sigint_handler);
-    if (signal(SIGINT, sigint_handler) == SIG_ERR)
-        return NULL;
+    if (ret != HACKRF_SUCCESS) {
+        PyErr_SetString(PyExc_RuntimeError, "failed to initialize libhackrf");
+        return -1;
+    }
+    st->lib_ref = true;
 
-    if (hackrf_init() != HACKRF_SUCCESS)
-        return NULL;
+    st->hackrf_type = (PyTypeObject *) PyType_FromModuleAndSpec(m, &hackrf_spec, NULL);
+    if (st->hackrf_type == NULL) {
+        return -1;
+    }
+
+    if (PyModule_AddObjectRef(m, "hackrf", (PyObject *) st->hackrf_type) < 0) {
+        return -1;
+    }
+
+    st->reader_type = (PyTypeObject *) PyType_FromModuleAndSpec(m, &reader_spec, NULL);
+    if (st->reader_type == NULL) {
+        return -1;
+    }
+
+    return PyModule_AddObjectRef(m, "iq_reader", (PyObject *) st->reader_type);
+}
+
+static int module_traverse(PyObject *m, visitproc visit, void *arg) {
+    struct module_state *st = PyModule_GetState(m);
+    Py_VISIT(st->hackrf_type);
+    Py_VISIT(st->reader_type);
+    return 0;
+}
+
+static int module_clear(PyObject *m) {
+    struct module_state *st = PyModule_GetState(m);
+    Py_CLEAR(st->hackrf_type);
+    Py_CLEAR(st->reader_type);
+    return 0;
+}
+
+static void module_free(void *m) {
+    struct module_state *st = PyModule_GetState((PyObject *) m);
+    module_clear((PyObject *) m);
+
+    if (st->lib_ref) {
+        st->lib_ref = false;
+        pthread_mutex_lock(&lib_lock);
+        if (--lib_users == 0) {
+            hackrf_exit();
+        }
+        pthread_mutex_unlock(&lib_lock);
+    }
+}
+
+static PyModuleDef_Slot module_slots[] = {
+    {Py_mod_exec, module_exec},
+#ifdef Py_mod_multiple_interpreters
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#ifdef Py_mod_gil
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL},
+};
 
-    atexit(cleanup);
+static struct PyModuleDef module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "py_hackrf",
+    .m_doc = "hackrf python library",
+    .m_size = sizeof(struct module_state),
+    .m_methods = module_method_table,
+    .m_slots = module_slots,
+    .m_traverse = module_traverse,
+    .m_clear = module_clear,
+    .m_free = module_free,
+};
 
-    return m;
+PyMODINIT_FUNC PyInit_py_hackrf() {
+    return PyModuleDef_Init(&module);
 }
@@ -11,6 +11,10 @@ static inline void set_timeout(struct timespec *ts, unsigned int timeout_ms) {
     clock_gettime(CLOCK_REALTIME, ts);
     ts->tv_sec += timeout_ms / 1000;
     ts->tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
 }
 
 bool queue_init(struct queue *q, size_t item_size, size_t max_items) {
@@ -27,18 +31,26 @@ bool queue_init(struct queue *q, size_t item_size, size_t max_items) {
     q->terminated = false;
     pthread_mutex_init(&q->mutex, NULL);
     pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
     return true;
 }
 
 bool queue_resize(struct queue *q, size_t max_items) {
     size_t size = max_items * q->item_size;
+
+    pthread_mutex_lock(&q->mutex);
     void *data = realloc(q->data, size);
     if (data == NULL) {
+        pthread_mutex_unlock(&q->mutex);
         return false;
     }
 
     q->data = data;
     q->size = size;
+    q->head = 0;
+    q->tail = 0;
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->mutex);
     return true;
 }
 
@@ -63,13 +75,18 @@ bool queue_push(struct queue *q, void *v, unsigned int timeout_ms) {
     pthread_mutex_lock(&q->mutex);
 
     while (next(q, q->head) == q->tail) {
+        if (q->terminated) {
+            pthread_mutex_unlock(&q->mutex);
+            return false;
+        }
+
         int ret = 0;
         if (timeout_ms > 0) {
             struct timespec ts;
             set_timeout(&ts, timeout_ms);
-            ret = pthread_cond_timedwait(&q->not_empty, &q->mutex, &ts);
+            ret = pthread_cond_timedwait(&q->not_full, &q->mutex, &ts);
         } else {
-            pthread_cond_wait(&q->not_empty, &q->mutex);
+            pthread_cond_wait(&q->not_full, &q->mutex);
         }
 
         if (q->terminated || ret != 0) {
@@ -98,6 +115,7 @@ bool queue_pop_noblock(struct queue *q, void *v) {
     memcpy(v, &q->data[q->tail], q->item_size);
     q->tail = next(q, q->tail);
 
+    pthread_cond_signal(&q->not_full);
     pthread_mutex_unlock(&q->mutex);
 
     return true;
@@ -106,6 +124,11 @@ bool queue_pop_noblock(struct queue *q, void *v) {
 bool queue_pop(struct queue *q, void *v, unsigned int timeout_ms) {
     pthread_mutex_lock(&q->mutex);
     while (q->tail == q->head) {
+        if (q->terminated) {
+            pthread_mutex_unlock(&q->mutex);
+            return false;
+        }
+
         int ret = 0;
         if (timeout_ms > 0) {
             struct timespec ts;
@@ -124,6 +147,7 @@ bool queue_pop(struct queue *q, void *v, unsigned int timeout_ms) {
     memcpy(v, &q->data[q->tail], q->item_size);
     q->tail = next(q, q->tail);
 
+    pthread_cond_signal(&q->not_full);
     pthread_mutex_unlock(&q->mutex);
 
     return true;
@@ -147,11 +171,20 @@ void queue_terminate(struct queue *q) {
     pthread_mutex_lock(&q->mutex);
     q->terminated = true;
     pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+bool queue_terminated(struct queue *q) {
+    pthread_mutex_lock(&q->mutex);
+    bool terminated = q->terminated;
     pthread_mutex_unlock(&q->mutex);
+    return terminated;
 }
 
 void queue_deinit(struct queue *q) {
     pthread_mutex_destroy(&q->mutex);
     pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
     free(q->data);
 }
@@ -14,6 +14,7 @@ struct queue {
     size_t size;
     pthread_mutex_t mutex;
     pthread_cond_t not_empty;
+    pthread_cond_t not_full;
     volatile bool terminated;
     volatile size_t head;
     volatile size_t tail;
@@ -31,11 +32,10 @@ struct queue {
 bool queue_init(struct queue *q, size_t item_size, size_t max_items);
 
 /**
- * Resize the queue
+ * Resize the queue. Queued items are discarded, flush them first if they own
+ * resources
  *
  * @param q queue
- * @param q queue
- * @param item_size item size in bytes
  * @param max_items maximum number of items in the queue
  *
  * @return false if memory allocation failed
@@ -57,6 +57,13 @@ void queue_deinit(struct queue *q);
  */
 void queue_terminate(struct queue *q);
 
+/**
+ * Check if the queue was terminated
+ *
+ * @param q queue
+ */
+bool queue_terminated(struct queue *q);
+
 /**
  * Check if the queue is full
  *
@@ -0,0 +1,243 @@
+#include "recorder.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static bool write_all(struct recorder *r, const void *buf, size_t len) {
+    const uint8_t *p = (const uint8_t *) buf;
+    while (len > 0) {
+        ssize_t n = write(r->fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            r->summary.failed = true;
+            return false;
+        }
+        p += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+static void write_block(struct recorder *r) {
+    if (r->fill == 0 || r->summary.failed) {
+        r->fill = 0;
+        return;
+    }
+
+    if (r->summary.blocks == r->index_cap) {
+        size_t n = r->index_cap ? 2 * r->index_cap : 1024;
+        struct iq_index_entry *index = realloc(r->index, n * sizeof(struct iq_index_entry));
+        if (index == NULL) {
+            r->summary.failed = true;
+            return;
+        }
+        r->index = index;
+        r->index_cap = n;
+    }
+
+    struct iq_block_header h = {
+        .sample_idx = r->block_idx,
+        .timestamp = r->block_time,
+        .freq = r->block_freq,
+    };
+    iq_encode(r->codec, r->block, r->fill, r->payload, &h);
+
+    uint8_t buf[IQFILE_BLOCK_HEADER_SIZE];
+    iq_put_block_header(buf, &h);
+    if (!write_all(r, buf, sizeof(buf)) || !write_all(r, r->payload, h.payload_len)) {
+        return;
+    }
+
+    r->index[r->summary.blocks++] = (struct iq_index_entry) {
+        .offset = r->offset,
+        .sample_idx = r->block_idx,
+        .timestamp = r->block_time,
+        .freq = r->block_freq,
+        .samples = (uint32_t) r->fill,
+    };
+    r->offset += sizeof(buf) + h.payload_len;
+    r->summary.samples += r->fill;
+    r->fill = 0;
+}
+
+static void append(struct recorder *r, const struct record_item *item) {
+    const struct shared_block *b = item->block;
+    size_t n = b->len / 2;
+    size_t k = 0;
+
+    // a block covers one contiguous stretch at one frequency
+    if (r->fill > 0 && (item->freq != r->block_freq || b->sample_idx != r->block_idx + r->fill)) {
+        write_block(r);
+    }
+
+    while (k < n) {
+        if (r->fill == 0) {
+            r->block_idx = b->sample_idx + k;
+            r->block_freq = item->freq;
+            r->block_time = item->timestamp + (double) k / r->sample_rate;
+        }
+
+        size_t len = n - k;
+        if (len > r->block_samples - r->fill) {
+            len = r->block_samples - r->fill;
+        }
+        memcpy(r->block + 2 * r->fill, b->data + 2 * k, 2 * len);
+        r->fill += len;
+        k += len;
+
+        if (r->fill == r->block_samples) {
+            write_block(r);
+        }
+    }
+}
+
+static void *recorder_thread(void *arg) {
+    struct recorder *r = (struct recorder *) arg;
+    struct record_item item;
+
+    while (queue_pop(&r->in_queue, &item, 0)) {
+        append(r, &item);
+        shared_block_release(item.block);
+    }
+
+    return NULL;
+}
+
+int recorder_open(struct recorder *r, const char *path, enum iq_codec codec, size_t block_samples,
+        double sample_rate, size_t queue_len) {
+    memset(r, 0, sizeof(*r));
+    if (codec > IQ_CODEC_RICE || block_samples == 0 || block_samples > IQFILE_MAX_BLOCK_SAMPLES ||
+            sample_rate <= 0.0 || queue_len < 2) {
+        return -2;
+    }
+
+    r->codec = codec;
+    r->block_samples = block_samples;
+    r->sample_rate = sample_rate;
+    atomic_init(&r->dropped, 0);
+
+    r->block = malloc(2 * block_samples);
+    r->payload = malloc(iq_encode_bound(block_samples));
+    if (r->block == NULL || r->payload == NULL) {
+        goto NOMEM;
+    }
+
+    if (!queue_init(&r->in_queue, sizeof(struct record_item), queue_len)) {
+        goto NOMEM;
+    }
+
+    r->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (r->fd < 0) {
+        int err = errno;
+        queue_deinit(&r->in_queue);
+        free(r->block);
+        free(r->payload);
+        errno = err;
+        return -1;
+    }
+
+    // the index offset is filled in on close
+    struct iq_file_header h = {
+        .version = IQFILE_VERSION,
+        .codec = codec,
+        .block_samples = (uint32_t) block_samples,
+        .sample_rate = sample_rate,
+    };
+    uint8_t buf[IQFILE_HEADER_SIZE];
+    iq_put_file_header(buf, &h);
+    r->offset = sizeof(buf);
+
+    if (!write_all(r, buf, sizeof(buf))) {
+        int err = errno;
+        close(r->fd);
+        queue_deinit(&r->in_queue);
+        free(r->block);
+        free(r->payload);
+        errno = err;
+        return -1;
+    }
+
+    r->running = pthread_create(&r->thread, NULL, recorder_thread, r) == 0;
+    if (!r->running) {
+        struct recorder_summary s;
+        recorder_close(r, &s);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return 0;
+
+NOMEM:
+    free(r->block);
+    free(r->payload);
+    errno = ENOMEM;
+    return -1;
+}
+
+void recorder_submit(struct recorder *r, const struct record_item *item) {
+    if (!queue_push_noblock(&r->in_queue, (void *) item)) {
+        atomic_fetch_add(&r->dropped, 1);
+        shared_block_release(item->block);
+    }
+}
+
+void recorder_close(struct recorder *r, struct recorder_summary *summary) {
+    if (r->running) {
+        queue_terminate(&r->in_queue);
+        pthread_join(r->thread, NULL);
+        r->running = false;
+    }
+
+    // the thread stops as soon as the queue is terminated, write what is left
+    struct record_item item;
+    while (queue_pop_noblock(&r->in_queue, &item)) {
+        append(r, &item);
+        shared_block_release(item.block);
+    }
+    write_block(r);
+
+    if (!r->summary.failed) {
+        size_t len = r->summary.blocks * IQFILE_INDEX_ENTRY_SIZE;
+        uint8_t *buf = malloc(len + 1);
+        if (buf != NULL) {
+            for (size_t i = 0; i < r->summary.blocks; i++) {
+                iq_put_index_entry(buf + i * IQFILE_INDEX_ENTRY_SIZE, &r->index[i]);
+            }
+
+            struct iq_file_header h = {
+                .version = IQFILE_VERSION,
+                .codec = r->codec,
+                .block_samples = (uint32_t) r->block_samples,
+                .sample_rate = r->sample_rate,
+                .index_offset = r->offset,
+                .n_blocks = r->summary.blocks,
+            };
+            uint8_t header[IQFILE_HEADER_SIZE];
+            iq_put_file_header(header, &h);
+
+            if (write_all(r, buf, len)) {
+                r->summary.failed = pwrite(r->fd, header, sizeof(header), 0) != (ssize_t) sizeof(header);
+            }
+            free(buf);
+        } else {
+            r->summary.failed = true;
+        }
+    }
+
+    if (close(r->fd) != 0) {
+        r->summary.failed = true;
+    }
+
+    r->summary.bytes = r->offset;
+    r->summary.dropped = atomic_load(&r->dropped);
+    *summary = r->summary;
+
+    queue_deinit(&r->in_queue);
+    free(r->block);
+    free(r->payload);
+    free(r->index);
+}
@@ -0,0 +1,96 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "demod.h"
+#include "iqfile.h"
+#include "queue.h"
+
+/**
+ * Transfer queued for recording
+ */
+struct record_item {
+    struct shared_block *block;
+    uint64_t freq;
+    double timestamp;       // wall clock time of the first sample
+};
+
+/**
+ * Recording totals
+ */
+struct recorder_summary {
+    uint64_t blocks;
+    uint64_t samples;
+    uint64_t bytes;
+    uint64_t dropped;       // transfers dropped because the writer fell behind
+    bool failed;            // a write failed, the file ends at the last complete block
+};
+
+/**
+ * Writes the rx stream to an iqfile from its own thread. Transfers are cut
+ * into blocks of a fixed length, a block ends early when the frequency
+ * changes or the stream index is not contiguous
+ */
+struct recorder {
+    int fd;
+    enum iq_codec codec;
+    size_t block_samples;
+    double sample_rate;
+
+    int8_t *block;
+    size_t fill;
+    uint64_t block_idx;
+    uint64_t block_freq;
+    double block_time;
+    uint8_t *payload;
+    uint64_t offset;
+
+    struct iq_index_entry *index;
+    size_t index_cap;
+    struct recorder_summary summary;
+
+    struct queue in_queue;
+    pthread_t thread;
+    bool running;
+    atomic_ullong dropped;
+};
+
+/**
+ * Create the file and start the writer thread
+ *
+ * @param r recorder
+ * @param path file path, an existing file is truncated
+ * @param codec block codec
+ * @param block_samples samples per block
+ * @param sample_rate sample rate stored in the file header
+ * @param queue_len input FIFO size in transfers
+ *
+ * @return 0 on success, -1 on an i/o error (errno is set), -2 if parameters
+ * are invalid
+ */
+int recorder_open(struct recorder *r, const char *path, enum iq_codec codec, size_t block_samples,
+        double sample_rate, size_t queue_len);
+
+/**
+ * Queue a transfer (non-blocking). The reference is released by the
+ * recorder, also when the transfer is dropped
+ *
+ * @param r recorder
+ * @param item transfer
+ */
+void recorder_submit(struct recorder *r, const struct record_item *item);
+
+/**
+ * Write queued transfers and the last partial block, append the index and
+ * close the file
+ *
+ * @param r recorder
+ * @param summary pointer to store the totals
+ */
+void recorder_close(struct recorder *r, struct recorder_summary *summary);
+
+#endif // RECORDER_H
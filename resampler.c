@@ -0,0 +1,231 @@
+#include "resampler.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESAMPLER_PHASES 64
+
+static double sinc(double x) {
+    if (fabs(x) < 1e-12) {
+        return 1.0;
+    }
+    return sin(M_PI * x) / (M_PI * x);
+}
+
+// blackman window over [-half, half]
+static double window(double t, double half) {
+    if (fabs(t) >= half) {
+        return 0.0;
+    }
+    double x = (t + half) / (2.0 * half);
+    return 0.42 - 0.5 * cos(2.0 * M_PI * x) + 0.08 * cos(4.0 * M_PI * x);
+}
+
+static bool buf_reserve(float **buf, size_t *cap, size_t n) {
+    if (n <= *cap) {
+        return true;
+    }
+
+    float *b = realloc(*buf, n * sizeof(float));
+    if (b == NULL) {
+        return false;
+    }
+
+    *buf = b;
+    *cap = n;
+    return true;
+}
+
+bool decimator_init(struct decimator *d, size_t factor, float cutoff, size_t taps_per_factor) {
+    memset(d, 0, sizeof(*d));
+    d->factor = factor;
+    d->n_taps = factor * taps_per_factor + 1;
+    d->taps = malloc(d->n_taps * sizeof(float));
+    if (d->taps == NULL) {
+        return false;
+    }
+
+    double half = (double) (d->n_taps + 1) / 2.0;
+    double center = (double) (d->n_taps - 1) / 2.0;
+    double sum = 0.0;
+    for (size_t k = 0; k < d->n_taps; k++) {
+        double t = (double) k - center;
+        double h = 2.0 * cutoff * sinc(2.0 * cutoff * t) * window(t, half);
+        d->taps[k] = (float) h;
+        sum += h;
+    }
+    for (size_t k = 0; k < d->n_taps; k++) {
+        d->taps[k] = (float) (d->taps[k] / sum);
+    }
+
+    decimator_reset(d);
+    return true;
+}
+
+void decimator_deinit(struct decimator *d) {
+    free(d->taps);
+    free(d->buf);
+    d->taps = NULL;
+    d->buf = NULL;
+}
+
+void decimator_reset(struct decimator *d) {
+    d->buf_len = 0;
+    if (buf_reserve(&d->buf, &d->buf_cap, 2 * (d->n_taps - 1))) {
+        memset(d->buf, 0, 2 * (d->n_taps - 1) * sizeof(float));
+        d->buf_len = d->n_taps - 1;
+    }
+}
+
+size_t decimator_process(struct decimator *d, const float *in, size_t n_in, float *out) {
+    if (!buf_reserve(&d->buf, &d->buf_cap, 2 * (d->buf_len + n_in))) {
+        return 0;
+    }
+
+    memcpy(d->buf + 2 * d->buf_len, in, 2 * n_in * sizeof(float));
+    d->buf_len += n_in;
+
+    const float *h = d->taps;
+    size_t n_taps = d->n_taps;
+    size_t n_out = 0;
+    size_t pos = 0;
+
+    for (; pos + n_taps <= d->buf_len; pos += d->factor) {
+        const float *x = d->buf + 2 * pos;
+        float re0 = 0.0f, im0 = 0.0f, re1 = 0.0f, im1 = 0.0f;
+        size_t k = 0;
+        for (; k + 1 < n_taps; k += 2) {
+            re0 += h[k] * x[2 * k];
+            im0 += h[k] * x[2 * k + 1];
+            re1 += h[k + 1] * x[2 * k + 2];
+            im1 += h[k + 1] * x[2 * k + 3];
+        }
+        for (; k < n_taps; k++) {
+            re0 += h[k] * x[2 * k];
+            im0 += h[k] * x[2 * k + 1];
+        }
+
+        out[2 * n_out] = re0 + re1;
+        out[2 * n_out + 1] = im0 + im1;
+        n_out++;
+    }
+
+    memmove(d->buf, d->buf + 2 * pos, 2 * (d->buf_len - pos) * sizeof(float));
+    d->buf_len -= pos;
+
+    return n_out;
+}
+
+bool resampler_init(struct resampler *r, size_t channels, double ratio, size_t n_taps) {
+    memset(r, 0, sizeof(*r));
+    r->channels = channels;
+    r->step = 1.0 / ratio;
+    r->n_phases = RESAMPLER_PHASES;
+
+    // stretch the filter when decimating so the cutoff follows the output rate
+    double scale = ratio < 1.0 ? ratio : 1.0;
+    r->n_taps = (size_t) ceil((double) n_taps / scale);
+    r->n_taps += r->n_taps & 1;
+
+    r->bank = malloc((r->n_phases + 1) * r->n_taps * sizeof(float));
+    if (r->bank == NULL) {
+        return false;
+    }
+
+    double cutoff = 0.45 * scale;
+    double half = (double) r->n_taps / 2.0;
+    for (size_t p = 0; p <= r->n_phases; p++) {
+        float *b = r->bank + p * r->n_taps;
+        double mu = (double) p / (double) r->n_phases;
+        double sum = 0.0;
+        for (size_t k = 0; k < r->n_taps; k++) {
+            double t = mu + half - 1.0 - (double) k;
+            double h = 2.0 * cutoff * sinc(2.0 * cutoff * t) * window(t, half);
+            b[k] = (float) h;
+            sum += h;
+        }
+        for (size_t k = 0; k < r->n_taps; k++) {
+            b[k] = (float) (b[k] / sum);
+        }
+    }
+
+    resampler_reset(r);
+    return true;
+}
+
+void resampler_deinit(struct resampler *r) {
+    free(r->bank);
+    free(r->buf);
+    r->bank = NULL;
+    r->buf = NULL;
+}
+
+void resampler_reset(struct resampler *r) {
+    size_t history = r->n_taps / 2 - 1;
+    r->buf_len = 0;
+    r->t = 0.0;
+    if (buf_reserve(&r->buf, &r->buf_cap, r->channels * (history + 1))) {
+        memset(r->buf, 0, r->channels * history * sizeof(float));
+        r->buf_len = history;
+        r->t = (double) history;
+    }
+}
+
+size_t resampler_max_output(const struct resampler *r, size_t n_in) {
+    return (size_t) ceil((double) n_in / r->step) + 2;
+}
+
+size_t resampler_process(struct resampler *r, const float *in, size_t n_in, float *out) {
+    size_t ch = r->channels;
+    if (!buf_reserve(&r->buf, &r->buf_cap, ch * (r->buf_len + n_in))) {
+        return 0;
+    }
+
+    memcpy(r->buf + ch * r->buf_len, in, ch * n_in * sizeof(float));
+    r->buf_len += n_in;
+
+    size_t n_taps = r->n_taps;
+    size_t half = n_taps / 2;
+    size_t n_out = 0;
+
+    while ((size_t) r->t + half < r->buf_len) {
+        size_t n = (size_t) r->t;
+        double pf = (r->t - (double) n) * (double) r->n_phases;
+        size_t p = (size_t) pf;
+        float a = (float) (pf - (double) p);
+        const float *b0 = r->bank + p * n_taps;
+        const float *b1 = b0 + n_taps;
+        const float *x = r->buf + ch * (n + 1 - half);
+
+        if (ch == 2) {
+            float re = 0.0f, im = 0.0f;
+            for (size_t k = 0; k < n_taps; k++) {
+                float h = b0[k] + a * (b1[k] - b0[k]);
+                re += h * x[2 * k];
+                im += h * x[2 * k + 1];
+            }
+            out[2 * n_out] = re;
+            out[2 * n_out + 1] = im;
+        } else {
+            float acc = 0.0f;
+            for (size_t k = 0; k < n_taps; k++) {
+                acc += (b0[k] + a * (b1[k] - b0[k])) * x[k];
+            }
+            out[n_out] = acc;
+        }
+
+        n_out++;
+        r->t += r->step;
+    }
+
+    // keep the history needed by the next output
+    size_t drop = (size_t) r->t + 1 - half;
+    if (drop > r->buf_len) {
+        drop = r->buf_len;
+    }
+    memmove(r->buf, r->buf + ch * drop, ch * (r->buf_len - drop) * sizeof(float));
+    r->buf_len -= drop;
+    r->t -= (double) drop;
+
+    return n_out;
+}
@@ -0,0 +1,121 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Integer FIR decimator for interleaved complex float32 samples. Only every
+ * factor-th output is computed
+ */
+struct decimator {
+    size_t factor;
+    size_t n_taps;
+    float *taps;
+    float *buf;         // n_taps - 1 samples of history followed by new input
+    size_t buf_len;
+    size_t buf_cap;
+};
+
+/**
+ * Arbitrary-ratio polyphase resampler for interleaved float32 samples with
+ * 1 (real) or 2 (complex) channels. Filter phases are linearly interpolated,
+ * so any ratio can be used for both interpolation and decimation
+ */
+struct resampler {
+    size_t channels;
+    double step;        // input samples per output sample
+    size_t n_phases;
+    size_t n_taps;      // taps per phase
+    float *bank;        // (n_phases + 1) * n_taps coefficients
+    float *buf;
+    size_t buf_len;
+    size_t buf_cap;
+    double t;           // position of the next output relative to buf
+};
+
+/**
+ * Initialize decimator
+ *
+ * @param d decimator
+ * @param factor decimation factor
+ * @param cutoff lowpass cutoff, normalized to the input rate (0..0.5)
+ * @param taps_per_factor filter length in multiples of the factor
+ *
+ * @return false if memory allocation failed
+ */
+bool decimator_init(struct decimator *d, size_t factor, float cutoff, size_t taps_per_factor);
+
+/**
+ * Destroy decimator
+ *
+ * @param d decimator
+ */
+void decimator_deinit(struct decimator *d);
+
+/**
+ * Reset filter history
+ *
+ * @param d decimator
+ */
+void decimator_reset(struct decimator *d);
+
+/**
+ * Decimate a block of complex samples
+ *
+ * @param d decimator
+ * @param in interleaved complex input
+ * @param n_in number of input samples
+ * @param out interleaved complex output, at least n_in / factor + 1 samples
+ *
+ * @return number of output samples, 0 if memory allocation failed
+ */
+size_t decimator_process(struct decimator *d, const float *in, size_t n_in, float *out);
+
+/**
+ * Initialize resampler
+ *
+ * @param r resampler
+ * @param channels 1 for real, 2 for interleaved complex samples
+ * @param ratio output rate / input rate
+ * @param n_taps taps per phase at ratio >= 1, scaled by 1 / ratio when decimating
+ *
+ * @return false if memory allocation failed
+ */
+bool resampler_init(struct resampler *r, size_t channels, double ratio, size_t n_taps);
+
+/**
+ * Destroy resampler
+ *
+ * @param r resampler
+ */
+void resampler_deinit(struct resampler *r);
+
+/**
+ * Reset filter history
+ *
+ * @param r resampler
+ */
+void resampler_reset(struct resampler *r);
+
+/**
+ * Upper bound of output samples produced from n_in input samples
+ *
+ * @param r resampler
+ * @param n_in number of input samples
+ */
+size_t resampler_max_output(const struct resampler *r, size_t n_in);
+
+/**
+ * Resample a block
+ *
+ * @param r resampler
+ * @param in input samples
+ * @param n_in number of input samples
+ * @param out output buffer, at least resampler_max_output(r, n_in) samples
+ *
+ * @return number of output samples, 0 if memory allocation failed
+ */
+size_t resampler_process(struct resampler *r, const float *in, size_t n_in, float *out);
+
+#endif // RESAMPLER_H
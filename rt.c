@@ -0,0 +1,141 @@
+#include "rt.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+int rt_apply_thread(pthread_t thread, const struct rt_thread_config *config) {
+    int applied = 0;
+
+    if (config->pin && pthread_setaffinity_np(thread, sizeof(cpu_set_t), &config->cpus) == 0) {
+        applied |= RT_AFFINITY;
+    }
+
+    if (config->priority > 0) {
+        struct sched_param param = {.sched_priority = config->priority};
+        if (pthread_setschedparam(thread, SCHED_FIFO, &param) == 0) {
+            applied |= RT_PRIORITY;
+        }
+    }
+
+    return applied;
+}
+
+bool rt_lock_region(const void *addr, size_t len) {
+    return addr != NULL && len > 0 && mlock(addr, len) == 0;
+}
+
+void rt_unlock_region(const void *addr, size_t len) {
+    if (addr != NULL && len > 0) {
+        munlock(addr, len);
+    }
+}
+
+static size_t round_up(size_t n, size_t align) {
+    return (n + align - 1) / align * align;
+}
+
+bool buf_pool_init(struct buf_pool *p, size_t n_slots, size_t slot_size, bool lock, bool huge_pages) {
+    memset(p, 0, sizeof(*p));
+    atomic_init(&p->misses, 0);
+    atomic_init(&p->outstanding, 0);
+
+    // keep slots cache line aligned
+    p->slot_size = round_up(slot_size, 64);
+    p->n_slots = n_slots;
+
+    size_t size = p->slot_size * n_slots;
+    void *base = MAP_FAILED;
+
+    if (huge_pages) {
+        p->map_size = round_up(size, HUGE_PAGE_SIZE);
+        base = mmap(NULL, p->map_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (base != MAP_FAILED) {
+            p->mem_flags |= RT_HUGETLB;
+        }
+    }
+
+    if (base == MAP_FAILED) {
+        p->map_size = round_up(size, (size_t) sysconf(_SC_PAGESIZE));
+        base = mmap(NULL, p->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            p->map_size = 0;
+            return false;
+        }
+
+        // advise before the pages are faulted in so they can be backed by huge pages
+        if (huge_pages && madvise(base, p->map_size, MADV_HUGEPAGE) == 0) {
+            p->mem_flags |= RT_THP;
+        }
+    }
+    p->base = base;
+
+    if (lock && mlock(p->base, p->map_size) == 0) {
+        p->mem_flags |= RT_LOCKED;
+    }
+
+    // prefault, a no-op for populated or locked mappings
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t off = 0; off < p->map_size; off += (size_t) page) {
+        ((volatile uint8_t *) p->base)[off] = 0;
+    }
+
+    // the queue holds one item less than its length
+    if (!queue_init(&p->free_slots, sizeof(void *), n_slots + 1)) {
+        munmap(p->base, p->map_size);
+        memset(p, 0, sizeof(*p));
+        return false;
+    }
+
+    for (size_t i = 0; i < n_slots; i++) {
+        void *slot = p->base + i * p->slot_size;
+        queue_push_noblock(&p->free_slots, &slot);
+    }
+
+    return true;
+}
+
+void buf_pool_deinit(struct buf_pool *p) {
+    if (p->base != NULL) {
+        munmap(p->base, p->map_size);
+        queue_deinit(&p->free_slots);
+    }
+
+    p->base = NULL;
+    p->map_size = 0;
+    p->slot_size = 0;
+    p->n_slots = 0;
+    p->mem_flags = 0;
+}
+
+void *buf_pool_get(struct buf_pool *p, size_t size) {
+    if (p->base == NULL) {
+        return NULL;
+    }
+
+    void *slot;
+    if (size > p->slot_size || !queue_pop_noblock(&p->free_slots, &slot)) {
+        atomic_fetch_add(&p->misses, 1);
+        return NULL;
+    }
+
+    atomic_fetch_add(&p->outstanding, 1);
+    return slot;
+}
+
+bool buf_pool_put(struct buf_pool *p, void *buf) {
+    uint8_t *b = (uint8_t *) buf;
+    if (p->base == NULL || b < p->base || b >= p->base + p->slot_size * p->n_slots) {
+        return false;
+    }
+
+    queue_push_noblock(&p->free_slots, &buf);
+    atomic_fetch_sub(&p->outstanding, 1);
+    return true;
+}
+
+size_t buf_pool_outstanding(struct buf_pool *p) {
+    return atomic_load(&p->outstanding);
+}
@@ -0,0 +1,128 @@
+#ifndef RT_H
+#define RT_H
+
+// cpu_set_t and pthread_setaffinity_np, include this header first
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "queue.h"
+
+// thread settings that took effect
+#define RT_AFFINITY 0x01
+#define RT_PRIORITY 0x02
+
+// memory settings that took effect
+#define RT_LOCKED   0x01
+#define RT_HUGETLB  0x02
+#define RT_THP      0x04
+
+/**
+ * Placement of a thread, priority 0 keeps the default scheduling policy
+ */
+struct rt_thread_config {
+    cpu_set_t cpus;
+    bool pin;
+    int priority;
+};
+
+/**
+ * Apply CPU affinity and SCHED_FIFO priority to a thread. Either may fail
+ * without privileges or on an invalid CPU set, the other is still applied
+ *
+ * @param thread thread
+ * @param config placement
+ *
+ * @return RT_AFFINITY and RT_PRIORITY flags for the settings that took effect
+ */
+int rt_apply_thread(pthread_t thread, const struct rt_thread_config *config);
+
+/**
+ * Lock a memory region, this also faults its pages in
+ *
+ * @param addr start of the region
+ * @param len length in bytes
+ *
+ * @return true if the region was locked
+ */
+bool rt_lock_region(const void *addr, size_t len);
+
+/**
+ * Unlock a region locked by rt_lock_region, before it is freed or resized
+ *
+ * @param addr start of the region
+ * @param len length in bytes
+ */
+void rt_unlock_region(const void *addr, size_t len);
+
+/**
+ * Pool of fixed size buffers in a single prefaulted mapping. Buffers are
+ * handed out from the rx callback and returned by the consumer, a pool that
+ * is replaced while buffers are still out must stay mapped until they are back
+ */
+struct buf_pool {
+    uint8_t *base;
+    size_t map_size;
+    size_t slot_size;
+    size_t n_slots;
+    int mem_flags;
+    struct queue free_slots;
+    atomic_ullong misses;
+    atomic_size_t outstanding;  // buffers handed out and not returned yet
+    struct buf_pool *next;      // chains replaced pools for their owner
+};
+
+/**
+ * Map and prefault the pool. Huge pages are tried with MAP_HUGETLB first,
+ * then requested from transparent huge pages
+ *
+ * @param p pool
+ * @param n_slots number of buffers
+ * @param slot_size buffer size in bytes
+ * @param lock lock the mapping in memory
+ * @param huge_pages back the mapping with huge pages
+ *
+ * @return false if the mapping could not be created
+ */
+bool buf_pool_init(struct buf_pool *p, size_t n_slots, size_t slot_size, bool lock, bool huge_pages);
+
+/**
+ * Unmap the pool. All buffers must have been returned
+ *
+ * @param p pool, may be zeroed or already destroyed
+ */
+void buf_pool_deinit(struct buf_pool *p);
+
+/**
+ * Take a buffer (non-blocking)
+ *
+ * @param p pool
+ * @param size requested size in bytes
+ *
+ * @return buffer or NULL if the pool is empty or size exceeds the slot size
+ */
+void *buf_pool_get(struct buf_pool *p, size_t size);
+
+/**
+ * Return a buffer to the pool
+ *
+ * @param p pool
+ * @param buf buffer
+ *
+ * @return false if buf does not belong to the pool
+ */
+bool buf_pool_put(struct buf_pool *p, void *buf);
+
+/**
+ * @param p pool
+ *
+ * @return number of buffers handed out and not returned yet
+ */
+size_t buf_pool_outstanding(struct buf_pool *p);
+
+#endif // RT_H
@@ -6,11 +6,11 @@ setup(
     ext_modules=[
         Extension(
             "py_hackrf",
-            ["py_hackrf.c", "queue.c"],
+            ["py_hackrf.c", "queue.c", "iq_correction.c", "agc.c", "squelch.c", "fft.c", "correlator.c", "resampler.c", "nco.c", "demod.c", "tx_baseband.c", "modulator.c", "hop.c", "rt.c", "snapshot.c", "iqfile.c", "recorder.c", "sweep_demux.c", "spill.c"],
             define_macros=[("DEBUG", "0")],
             extra_compile_args=["-O3"],
             # extra_link_args=['-fsanitize=address'],
-            libraries=["hackrf", "pthread"],
+            libraries=["hackrf", "pthread", "m"],
         )
     ],
 )
@@ -0,0 +1,145 @@
+#include "snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool snapshot_init(struct snapshot *s, size_t length, uint64_t period) {
+    memset(s, 0, sizeof(*s));
+    if (length == 0 || period < length) {
+        return false;
+    }
+
+    s->length = length;
+    s->period = period;
+
+    for (int i = 0; i < 2; i++) {
+        s->slots[i] = malloc(2 * length);
+        if (s->slots[i] == NULL) {
+            free(s->slots[0]);
+            return false;
+        }
+
+        // fault the pages in now rather than from the rx callback
+        memset(s->slots[i], 0, 2 * length);
+        atomic_init(&s->held[i], false);
+    }
+
+    // the queue holds one item less than its length
+    if (!queue_init(&s->ready, sizeof(struct snapshot_info), 3)) {
+        free(s->slots[0]);
+        free(s->slots[1]);
+        return false;
+    }
+
+    atomic_init(&s->taken, 0);
+    atomic_init(&s->dropped, 0);
+    return true;
+}
+
+void snapshot_deinit(struct snapshot *s) {
+    queue_deinit(&s->ready);
+    free(s->slots[0]);
+    free(s->slots[1]);
+    s->slots[0] = NULL;
+    s->slots[1] = NULL;
+}
+
+void snapshot_reset(struct snapshot *s) {
+    struct snapshot_info info;
+    while (queue_pop_noblock(&s->ready, &info)) {
+    }
+
+    s->next_start = 0;
+    s->filling = false;
+    s->active = 0;
+    atomic_store(&s->held[0], false);
+    atomic_store(&s->held[1], false);
+    atomic_store(&s->taken, 0);
+    atomic_store(&s->dropped, 0);
+}
+
+static bool reserve_slot(struct snapshot *s) {
+    for (int i = 0; i < 2; i++) {
+        int slot = (s->active + i) % 2;
+        if (!atomic_load(&s->held[slot])) {
+            atomic_store(&s->held[slot], true);
+            s->active = slot;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void snapshot_process(struct snapshot *s, const int8_t *buf, size_t n_samples, uint64_t base_idx,
+        double end_time, double sample_rate) {
+    uint64_t end_idx = base_idx + n_samples;
+    size_t k = 0;
+
+    while (k < n_samples) {
+        uint64_t idx = base_idx + k;
+
+        if (!s->filling) {
+            // skip windows that started in a gap of the stream
+            if (s->next_start < idx) {
+                s->next_start += (idx - s->next_start + s->period - 1) / s->period * s->period;
+            }
+            if (s->next_start >= end_idx) {
+                return;
+            }
+
+            k = (size_t) (s->next_start - base_idx);
+            idx = s->next_start;
+            s->next_start += s->period;
+
+            if (!reserve_slot(s)) {
+                atomic_fetch_add(&s->dropped, 1);
+                continue;
+            }
+
+            s->filling = true;
+            s->fill = 0;
+            s->start_idx = idx;
+            s->timestamp = end_time - (double) (end_idx - idx) / sample_rate;
+        }
+
+        if (idx != s->start_idx + s->fill) {
+            atomic_store(&s->held[s->active], false);
+            atomic_fetch_add(&s->dropped, 1);
+            s->filling = false;
+            continue;
+        }
+
+        size_t len = n_samples - k;
+        if (len > s->length - s->fill) {
+            len = s->length - s->fill;
+        }
+        memcpy(s->slots[s->active] + 2 * s->fill, buf + 2 * k, 2 * len);
+        s->fill += len;
+        k += len;
+
+        if (s->fill == s->length) {
+            struct snapshot_info info = {
+                .slot = s->active,
+                .sample_idx = s->start_idx,
+                .timestamp = s->timestamp,
+            };
+            s->filling = false;
+            s->active = (s->active + 1) % 2;
+
+            if (queue_push_noblock(&s->ready, &info)) {
+                atomic_fetch_add(&s->taken, 1);
+            } else {
+                atomic_store(&s->held[info.slot], false);
+                atomic_fetch_add(&s->dropped, 1);
+            }
+        }
+    }
+}
+
+bool snapshot_pop(struct snapshot *s, struct snapshot_info *info, bool block, unsigned int timeout_ms) {
+    return block ? queue_pop(&s->ready, info, timeout_ms) : queue_pop_noblock(&s->ready, info);
+}
+
+void snapshot_release(struct snapshot *s, int slot) {
+    atomic_store(&s->held[slot], false);
+}
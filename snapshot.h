@@ -0,0 +1,101 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "queue.h"
+
+/**
+ * Completed snapshot, the slot stays owned by the consumer until released
+ */
+struct snapshot_info {
+    int slot;
+    uint64_t sample_idx;    // rx stream index of the first sample
+    double timestamp;       // wall clock time of the first sample in seconds
+};
+
+/**
+ * Periodic capture of fixed length windows from the rx stream into two
+ * preallocated slots. The rx callback fills one slot while the consumer
+ * reads the other, a window is dropped when both are taken
+ */
+struct snapshot {
+    int8_t *slots[2];
+    size_t length;          // samples per snapshot
+    uint64_t period;        // samples between snapshot starts
+    uint64_t next_start;
+
+    bool filling;
+    int active;
+    size_t fill;
+    uint64_t start_idx;
+    double timestamp;
+
+    atomic_bool held[2];
+    struct queue ready;
+    atomic_ullong taken;
+    atomic_ullong dropped;
+};
+
+/**
+ * Allocate and prefault both slots
+ *
+ * @param s snapshot scheduler
+ * @param length samples per snapshot
+ * @param period samples between snapshot starts, at least length
+ *
+ * @return false if parameters are invalid or memory allocation failed
+ */
+bool snapshot_init(struct snapshot *s, size_t length, uint64_t period);
+
+/**
+ * Destroy snapshot scheduler
+ *
+ * @param s snapshot scheduler
+ */
+void snapshot_deinit(struct snapshot *s);
+
+/**
+ * Drop pending snapshots and schedule the first one at the start of a stream
+ *
+ * @param s snapshot scheduler
+ */
+void snapshot_reset(struct snapshot *s);
+
+/**
+ * Copy scheduled windows from a block of the rx stream. A discontinuity in
+ * the stream index aborts the snapshot in progress
+ *
+ * @param s snapshot scheduler
+ * @param buf interleaved int8 IQ samples
+ * @param n_samples number of complex samples
+ * @param base_idx stream index of the first sample
+ * @param end_time wall clock time after the last sample in seconds
+ * @param sample_rate sample rate in Hz
+ */
+void snapshot_process(struct snapshot *s, const int8_t *buf, size_t n_samples, uint64_t base_idx,
+        double end_time, double sample_rate);
+
+/**
+ * Pop a completed snapshot
+ *
+ * @param s snapshot scheduler
+ * @param info pointer to store the snapshot, its slot must be released
+ * @param block wait for data
+ * @param timeout_ms timeout in milliseconds, 0 will block forever
+ *
+ * @return true if a snapshot was popped
+ */
+bool snapshot_pop(struct snapshot *s, struct snapshot_info *info, bool block, unsigned int timeout_ms);
+
+/**
+ * Hand a slot back to the rx callback
+ *
+ * @param s snapshot scheduler
+ * @param slot slot of a popped snapshot
+ */
+void snapshot_release(struct snapshot *s, int slot);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,304 @@
+#include "spill.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define SPILL_WRAP UINT64_MAX
+#define ALIGN8(x) (((x) + 7) & ~(size_t) 7)
+
+/**
+ * Item queued for the writer, followed by the metadata
+ */
+struct spill_item {
+    void *buf;
+    size_t len;
+};
+
+static inline size_t item_size(const struct spill *s) {
+    return sizeof(struct spill_item) + s->meta_size;
+}
+
+// record: payload length, metadata and payload, each padded to 8 bytes
+static inline size_t record_size(const struct spill *s, size_t len) {
+    return sizeof(uint64_t) + ALIGN8(s->meta_size) + ALIGN8(len);
+}
+
+static void drop_item(struct spill *s, const uint8_t *item) {
+    const struct spill_item *it = (const struct spill_item *) item;
+    s->free_fn(s->free_ctx, it->buf);
+    atomic_fetch_sub(&s->depth, 1);
+}
+
+static void *spill_thread(void *arg) {
+    struct spill *s = (struct spill *) arg;
+
+    while (queue_pop(&s->in_queue, s->witem, 0)) {
+        const struct spill_item *it = (const struct spill_item *) s->witem;
+        size_t rec = record_size(s, it->len);
+        if (rec > s->capacity) {
+            atomic_fetch_add(&s->dropped, 1);
+            drop_item(s, s->witem);
+            continue;
+        }
+
+        // wait for the reader to make room, the producer keeps queueing meanwhile
+        pthread_mutex_lock(&s->mutex);
+        s->writing = true;
+        for (;;) {
+            if (s->stop) {
+                break;
+            }
+
+            if (s->used == 0) {
+                s->head = 0;
+                s->tail = 0;
+            }
+
+            size_t waste = s->head + rec > s->capacity ? s->capacity - s->head : 0;
+            if (s->used + waste + rec <= s->capacity) {
+                if (waste > 0) {
+                    uint64_t marker = SPILL_WRAP;
+                    memcpy(s->map + s->head, &marker, sizeof(marker));
+                    s->used += waste;
+                    s->head = 0;
+                }
+                break;
+            }
+
+            pthread_cond_wait(&s->space, &s->mutex);
+        }
+
+        if (s->stop) {
+            s->writing = false;
+            pthread_mutex_unlock(&s->mutex);
+            drop_item(s, s->witem);
+            continue;
+        }
+
+        size_t pos = s->head;
+        pthread_mutex_unlock(&s->mutex);
+
+        uint64_t len = it->len;
+        uint8_t *p = s->map + pos;
+        memcpy(p, &len, sizeof(len));
+        memcpy(p + sizeof(len), s->witem + sizeof(struct spill_item), s->meta_size);
+        memcpy(p + sizeof(len) + ALIGN8(s->meta_size), it->buf, it->len);
+
+        pthread_mutex_lock(&s->mutex);
+        s->head = pos + rec == s->capacity ? 0 : pos + rec;
+        s->used += rec;
+        s->records++;
+        s->writing = false;
+        pthread_cond_broadcast(&s->data);
+        pthread_cond_broadcast(&s->space);
+        pthread_mutex_unlock(&s->mutex);
+
+        s->free_fn(s->free_ctx, it->buf);
+        atomic_fetch_add(&s->spilled, 1);
+    }
+
+    return NULL;
+}
+
+int spill_init(struct spill *s, const char *path, size_t capacity, size_t meta_size, size_t queue_len,
+        spill_free_fn free_fn, void *free_ctx) {
+    memset(s, 0, sizeof(*s));
+    capacity &= ~(size_t) 7;
+    if (capacity == 0 || meta_size == 0 || queue_len < 2 || free_fn == NULL) {
+        return -2;
+    }
+
+    s->capacity = capacity;
+    s->meta_size = meta_size;
+    s->free_fn = free_fn;
+    s->free_ctx = free_ctx;
+    atomic_init(&s->depth, 0);
+    atomic_init(&s->spilled, 0);
+    atomic_init(&s->dropped, 0);
+
+    s->item = malloc(item_size(s));
+    s->witem = malloc(item_size(s));
+    if (s->item == NULL || s->witem == NULL || !queue_init(&s->in_queue, item_size(s), queue_len)) {
+        free(s->item);
+        free(s->witem);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // reserve the blocks up front so the writer never runs out of disk midway
+    s->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    int err = s->fd < 0 ? errno : posix_fallocate(s->fd, 0, (off_t) capacity);
+    if (err == 0) {
+        s->map = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+        if (s->map == MAP_FAILED) {
+            s->map = NULL;
+            err = errno;
+        }
+    }
+
+    if (s->fd >= 0) {
+        unlink(path);
+    }
+
+    if (err != 0) {
+        if (s->fd >= 0) {
+            close(s->fd);
+        }
+        queue_deinit(&s->in_queue);
+        free(s->item);
+        free(s->witem);
+        errno = err;
+        return -1;
+    }
+
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->data, NULL);
+    pthread_cond_init(&s->space, NULL);
+
+    s->running = pthread_create(&s->thread, NULL, spill_thread, s) == 0;
+    if (!s->running) {
+        spill_deinit(s);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return 0;
+}
+
+void spill_deinit(struct spill *s) {
+    pthread_mutex_lock(&s->mutex);
+    s->stop = true;
+    pthread_cond_broadcast(&s->space);
+    pthread_mutex_unlock(&s->mutex);
+
+    if (s->running) {
+        queue_terminate(&s->in_queue);
+        pthread_join(s->thread, NULL);
+        s->running = false;
+    }
+
+    while (queue_pop_noblock(&s->in_queue, s->witem)) {
+        drop_item(s, s->witem);
+    }
+
+    munmap(s->map, s->capacity);
+    close(s->fd);
+    queue_deinit(&s->in_queue);
+    pthread_mutex_destroy(&s->mutex);
+    pthread_cond_destroy(&s->data);
+    pthread_cond_destroy(&s->space);
+    free(s->item);
+    free(s->witem);
+    s->map = NULL;
+    s->item = NULL;
+    s->witem = NULL;
+}
+
+static void reset_ring(struct spill *s) {
+    atomic_fetch_sub(&s->depth, s->records);
+    s->head = 0;
+    s->tail = 0;
+    s->used = 0;
+    s->records = 0;
+    pthread_cond_broadcast(&s->space);
+}
+
+void spill_flush(struct spill *s) {
+    uint8_t *item = malloc(item_size(s));
+    if (item != NULL) {
+        while (queue_pop_noblock(&s->in_queue, item)) {
+            drop_item(s, item);
+        }
+        free(item);
+    }
+
+    // the writer may hold a record waiting for space, let it finish so its buffer is released
+    pthread_mutex_lock(&s->mutex);
+    while (s->writing) {
+        reset_ring(s);
+        pthread_cond_wait(&s->space, &s->mutex);
+    }
+    reset_ring(s);
+    pthread_mutex_unlock(&s->mutex);
+}
+
+bool spill_submit(struct spill *s, const void *meta, void *buf, size_t len) {
+    struct spill_item *it = (struct spill_item *) s->item;
+    it->buf = buf;
+    it->len = len;
+    memcpy(s->item + sizeof(struct spill_item), meta, s->meta_size);
+
+    // count first, the reader must never see a record it does not expect
+    atomic_fetch_add(&s->depth, 1);
+    if (!queue_push_noblock(&s->in_queue, s->item)) {
+        atomic_fetch_sub(&s->depth, 1);
+        atomic_fetch_add(&s->dropped, 1);
+        return false;
+    }
+
+    return true;
+}
+
+size_t spill_depth(struct spill *s) {
+    return (size_t) atomic_load(&s->depth);
+}
+
+bool spill_peek(struct spill *s, const void **meta, const void **data, size_t *len, unsigned int timeout_ms) {
+    pthread_mutex_lock(&s->mutex);
+    if (s->records == 0 && timeout_ms > 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += timeout_ms / 1000;
+        ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&s->data, &s->mutex, &ts);
+    }
+
+    if (s->records == 0) {
+        pthread_mutex_unlock(&s->mutex);
+        return false;
+    }
+
+    uint64_t hdr;
+    memcpy(&hdr, s->map + s->tail, sizeof(hdr));
+    if (hdr == SPILL_WRAP) {
+        s->used -= s->capacity - s->tail;
+        s->tail = 0;
+        memcpy(&hdr, s->map, sizeof(hdr));
+        pthread_cond_broadcast(&s->space);
+    }
+
+    const uint8_t *p = s->map + s->tail + sizeof(hdr);
+    *meta = p;
+    *data = p + ALIGN8(s->meta_size);
+    *len = (size_t) hdr;
+    s->peek_size = record_size(s, (size_t) hdr);
+    pthread_mutex_unlock(&s->mutex);
+
+    return true;
+}
+
+void spill_consume(struct spill *s) {
+    pthread_mutex_lock(&s->mutex);
+    s->tail = s->tail + s->peek_size == s->capacity ? 0 : s->tail + s->peek_size;
+    s->used -= s->peek_size;
+    s->records--;
+    pthread_cond_broadcast(&s->space);
+    pthread_mutex_unlock(&s->mutex);
+
+    atomic_fetch_sub(&s->depth, 1);
+}
+
+size_t spill_used(struct spill *s) {
+    pthread_mutex_lock(&s->mutex);
+    size_t used = s->used;
+    pthread_mutex_unlock(&s->mutex);
+    return used;
+}
@@ -0,0 +1,132 @@
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "queue.h"
+
+/**
+ * Releases a buffer handed to spill_submit once it is written
+ */
+typedef void (*spill_free_fn)(void *ctx, void *buf);
+
+/**
+ * Overflow FIFO backed by a preallocated memory mapped file. Records are
+ * written by a background thread so the producer never waits on the disk,
+ * they are read back in order. Each record is a fixed size metadata blob
+ * followed by the payload
+ */
+struct spill {
+    int fd;
+    uint8_t *map;
+    size_t capacity;        // bytes
+    size_t meta_size;
+
+    spill_free_fn free_fn;
+    void *free_ctx;
+
+    pthread_mutex_t mutex;  // guards the ring
+    pthread_cond_t data;
+    pthread_cond_t space;
+    size_t head;
+    size_t tail;
+    size_t used;            // bytes including wrap padding
+    size_t records;         // complete records in the file
+    bool writing;
+    bool stop;
+
+    struct queue in_queue;
+    uint8_t *item;          // producer scratch item
+    uint8_t *witem;         // writer scratch item
+    size_t peek_size;
+    pthread_t thread;
+    bool running;
+
+    atomic_ullong depth;    // records submitted and not consumed yet
+    atomic_ullong spilled;
+    atomic_ullong dropped;
+};
+
+/**
+ * Create and preallocate the file and start the writer thread. The file is
+ * unlinked right away, its space is returned when the spill is destroyed
+ *
+ * @param s spill
+ * @param path file path
+ * @param capacity file size in bytes
+ * @param meta_size metadata bytes per record
+ * @param queue_len records waiting for the writer before they are dropped
+ * @param free_fn releases submitted buffers
+ * @param free_ctx context of free_fn
+ *
+ * @return 0 on success, -1 on an i/o error (errno is set), -2 if parameters
+ * are invalid
+ */
+int spill_init(struct spill *s, const char *path, size_t capacity, size_t meta_size, size_t queue_len,
+        spill_free_fn free_fn, void *free_ctx);
+
+/**
+ * Stop the writer thread, drop pending records and remove the file
+ *
+ * @param s spill
+ */
+void spill_deinit(struct spill *s);
+
+/**
+ * Drop all pending records
+ *
+ * @param s spill
+ */
+void spill_flush(struct spill *s);
+
+/**
+ * Queue a record for the writer (non-blocking). The buffer is owned by the
+ * spill on success
+ *
+ * @param s spill
+ * @param meta meta_size bytes
+ * @param buf payload
+ * @param len payload length in bytes
+ *
+ * @return false if the writer queue is full
+ */
+bool spill_submit(struct spill *s, const void *meta, void *buf, size_t len);
+
+/**
+ * Number of records submitted and not consumed yet
+ *
+ * @param s spill
+ */
+size_t spill_depth(struct spill *s);
+
+/**
+ * Wait for the oldest record. Only one thread may read
+ *
+ * @param s spill
+ * @param meta pointer to the metadata, valid until spill_consume
+ * @param data pointer to the payload, valid until spill_consume
+ * @param len pointer to store the payload length
+ * @param timeout_ms timeout in milliseconds, 0 returns immediately
+ *
+ * @return false if no record is available
+ */
+bool spill_peek(struct spill *s, const void **meta, const void **data, size_t *len, unsigned int timeout_ms);
+
+/**
+ * Drop the record returned by spill_peek
+ *
+ * @param s spill
+ */
+void spill_consume(struct spill *s);
+
+/**
+ * Bytes used in the file
+ *
+ * @param s spill
+ */
+size_t spill_used(struct spill *s);
+
+#endif // SPILL_H
@@ -0,0 +1,204 @@
+#include "squelch.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_BURST_CAP 16384
+
+static bool burst_append(struct squelch *sq, const int8_t *src, size_t n_samples) {
+    size_t needed = sq->burst_len + n_samples;
+    if (needed > sq->burst_cap) {
+        size_t cap = sq->burst_cap * 2;
+        if (cap < MIN_BURST_CAP) {
+            cap = MIN_BURST_CAP;
+        }
+        if (cap > sq->config.max_len) {
+            cap = sq->config.max_len;
+        }
+        if (cap < needed) {
+            cap = needed;
+        }
+
+        int8_t *burst = realloc(sq->burst, cap * 2);
+        if (burst == NULL) {
+            return false;
+        }
+        sq->burst = burst;
+        sq->burst_cap = cap;
+    }
+
+    memcpy(sq->burst + sq->burst_len * 2, src, n_samples * 2);
+    sq->burst_len = needed;
+    return true;
+}
+
+static bool burst_emit(struct squelch *sq) {
+    int8_t *buf = sq->burst;
+    size_t len = sq->burst_len * 2;
+
+    sq->burst = NULL;
+    sq->burst_len = 0;
+    sq->burst_cap = 0;
+    atomic_fetch_add(&sq->bursts, 1);
+
+    return sq->emit(sq->ctx, buf, len, sq->burst_idx);
+}
+
+static void history_update(struct squelch *sq, const int8_t *buf, size_t n_samples) {
+    size_t cap = sq->history_cap;
+    if (cap == 0) {
+        return;
+    }
+
+    if (n_samples >= cap) {
+        memcpy(sq->history, buf + (n_samples - cap) * 2, cap * 2);
+        sq->history_len = cap;
+        return;
+    }
+
+    size_t keep = sq->history_len + n_samples > cap ? cap - n_samples : sq->history_len;
+    memmove(sq->history, sq->history + (sq->history_len - keep) * 2, keep * 2);
+    memcpy(sq->history + keep * 2, buf, n_samples * 2);
+    sq->history_len = keep + n_samples;
+}
+
+bool squelch_init(struct squelch *sq, const struct squelch_config *config, squelch_emit_fn emit, void *ctx) {
+    memset(sq, 0, sizeof(*sq));
+    sq->config = *config;
+    sq->emit = emit;
+    sq->ctx = ctx;
+
+    sq->history_cap = (size_t) config->pre + config->attack;
+    sq->history = malloc(sq->history_cap * 2 + 1);
+    if (sq->history == NULL) {
+        return false;
+    }
+
+    squelch_reset(sq);
+    return true;
+}
+
+void squelch_deinit(struct squelch *sq) {
+    free(sq->burst);
+    free(sq->history);
+    sq->burst = NULL;
+    sq->history = NULL;
+}
+
+void squelch_reset(struct squelch *sq) {
+    sq->state = SQUELCH_CLOSED;
+    sq->env = 0.0f;
+    sq->count = 0;
+    sq->end_idx = 0;
+    sq->last_end_idx = 0;
+    sq->burst_len = 0;
+    sq->burst_idx = 0;
+    sq->history_len = 0;
+    atomic_store(&sq->bursts, 0);
+}
+
+bool squelch_process(struct squelch *sq, const int8_t *buf, size_t n_samples, uint64_t base_idx) {
+    const struct squelch_config *c = &sq->config;
+    size_t seg = 0;
+
+    for (size_t i = 0; i < n_samples; i++) {
+        uint64_t idx = base_idx + i;
+        float re = buf[2 * i], im = buf[2 * i + 1];
+        sq->env += c->smoothing * ((re * re + im * im) * (1.0f / (128.0f * 128.0f)) - sq->env);
+
+        switch (sq->state) {
+        case SQUELCH_CLOSED:
+            if (sq->env <= c->threshold) {
+                sq->count = 0;
+                break;
+            }
+            if (++sq->count < c->attack) {
+                break;
+            }
+
+            // open: include pre-padding, reaching back into history if needed
+            uint64_t lookback = (uint64_t) c->attack - 1 + c->pre;
+            uint64_t start = idx >= lookback ? idx - lookback : 0;
+            uint64_t oldest = base_idx - sq->history_len;
+            if (start < oldest) {
+                start = oldest;
+            }
+            if (start < sq->last_end_idx) {
+                start = sq->last_end_idx;
+            }
+
+            sq->burst_idx = start;
+            if (start < base_idx) {
+                size_t offset = (size_t) (start - oldest);
+                if (!burst_append(sq, sq->history + offset * 2, sq->history_len - offset)) {
+                    return false;
+                }
+                seg = 0;
+            } else {
+                seg = (size_t) (start - base_idx);
+            }
+
+            sq->state = SQUELCH_OPEN;
+            sq->count = 0;
+            break;
+        case SQUELCH_OPEN:
+            if (sq->env > c->threshold) {
+                sq->count = 0;
+                break;
+            }
+            if (++sq->count >= c->release) {
+                sq->state = SQUELCH_TAIL;
+                sq->end_idx = idx + 1 + c->post;
+            }
+            break;
+        case SQUELCH_TAIL:
+            // energy came back during post-padding, the burst continues
+            if (sq->env > c->threshold) {
+                sq->state = SQUELCH_OPEN;
+                sq->count = 0;
+            }
+            break;
+        }
+
+        if (sq->state == SQUELCH_CLOSED) {
+            continue;
+        }
+
+        if (sq->state == SQUELCH_TAIL && idx + 1 >= sq->end_idx) {
+            if (!burst_append(sq, buf + seg * 2, i + 1 - seg) || !burst_emit(sq)) {
+                return false;
+            }
+            sq->state = SQUELCH_CLOSED;
+            sq->count = 0;
+            sq->last_end_idx = idx + 1;
+        } else if (sq->burst_len + (i + 1 - seg) >= c->max_len) {
+            // split long bursts, the continuation starts at the next sample
+            if (!burst_append(sq, buf + seg * 2, i + 1 - seg) || !burst_emit(sq)) {
+                return false;
+            }
+            sq->burst_idx = idx + 1;
+            seg = i + 1;
+        }
+    }
+
+    if (sq->state != SQUELCH_CLOSED && seg < n_samples) {
+        if (!burst_append(sq, buf + seg * 2, n_samples - seg)) {
+            return false;
+        }
+    }
+
+    history_update(sq, buf, n_samples);
+    return true;
+}
+
+bool squelch_flush(struct squelch *sq) {
+    bool ok = true;
+    if (sq->state != SQUELCH_CLOSED && sq->burst_len > 0) {
+        ok = burst_emit(sq);
+    }
+
+    sq->state = SQUELCH_CLOSED;
+    sq->env = 0.0f;
+    sq->count = 0;
+    sq->history_len = 0;
+    return ok;
+}
@@ -0,0 +1,109 @@
+#ifndef SQUELCH_H
+#define SQUELCH_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Squelch parameters. Lengths are in complex samples
+ */
+struct squelch_config {
+    float threshold;    // power threshold, 1.0 = full scale
+    float smoothing;    // coefficient of the single-pole power envelope
+    uint32_t attack;    // consecutive samples above threshold that open the squelch
+    uint32_t release;   // consecutive samples below threshold that close the squelch
+    uint32_t pre;       // samples kept before the burst
+    uint32_t post;      // samples kept after the burst
+    size_t max_len;     // longer bursts are split
+};
+
+/**
+ * Callback invoked for every completed burst. Ownership of buf is
+ * transferred to the callee
+ *
+ * @param ctx callback context
+ * @param buf interleaved int8 IQ samples, allocated with malloc
+ * @param len buffer length in bytes
+ * @param start_idx stream index of the first sample
+ *
+ * @return false to stop processing
+ */
+typedef bool (*squelch_emit_fn)(void *ctx, int8_t *buf, size_t len, uint64_t start_idx);
+
+/**
+ * Energy-detect squelch that cuts int8 IQ stream into bursts
+ */
+struct squelch {
+    struct squelch_config config;
+    squelch_emit_fn emit;
+    void *ctx;
+
+    enum { SQUELCH_CLOSED, SQUELCH_OPEN, SQUELCH_TAIL } state;
+    float env;
+    uint32_t count;
+    uint64_t end_idx;
+    uint64_t last_end_idx;
+
+    int8_t *burst;
+    size_t burst_len;
+    size_t burst_cap;
+    uint64_t burst_idx;
+
+    int8_t *history;
+    size_t history_len;
+    size_t history_cap;
+
+    atomic_ullong bursts;
+};
+
+/**
+ * Initialize squelch
+ *
+ * @param sq squelch
+ * @param config parameters
+ * @param emit burst callback
+ * @param ctx callback context
+ *
+ * @return false if memory allocation failed
+ */
+bool squelch_init(struct squelch *sq, const struct squelch_config *config, squelch_emit_fn emit, void *ctx);
+
+/**
+ * Destroy squelch and drop a burst in progress
+ *
+ * @param sq squelch
+ */
+void squelch_deinit(struct squelch *sq);
+
+/**
+ * Reset state at the start of a stream
+ *
+ * @param sq squelch
+ */
+void squelch_reset(struct squelch *sq);
+
+/**
+ * Process a block of samples
+ *
+ * @param sq squelch
+ * @param buf interleaved int8 IQ samples
+ * @param n_samples number of complex samples
+ * @param base_idx stream index of the first sample
+ *
+ * @return false if memory allocation failed or the callback requested stop
+ */
+bool squelch_process(struct squelch *sq, const int8_t *buf, size_t n_samples, uint64_t base_idx);
+
+/**
+ * End the contiguous input, e.g. at a retune. A burst in progress is emitted
+ * as is and history before the gap is never used as pre-padding
+ *
+ * @param sq squelch
+ *
+ * @return false if the callback requested stop
+ */
+bool squelch_flush(struct squelch *sq);
+
+#endif // SQUELCH_H
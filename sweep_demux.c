@@ -0,0 +1,263 @@
+#include "sweep_demux.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+bool sweep_demux_init(struct sweep_demux *d, size_t capacity, int max_tunings, size_t settle, size_t stream_len) {
+    memset(d, 0, sizeof(*d));
+    if (capacity < SWEEP_BLOCK_SAMPLES || max_tunings <= 0 || capacity > SIZE_MAX / 2 / (size_t) max_tunings) {
+        return false;
+    }
+
+    d->capacity = capacity;
+    d->max_rings = max_tunings;
+    d->settle = settle;
+    d->stream = stream_len > 0;
+
+    d->arena = malloc(2 * capacity * (size_t) max_tunings);
+    d->rings = calloc((size_t) max_tunings, sizeof(struct sweep_ring));
+    if (d->arena == NULL || d->rings == NULL) {
+        free(d->arena);
+        free(d->rings);
+        return false;
+    }
+
+    // fault the pages in now rather than from the rx callback
+    memset(d->arena, 0, 2 * capacity * (size_t) max_tunings);
+    for (int i = 0; i < max_tunings; i++) {
+        d->rings[i].buf = d->arena + 2 * capacity * (size_t) i;
+    }
+
+    // the queue holds one item less than its length
+    if (!queue_init(&d->segments, sizeof(struct sweep_segment), d->stream ? stream_len + 1 : 0)) {
+        free(d->arena);
+        free(d->rings);
+        return false;
+    }
+
+    pthread_mutex_init(&d->mutex, NULL);
+    pthread_cond_init(&d->data, NULL);
+    atomic_init(&d->blocks, 0);
+    atomic_init(&d->dropped_blocks, 0);
+    atomic_init(&d->overwritten, 0);
+    atomic_init(&d->segments_dropped, 0);
+    return true;
+}
+
+void sweep_demux_deinit(struct sweep_demux *d) {
+    queue_deinit(&d->segments);
+    pthread_mutex_destroy(&d->mutex);
+    pthread_cond_destroy(&d->data);
+    free(d->arena);
+    free(d->rings);
+    d->arena = NULL;
+    d->rings = NULL;
+}
+
+void sweep_demux_reset(struct sweep_demux *d, size_t dwell_blocks) {
+    struct sweep_segment seg;
+    while (queue_pop_noblock(&d->segments, &seg)) {
+    }
+
+    pthread_mutex_lock(&d->mutex);
+    d->n_rings = 0;
+    d->dwell_blocks = dwell_blocks;
+    d->dwelling = false;
+    d->steps = 0;
+    pthread_mutex_unlock(&d->mutex);
+
+    atomic_store(&d->blocks, 0);
+    atomic_store(&d->dropped_blocks, 0);
+    atomic_store(&d->overwritten, 0);
+    atomic_store(&d->segments_dropped, 0);
+}
+
+static int find_ring(struct sweep_demux *d, uint64_t freq, bool create) {
+    for (int i = 0; i < d->n_rings; i++) {
+        if (d->rings[i].freq == freq) {
+            return i;
+        }
+    }
+
+    if (!create || d->n_rings == d->max_rings) {
+        return -1;
+    }
+
+    struct sweep_ring *r = &d->rings[d->n_rings];
+    r->freq = freq;
+    r->head = 0;
+    r->tail = 0;
+    return d->n_rings++;
+}
+
+static void ring_write(struct sweep_demux *d, struct sweep_ring *r, const int8_t *iq, size_t n) {
+    size_t at = (size_t) (r->head % d->capacity);
+    size_t first = n < d->capacity - at ? n : d->capacity - at;
+    memcpy(r->buf + 2 * at, iq, 2 * first);
+    memcpy(r->buf, iq + 2 * first, 2 * (n - first));
+    r->head += n;
+
+    if (r->head - r->tail > d->capacity) {
+        atomic_fetch_add(&d->overwritten, r->head - d->capacity - r->tail);
+        r->tail = r->head - d->capacity;
+    }
+}
+
+static void ring_copy(struct sweep_demux *d, const struct sweep_ring *r, uint64_t pos, int8_t *out, size_t n) {
+    size_t at = (size_t) (pos % d->capacity);
+    size_t first = n < d->capacity - at ? n : d->capacity - at;
+    memcpy(out, r->buf + 2 * at, 2 * first);
+    memcpy(out + 2 * first, r->buf, 2 * (n - first));
+}
+
+static void end_dwell(struct sweep_demux *d) {
+    if (!d->dwelling) {
+        return;
+    }
+
+    d->dwelling = false;
+    if (d->stream && d->cur.samples > 0 && !queue_push_noblock(&d->segments, &d->cur)) {
+        atomic_fetch_add(&d->segments_dropped, 1);
+    }
+}
+
+void sweep_demux_process(struct sweep_demux *d, const uint8_t *buf, size_t len) {
+    bool written = false;
+
+    pthread_mutex_lock(&d->mutex);
+    for (size_t off = 0; off + SWEEP_BLOCK_SIZE <= len; off += SWEEP_BLOCK_SIZE) {
+        const uint8_t *blk = buf + off;
+        atomic_fetch_add(&d->blocks, 1);
+
+        if (blk[0] != SWEEP_MARKER || blk[1] != SWEEP_MARKER) {
+            atomic_fetch_add(&d->dropped_blocks, 1);
+            end_dwell(d);
+            continue;
+        }
+
+        uint64_t freq = 0;
+        for (int i = 7; i >= 0; i--) {
+            freq = (freq << 8) | blk[2 + i];
+        }
+
+        if (d->dwelling && freq != d->cur.freq) {
+            end_dwell(d);
+        }
+
+        if (!d->dwelling) {
+            int ring = find_ring(d, freq, true);
+            if (ring < 0) {
+                atomic_fetch_add(&d->dropped_blocks, 1);
+                continue;
+            }
+
+            d->cur = (struct sweep_segment) {
+                .index = d->steps++,
+                .freq = freq,
+                .pos = d->rings[ring].head,
+                .samples = 0,
+                .ring = ring,
+            };
+            d->dwelling = true;
+            d->cur_blocks = 0;
+            d->skip = d->settle;
+        }
+
+        const int8_t *iq = (const int8_t *) (blk + SWEEP_HEADER_SIZE);
+        size_t n = SWEEP_BLOCK_SAMPLES;
+        if (d->skip > 0) {
+            size_t k = d->skip < n ? d->skip : n;
+            iq += 2 * k;
+            n -= k;
+            d->skip -= k;
+        }
+
+        if (n > 0) {
+            ring_write(d, &d->rings[d->cur.ring], iq, n);
+            d->cur.samples += n;
+            written = true;
+        }
+
+        if (++d->cur_blocks == d->dwell_blocks) {
+            end_dwell(d);
+        }
+    }
+    pthread_mutex_unlock(&d->mutex);
+
+    if (written) {
+        pthread_cond_broadcast(&d->data);
+    }
+}
+
+size_t sweep_demux_wait(struct sweep_demux *d, uint64_t freq, unsigned int timeout_ms) {
+    pthread_mutex_lock(&d->mutex);
+    int ring = find_ring(d, freq, false);
+    size_t n = ring >= 0 ? (size_t) (d->rings[ring].head - d->rings[ring].tail) : 0;
+
+    if (n == 0 && timeout_ms > 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += timeout_ms / 1000;
+        ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&d->data, &d->mutex, &ts);
+
+        ring = find_ring(d, freq, false);
+        n = ring >= 0 ? (size_t) (d->rings[ring].head - d->rings[ring].tail) : 0;
+    }
+    pthread_mutex_unlock(&d->mutex);
+
+    return n;
+}
+
+size_t sweep_demux_read(struct sweep_demux *d, uint64_t freq, int8_t *out, size_t max_samples) {
+    pthread_mutex_lock(&d->mutex);
+    int ring = find_ring(d, freq, false);
+    size_t n = 0;
+    if (ring >= 0) {
+        struct sweep_ring *r = &d->rings[ring];
+        n = (size_t) (r->head - r->tail);
+        if (n > max_samples) {
+            n = max_samples;
+        }
+        ring_copy(d, r, r->tail, out, n);
+        r->tail += n;
+    }
+    pthread_mutex_unlock(&d->mutex);
+
+    return n;
+}
+
+bool sweep_demux_pop_segment(struct sweep_demux *d, struct sweep_segment *seg, bool block, unsigned int timeout_ms) {
+    return block ? queue_pop(&d->segments, seg, timeout_ms) : queue_pop_noblock(&d->segments, seg);
+}
+
+bool sweep_demux_copy_segment(struct sweep_demux *d, const struct sweep_segment *seg, int8_t *out) {
+    pthread_mutex_lock(&d->mutex);
+    const struct sweep_ring *r = &d->rings[seg->ring];
+    bool ok = seg->ring < d->n_rings && r->freq == seg->freq && r->head - seg->pos <= d->capacity;
+    if (ok) {
+        ring_copy(d, r, seg->pos, out, seg->samples);
+    }
+    pthread_mutex_unlock(&d->mutex);
+
+    if (!ok) {
+        atomic_fetch_add(&d->segments_dropped, 1);
+    }
+    return ok;
+}
+
+int sweep_demux_tunings(struct sweep_demux *d, uint64_t *freqs, size_t *buffered) {
+    pthread_mutex_lock(&d->mutex);
+    int n = d->n_rings;
+    for (int i = 0; i < n; i++) {
+        freqs[i] = d->rings[i].freq;
+        buffered[i] = (size_t) (d->rings[i].head - d->rings[i].tail);
+    }
+    pthread_mutex_unlock(&d->mutex);
+
+    return n;
+}
@@ -0,0 +1,168 @@
+#ifndef SWEEP_DEMUX_H
+#define SWEEP_DEMUX_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "queue.h"
+
+/**
+ * Every sweep block starts with two marker bytes followed by the tuned
+ * frequency as a little endian uint64, the rest of the block is IQ data
+ */
+#define SWEEP_BLOCK_SIZE 16384
+#define SWEEP_HEADER_SIZE 10
+#define SWEEP_MARKER 0x7f
+#define SWEEP_BLOCK_SAMPLES ((SWEEP_BLOCK_SIZE - SWEEP_HEADER_SIZE) / 2)
+
+/**
+ * Samples of one tuning, positions count samples since the sweep started
+ */
+struct sweep_ring {
+    uint64_t freq;
+    int8_t *buf;
+    uint64_t head;          // samples written
+    uint64_t tail;          // samples consumed by sweep_demux_read
+};
+
+/**
+ * One dwell at a tuning, the samples stay in the ring until overwritten
+ */
+struct sweep_segment {
+    uint64_t index;         // sweep step counter
+    uint64_t freq;
+    uint64_t pos;           // ring position of the first sample
+    size_t samples;
+    int ring;
+};
+
+/**
+ * Splits the sweep stream into one ring buffer per tuning. Block headers are
+ * stripped, the oldest samples of a ring are overwritten when the consumer
+ * falls behind. Completed dwells can also be queued as segments
+ */
+struct sweep_demux {
+    int8_t *arena;
+    struct sweep_ring *rings;
+    int n_rings;
+    int max_rings;
+    size_t capacity;        // samples per ring
+    size_t settle;          // samples skipped at the start of each dwell
+
+    pthread_mutex_t mutex;  // guards rings against readers
+    pthread_cond_t data;
+
+    size_t dwell_blocks;    // blocks per sweep step, 0 if unknown
+    struct sweep_segment cur;
+    bool dwelling;
+    size_t cur_blocks;
+    size_t skip;
+    uint64_t steps;
+
+    bool stream;
+    struct queue segments;
+
+    atomic_ullong blocks;
+    atomic_ullong dropped_blocks;       // bad marker or no free ring
+    atomic_ullong overwritten;          // samples lost before sweep_demux_read
+    atomic_ullong segments_dropped;
+};
+
+/**
+ * Allocate and prefault the rings
+ *
+ * @param d demultiplexer
+ * @param capacity samples per ring
+ * @param max_tunings number of rings, blocks of further tunings are dropped
+ * @param settle samples skipped at the start of each dwell
+ * @param stream_len segment FIFO size, 0 disables segments
+ *
+ * @return false if parameters are invalid or memory allocation failed
+ */
+bool sweep_demux_init(struct sweep_demux *d, size_t capacity, int max_tunings, size_t settle, size_t stream_len);
+
+/**
+ * Destroy demultiplexer
+ *
+ * @param d demultiplexer
+ */
+void sweep_demux_deinit(struct sweep_demux *d);
+
+/**
+ * Forget all tunings and pending segments at the start of a sweep
+ *
+ * @param d demultiplexer
+ * @param dwell_blocks blocks per sweep step, a dwell also ends when the
+ * frequency changes
+ */
+void sweep_demux_reset(struct sweep_demux *d, size_t dwell_blocks);
+
+/**
+ * Route a transfer of the sweep stream
+ *
+ * @param d demultiplexer
+ * @param buf transfer, a multiple of SWEEP_BLOCK_SIZE bytes
+ * @param len length in bytes
+ */
+void sweep_demux_process(struct sweep_demux *d, const uint8_t *buf, size_t len);
+
+/**
+ * Wait until samples of a tuning are available
+ *
+ * @param d demultiplexer
+ * @param freq tuned frequency in Hz
+ * @param timeout_ms timeout in milliseconds, 0 returns immediately
+ *
+ * @return number of buffered samples
+ */
+size_t sweep_demux_wait(struct sweep_demux *d, uint64_t freq, unsigned int timeout_ms);
+
+/**
+ * Consume the oldest buffered samples of a tuning
+ *
+ * @param d demultiplexer
+ * @param freq tuned frequency in Hz
+ * @param out interleaved int8 IQ
+ * @param max_samples capacity of out in complex samples
+ *
+ * @return number of samples copied
+ */
+size_t sweep_demux_read(struct sweep_demux *d, uint64_t freq, int8_t *out, size_t max_samples);
+
+/**
+ * Pop a completed dwell
+ *
+ * @param d demultiplexer
+ * @param seg pointer to store the segment
+ * @param block wait for data
+ * @param timeout_ms timeout in milliseconds, 0 will block forever
+ *
+ * @return true if a segment was popped
+ */
+bool sweep_demux_pop_segment(struct sweep_demux *d, struct sweep_segment *seg, bool block, unsigned int timeout_ms);
+
+/**
+ * Copy the samples of a popped segment
+ *
+ * @param d demultiplexer
+ * @param seg segment
+ * @param out seg->samples complex samples
+ *
+ * @return false if the samples were already overwritten
+ */
+bool sweep_demux_copy_segment(struct sweep_demux *d, const struct sweep_segment *seg, int8_t *out);
+
+/**
+ * List the tunings seen so far
+ *
+ * @param d demultiplexer
+ * @param freqs max_tunings frequencies
+ * @param buffered max_tunings buffered sample counts
+ *
+ * @return number of tunings
+ */
+int sweep_demux_tunings(struct sweep_demux *d, uint64_t *freqs, size_t *buffered);
+
+#endif // SWEEP_DEMUX_H
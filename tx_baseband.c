@@ -0,0 +1,62 @@
+#include "tx_baseband.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool tx_baseband_init(struct tx_baseband *t, double ratio, double freq, float gain, size_t n_taps) {
+    memset(t, 0, sizeof(*t));
+    t->shift = freq != 0.0;
+    t->scale = 127.0f * gain;
+
+    if (!resampler_init(&t->resampler, 2, ratio, n_taps)) {
+        resampler_deinit(&t->resampler);
+        return false;
+    }
+
+    nco_init(&t->nco, freq);
+    return true;
+}
+
+void tx_baseband_deinit(struct tx_baseband *t) {
+    resampler_deinit(&t->resampler);
+    free(t->work);
+    t->work = NULL;
+    t->work_cap = 0;
+}
+
+void tx_baseband_reset(struct tx_baseband *t) {
+    resampler_reset(&t->resampler);
+    nco_reset(&t->nco);
+}
+
+size_t tx_baseband_max_output(const struct tx_baseband *t, size_t n_in) {
+    return resampler_max_output(&t->resampler, n_in);
+}
+
+size_t tx_baseband_process(struct tx_baseband *t, const float *in, size_t n_in, int8_t *out) {
+    size_t n_max = tx_baseband_max_output(t, n_in);
+    if (2 * n_max > t->work_cap) {
+        float *w = realloc(t->work, 2 * n_max * sizeof(float));
+        if (w == NULL) {
+            return 0;
+        }
+        t->work = w;
+        t->work_cap = 2 * n_max;
+    }
+
+    size_t n_out = resampler_process(&t->resampler, in, n_in, t->work);
+    if (t->shift) {
+        nco_mix_cf32(&t->nco, t->work, t->work, n_out);
+    }
+
+    // saturate and round to nearest
+    const float *w = t->work;
+    float scale = t->scale;
+    for (size_t k = 0; k < 2 * n_out; k++) {
+        float v = w[k] * scale;
+        v = v > 127.0f ? 127.0f : v;
+        v = v < -127.0f ? -127.0f : v;
+        out[k] = (int8_t) (v + (v >= 0.0f ? 0.5f : -0.5f));
+    }
+
+    return n_out;
+}
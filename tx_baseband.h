@@ -0,0 +1,72 @@
+#ifndef TX_BASEBAND_H
+#define TX_BASEBAND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "nco.h"
+#include "resampler.h"
+
+/**
+ * Converts low rate float32 baseband to int8 IQ at the tx sample rate:
+ * polyphase interpolation, optional frequency shift and quantization
+ */
+struct tx_baseband {
+    struct resampler resampler;
+    struct nco nco;
+    bool shift;
+    float scale;
+    float *work;
+    size_t work_cap;
+};
+
+/**
+ * Initialize converter
+ *
+ * @param t converter
+ * @param ratio tx sample rate / baseband sample rate
+ * @param freq frequency shift normalized to the tx sample rate
+ * @param gain scale applied before quantization, 1.0 maps amplitude 1.0 to 127
+ * @param n_taps resampler filter length per phase
+ *
+ * @return false if memory allocation failed
+ */
+bool tx_baseband_init(struct tx_baseband *t, double ratio, double freq, float gain, size_t n_taps);
+
+/**
+ * Destroy converter
+ *
+ * @param t converter
+ */
+void tx_baseband_deinit(struct tx_baseband *t);
+
+/**
+ * Clear filter history and oscillator phase
+ *
+ * @param t converter
+ */
+void tx_baseband_reset(struct tx_baseband *t);
+
+/**
+ * Upper bound of output samples produced for n_in input samples
+ *
+ * @param t converter
+ * @param n_in number of input samples
+ *
+ * @return number of output samples
+ */
+size_t tx_baseband_max_output(const struct tx_baseband *t, size_t n_in);
+
+/**
+ * Convert a block of samples
+ *
+ * @param t converter
+ * @param in interleaved float32 IQ
+ * @param n_in number of complex input samples
+ * @param out interleaved int8 IQ, must hold tx_baseband_max_output() samples
+ *
+ * @return number of complex output samples, 0 on allocation failure
+ */
+size_t tx_baseband_process(struct tx_baseband *t, const float *in, size_t n_in, int8_t *out);
+
+#endif // TX_BASEBAND_H